@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSAGENTFILTER_H
+#define ATOMSGAFFER_ATOMSAGENTFILTER_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AtomsGaffer
+{
+
+// Compiled agent id filter, as typed in the agentIds plugs.
+// The filter is a comma separated list of ids and id ranges, like "0-100,150", where a
+// leading '!' excludes the id or the range. The ranges are stored as sorted disjoint intervals,
+// so testing an agent is a binary search and the cost doesn't depend on the width of the ranges.
+class AtomsAgentFilter
+{
+
+    public:
+
+        typedef std::shared_ptr<const AtomsAgentFilter> ConstPtr;
+
+        explicit AtomsAgentFilter( const std::string& filter );
+
+        // Return the compiled filter, filters are compiled once and shared between all the nodes using them
+        static ConstPtr get( const std::string& filter );
+
+        // True if the filter doesn't contain any entry
+        bool empty() const;
+
+        // True if the agent passes the filter. When invert is true the excluded entries are
+        // used as the included ones and vice versa. An agent passes a filter without included entries
+        // unless it is excluded.
+        bool match( int agentId, bool invert = false ) const;
+
+        // Set agentsFiltered to the agents passing the filter, in the same order as agentIds
+        void filter( const std::vector<int>& agentIds, std::vector<int>& agentsFiltered, bool invert = false ) const;
+
+    private:
+
+        // Closed interval of agent ids
+        typedef std::pair<int, int> Interval;
+        typedef std::vector<Interval> Intervals;
+
+        static void merge( Intervals& intervals );
+
+        static bool contains( const Intervals& intervals, int agentId );
+
+    private:
+
+        Intervals m_included;
+
+        Intervals m_excluded;
+
+};
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSAGENTFILTER_H
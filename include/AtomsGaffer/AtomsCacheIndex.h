@@ -0,0 +1,134 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSCACHEINDEX_H
+#define ATOMSGAFFER_ATOMSCACHEINDEX_H
+
+#include "IECore/RefCounted.h"
+
+#include "AtomsCore/Metadata/MapMetadata.h"
+#include "AtomsCore/Metadata/PoseMetadata.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Atoms
+{
+class AtomsCache;
+}
+
+namespace AtomsGaffer
+{
+
+IE_CORE_FORWARDDECLARE( AtomsCacheIndex )
+
+// Sidecar index of a frame of an atoms cache. It stores the pose and the metadata of every agent
+// of the frame in a block of its own, with a table of the block offsets, so a few agents can be
+// loaded without reading the whole frame files. The index is ignored when the frame files have
+// been written again after it.
+//
+// The layout of the atoms frame files is private to the atoms library, which only loads whole
+// frames, so the index can't point into them : it holds a copy of the agent data, roughly doubling
+// the disk size of the cache. It is only used for the frames that aren't interpolated. Nothing
+// writes an index implicitly, it is only written by an explicit call to build(), for the caches
+// where loading agent subsets is worth the disk space.
+class AtomsCacheIndex : public IECore::RefCounted
+{
+
+    public:
+
+        IE_CORE_DECLAREMEMBERPTR( AtomsCacheIndex );
+
+        ~AtomsCacheIndex() override;
+
+        // Path of the index of a cache frame, next to the frame files
+        static std::string indexPath( const std::string& cachePath, const std::string& cacheName, int frame );
+
+        // Build the index of every frame of the cache of an atoms sim file, writing a copy of all the agent
+        // data next to the frame files. Returns the number of frames indexed.
+        static int build( const std::string& atomsSimFile );
+
+        // Build the index of a single cache frame. Throws an IECore::IOException if the index can't be written.
+        static void build( const std::string& cachePath, const std::string& cacheName, int frame );
+
+        // Open the index of a cache frame. Returns null if there is no index, or if it is out of date.
+        static ConstAtomsCacheIndexPtr open( const std::string& cachePath, const std::string& cacheName, int frame );
+
+        size_t numAgents() const;
+
+        bool hasAgent( int agentId ) const;
+
+        // Load the pose and the metadata of an agent, decoding its block from the mapped index.
+        // Throws an IECore::InvalidArgumentException if the agent isn't in the index.
+        void loadAgent( int agentId, AtomsCore::PoseMetadata& pose, AtomsCore::MapMetadata& metadata ) const;
+
+        // Memory used by the agent table
+        size_t memorySize() const;
+
+    private:
+
+        AtomsCacheIndex( const std::string& path );
+
+        class MappedFile;
+
+        struct Block
+        {
+            int32_t agentId;
+            uint32_t reserved;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        const Block* block( int agentId ) const;
+
+        static void buildFrame( Atoms::AtomsCache& cache, const std::string& cachePath, const std::string& cacheName, int frame );
+
+        std::string m_path;
+
+        // The index is mapped, so the blocks of the agents are paged in on demand and are shared
+        // with the other processes reading the same index
+        std::unique_ptr<MappedFile> m_file;
+
+        // Sorted by agent id
+        std::vector<Block> m_blocks;
+
+};
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSCACHEINDEX_H
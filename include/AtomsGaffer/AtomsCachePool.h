@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSCACHEPOOL_H
+#define ATOMSGAFFER_ATOMSCACHEPOOL_H
+
+#include "Atoms/AtomsCache.h"
+#include "Atoms/AgentTypes.h"
+
+#include "IECore/MurmurHash.h"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AtomsGaffer
+{
+
+// Process wide registry of the data shared between the atoms caches opened by the nodes.
+// The data is keyed by the resolved cache path and the refresh count of the node reading it,
+// so the nodes with different refresh counts never evict each other's data. A cache is opened
+// once per entry, and every engine loads its frames from its own copy of it, so the header is
+// read once and the agent types are loaded only once and shared by all the copies.
+class AtomsCachePool
+{
+
+    public:
+
+        typedef AtomsPtr<Atoms::AtomsCache> CachePtr;
+
+        static AtomsCachePool& instance();
+
+        // Return a cache ready to load frames, or a null pointer if the cache can't be opened. The cache is
+        // opened once per path and refresh count, keeping its header resident, and every caller gets its own
+        // copy of the opened cache, so the frames loaded by the callers never share any state.
+        CachePtr open( const std::string& cachePath, const std::string& cacheName, int refreshCount );
+
+        // Add the given agent types to the cache. The types already loaded by another cache of the same path
+        // and refresh count are shared, the other ones are loaded by the cache and shared from then on.
+        // Returns the number of agent types loaded from disk.
+        size_t loadAgentTypes( const std::string& cachePath, const std::string& cacheName, int refreshCount, Atoms::AtomsCache& cache, const std::vector<std::string>& agentTypeNames );
+
+        // Return the memory used by the agent types shared by the caches of the given path and refresh count
+        size_t agentTypesMemory( const std::string& cachePath, const std::string& cacheName, int refreshCount );
+
+        // Return a fingerprint of the frame files read for the given frame. The frame is clamped to the cache
+        // frame range, so the frames outside the range get the same fingerprint as the first and last frames.
+        // The fingerprint is made of the content of the frame files, without the frame number, so the held
+        // frames get the same fingerprint too. The content of every file is hashed once, then again only when
+        // its size or modification time changes. The fingerprint of a frame is computed once per refresh count :
+        // the files rewritten since are picked up when the refresh count changes.
+        IECore::MurmurHash frameHash( const std::string& cachePath, const std::string& cacheName, int refreshCount, double frame );
+
+        // Remove all the shared data from the pool
+        void clear();
+
+        // Split the path of an atoms cache file in the cache folder and the cache name.
+        // The cache name is empty if the file doesn't have the given extension.
+        static void splitFilePath( const std::string& filePath, std::string& cachePath, std::string& cacheName, const std::string& extension = "atoms" );
+
+        // The types of the files written by atoms for every frame of a cache
+        static const std::vector<std::string>& frameFileTypes();
+
+        // Return the path of the file of the given type written by atoms for a cache frame
+        static std::string frameFilePath( const std::string& cachePath, const std::string& cacheName, int frame, const std::string& fileType );
+
+    private:
+
+        AtomsCachePool() = default;
+
+        ~AtomsCachePool() = default;
+
+        AtomsCachePool( const AtomsCachePool& ) = delete;
+
+        AtomsCachePool& operator=( const AtomsCachePool& ) = delete;
+
+    private:
+
+        struct Entry
+        {
+            Entry() : cacheOpened( false ) {}
+
+            std::mutex mutex;
+
+            // The cache opened for the entry, null if it can't be opened. It never loads any frame,
+            // it is only copied by open() and read for its frame range.
+            CachePtr cache;
+
+            bool cacheOpened;
+
+            std::map<std::string, Atoms::AgentTypePtr> agentTypes;
+
+            // The fingerprints of the cache frames, with the most recently used frame at the front of the list
+            std::map<int, std::pair<IECore::MurmurHash, std::list<int>::iterator>> frameFingerprints;
+
+            std::list<int> frameFingerprintsOrder;
+        };
+
+        typedef std::shared_ptr<Entry> EntryPtr;
+
+        typedef std::pair<std::string, int> EntryKey;
+
+        EntryPtr entry( const std::string& cachePath, const std::string& cacheName, int refreshCount );
+
+        // Return the cache of the entry, opening it on first use
+        static CachePtr entryCache( Entry& entry, const std::string& cachePath, const std::string& cacheName );
+
+        IECore::MurmurHash frameFingerprint( Entry& entry, const std::string& cachePath, const std::string& cacheName, int frame );
+
+        // Return the hash of the content of a file, hashing it again only if its size or modification time changed
+        IECore::MurmurHash fileHash( const std::string& filePath );
+
+        std::mutex m_mutex;
+
+        // The entries, with the most recently used key at the front of the list
+        std::map<EntryKey, std::pair<EntryPtr, std::list<EntryKey>::iterator>> m_entries;
+
+        std::list<EntryKey> m_entriesOrder;
+
+        struct FileHash
+        {
+            uint64_t size;
+            int64_t writeTime;
+            IECore::MurmurHash hash;
+            std::list<std::string>::iterator order;
+        };
+
+        std::mutex m_fileHashesMutex;
+
+        // The content hashes of the frame files, with the most recently used file at the front of the list
+        std::map<std::string, FileHash> m_fileHashes;
+
+        std::list<std::string> m_fileHashesOrder;
+
+};
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSCACHEPOOL_H
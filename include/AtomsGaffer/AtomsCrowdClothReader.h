@@ -37,6 +37,7 @@
 #ifndef ATOMSGAFFER_ATOMSCROWDCLOTHREADER_H
 #define ATOMSGAFFER_ATOMSCROWDCLOTHREADER_H
 
+#include "AtomsGaffer/AtomsStatistics.h"
 #include "AtomsGaffer/TypeIds.h"
 
 #include "GafferScene/SceneProcessor.h"
@@ -67,6 +68,11 @@ namespace AtomsGaffer
         Gaffer::IntPlug *refreshCountPlug();
         const Gaffer::IntPlug *refreshCountPlug() const;
 
+        // Returns the memory, load time and cloth mesh counts of the frames loaded by this node.
+        // See AtomsStatistics.
+        IECore::CompoundDataPtr statistics() const;
+        void clearStatistics();
+
         void affects( const Gaffer::Plug *input, AffectedPlugsContainer &outputs ) const override;
 
     protected:
@@ -82,6 +88,8 @@ namespace AtomsGaffer
 
         static size_t g_firstPlugIndex;
 
+        mutable AtomsStatistics m_statistics;
+
     };
 
 } // namespace AtomsGaffer
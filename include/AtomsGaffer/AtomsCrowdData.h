@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSCROWDDATA_H
+#define ATOMSGAFFER_ATOMSCROWDDATA_H
+
+#include "AtomsGaffer/TypeIds.h"
+
+#include "IECore/CompoundData.h"
+#include "IECore/Object.h"
+
+#include "ImathBox.h"
+#include "ImathMatrix.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AtomsGaffer
+{
+
+// Pose data of a whole crowd, stored as structure of arrays.
+// The skinning and normal matrices of all the agents live in two contiguous arrays,
+// the matrices of the agent at index i start at matrixOffsets()[i] and end at matrixOffsets()[i+1].
+// Root matrix, bounding box, pose hash, agent type and metadata are stored in per agent arrays
+// indexed by the same agent index. The AtomsCrowdReader outputs this object in the atoms:agents attribute.
+// A compact crowd stores the skinning matrices as float 3x4 affine matrices in a single array and doesn't
+// store the normal matrices, they can be computed from the skinning matrices when needed.
+class AtomsCrowdData : public IECore::Object
+{
+
+    public:
+
+        AtomsCrowdData();
+
+        IE_CORE_DECLAREEXTENSIONOBJECT( AtomsCrowdData, AtomsGaffer::TypeId::AtomsCrowdDataTypeId, IECore::Object );
+
+        // Resize all the arrays for the given agents, numJoints[i] is the number of matrices of agentIds[i].
+        // All the per agent data is reset to its default value.
+        void setAgents( const std::vector<int>& agentIds, const std::vector<size_t>& numJoints, bool compact = false );
+
+        bool isCompact() const;
+
+        size_t numAgents() const;
+
+        // Return the index of the agent, or -1 if the agent isn't stored
+        int agentIndex( int agentId ) const;
+
+        const std::vector<int>& agentIds() const;
+
+        const std::vector<size_t>& matrixOffsets() const;
+
+        size_t numJoints( size_t index ) const;
+
+        // Skinning matrices, worldBindPoseInverseMatrix * worldMatrix for every joint of every agent
+        const std::vector<Imath::M44d>& worldMatrices() const;
+        std::vector<Imath::M44d>& worldMatrices();
+
+        // Inverse transpose of the skinning matrices
+        const std::vector<Imath::M44d>& normalMatrices() const;
+        std::vector<Imath::M44d>& normalMatrices();
+
+        // Pointers to the first skinning and normal matrix of the agent at the given index
+        const Imath::M44d* worldMatrices( size_t index ) const;
+        Imath::M44d* worldMatrices( size_t index );
+        const Imath::M44d* normalMatrices( size_t index ) const;
+        Imath::M44d* normalMatrices( size_t index );
+
+        // Skinning matrices of a compact crowd, 12 floats for every joint
+        const std::vector<float>& compactMatrices() const;
+        std::vector<float>& compactMatrices();
+        const float* compactMatrices( size_t index ) const;
+        float* compactMatrices( size_t index );
+
+        // Returns the skinning matrices of the agent at the given index, expanding the compact matrices if needed
+        void skinningMatrices( size_t index, std::vector<Imath::M44d>& matrices ) const;
+
+        // Conversion between an affine matrix and its compact form. The last column of the matrix is
+        // always ( 0, 0, 0, 1 ), so only the first three columns of every row are stored.
+        static void compactMatrix( const Imath::M44d& matrix, float* compact );
+        static Imath::M44d expandMatrix( const float* compact );
+
+        const std::vector<Imath::M44d>& rootMatrices() const;
+        std::vector<Imath::M44d>& rootMatrices();
+
+        // Agent bounding boxes computed from the joint positions
+        const std::vector<Imath::Box3d>& bounds() const;
+        std::vector<Imath::Box3d>& bounds();
+
+        // Hash of the agent pose in local space, used to instance agents with the same pose
+        const std::vector<uint64_t>& poseHashes() const;
+        std::vector<uint64_t>& poseHashes();
+
+        const std::vector<std::string>& agentTypes() const;
+        std::vector<std::string>& agentTypes();
+
+        // Agent metadata translated to cortex data
+        const std::vector<IECore::ConstCompoundDataPtr>& metadata() const;
+        std::vector<IECore::ConstCompoundDataPtr>& metadata();
+
+        float getFrameOffset() const;
+        void setFrameOffset( float frameOffset );
+
+    private:
+
+        void updateAgentIndices();
+
+        std::vector<int> m_agentIds;
+
+        std::unordered_map<int, size_t> m_agentIndices;
+
+        std::vector<size_t> m_matrixOffsets;
+
+        std::vector<Imath::M44d> m_worldMatrices;
+
+        std::vector<Imath::M44d> m_normalMatrices;
+
+        std::vector<float> m_compactMatrices;
+
+        bool m_compact;
+
+        std::vector<Imath::M44d> m_rootMatrices;
+
+        std::vector<Imath::Box3d> m_bounds;
+
+        std::vector<uint64_t> m_poseHashes;
+
+        std::vector<std::string> m_agentTypes;
+
+        std::vector<IECore::ConstCompoundDataPtr> m_metadata;
+
+        float m_frameOffset;
+
+        static const unsigned int m_ioVersion;
+
+};
+
+IE_CORE_DECLAREPTR( AtomsCrowdData );
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSCROWDDATA_H
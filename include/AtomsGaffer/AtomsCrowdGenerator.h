@@ -37,6 +37,7 @@
 #ifndef ATOMSGAFFER_ATOMSCROWDGENERATOR_H
 #define ATOMSGAFFER_ATOMSCROWDGENERATOR_H
 
+#include "AtomsGaffer/AtomsCrowdData.h"
 #include "AtomsGaffer/TypeIds.h"
 
 #include "GafferScene/BranchCreator.h"
@@ -49,6 +50,8 @@
 namespace AtomsGaffer
 {
 
+class AtomsCrowdReader;
+
 class AtomsCrowdGenerator : public GafferScene::BranchCreator
 {
 
@@ -119,7 +122,15 @@ class AtomsCrowdGenerator : public GafferScene::BranchCreator
 
 		void atomsPoseHash( const ScenePath &parentPath, const ScenePath &branchPath, const Gaffer::Context *context, IECore::MurmurHash &h) const;
 
-        IECore::ConstCompoundDataPtr agentCacheData(const ScenePath &branchPath) const;
+        // Returns the reader computing the input crowd when its attributes reach the generator unchanged,
+        // so the agents can be computed individually by the reader
+        const AtomsCrowdReader *crowdReader() const;
+
+        // The agents are computed individually by the reader when crowdReader() finds one. Otherwise they are
+        // sliced from the crowd of the input, which is computed once for all of them.
+        void agentCacheHash( const ScenePath &branchPath, IECore::MurmurHash &h ) const;
+        // Returns the crowd data containing the agent, and the index of the agent inside it
+        ConstAtomsCrowdDataPtr agentCacheData( const ScenePath &branchPath, size_t &agentIndex ) const;
 
         IECore::ConstCompoundDataPtr agentClothMeshData( const ScenePath &parentPath, const ScenePath &branchPath ) const;
 
@@ -130,7 +141,7 @@ class AtomsCrowdGenerator : public GafferScene::BranchCreator
                 IECoreScene::MeshPrimitivePtr& result,
                 IECoreScene::ConstMeshPrimitivePtr& meshPrim,
                 IECore::ConstCompoundObjectPtr& meshAttributes,
-                const std::vector<Imath::M44d>& worldMatrices,
+                const Imath::M44d* worldMatrices,
                 const Imath::M44f& transformMatrix
         		) const;
 
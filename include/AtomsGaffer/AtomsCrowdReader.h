@@ -37,12 +37,19 @@
 #ifndef ATOMSGAFFER_ATOMSCROWDREADER_H
 #define ATOMSGAFFER_ATOMSCROWDREADER_H
 
+#include "AtomsGaffer/AtomsStatistics.h"
 #include "AtomsGaffer/TypeIds.h"
 
 #include "GafferScene/ObjectSource.h"
+#include "GafferScene/ScenePlug.h"
 
 #include "Gaffer/StringPlug.h"
 #include "Gaffer/NumericPlug.h"
+#include "Gaffer/BoxPlug.h"
+#include "Gaffer/CompoundNumericPlug.h"
+#include "Gaffer/TypedObjectPlug.h"
+
+#include <memory>
 
 namespace AtomsGaffer
 {
@@ -57,7 +64,7 @@ class AtomsCrowdReader : public GafferScene::ObjectSource
 	public:
 
 		AtomsCrowdReader( const std::string &name = defaultName<AtomsCrowdReader>() );
-		~AtomsCrowdReader() = default;
+		~AtomsCrowdReader() override;
 
 		IE_CORE_DECLARERUNTIMETYPEDEXTENSION( AtomsGaffer::AtomsCrowdReader, TypeId::AtomsCrowdReaderTypeId, GafferScene::ObjectSource );
 
@@ -73,9 +80,96 @@ class AtomsCrowdReader : public GafferScene::ObjectSource
 		Gaffer::IntPlug *refreshCountPlug();
 		const Gaffer::IntPlug *refreshCountPlug() const;
 
+		Gaffer::IntPlug *prefetchFramesPlug();
+		const Gaffer::IntPlug *prefetchFramesPlug() const;
+
+		Gaffer::BoolPlug *compactPalettePlug();
+		const Gaffer::BoolPlug *compactPalettePlug() const;
+
+		enum CullMode
+		{
+			CullOff = 0,
+			CullBox = 1,
+			CullCamera = 2
+		};
+
+		Gaffer::IntPlug *cullModePlug();
+		const Gaffer::IntPlug *cullModePlug() const;
+
+		Gaffer::Box3fPlug *cullBoxPlug();
+		const Gaffer::Box3fPlug *cullBoxPlug() const;
+
+		GafferScene::ScenePlug *cullScenePlug();
+		const GafferScene::ScenePlug *cullScenePlug() const;
+
+		Gaffer::StringPlug *cullCameraPlug();
+		const Gaffer::StringPlug *cullCameraPlug() const;
+
+		Gaffer::FloatPlug *cullPaddingPlug();
+		const Gaffer::FloatPlug *cullPaddingPlug() const;
+
+		// Additional caches, loaded in parallel with the atomsSimFile cache and merged in a single crowd
+		Gaffer::StringVectorDataPlug *atomsSimFilesPlug();
+		const Gaffer::StringVectorDataPlug *atomsSimFilesPlug() const;
+
+		// The offset added to the agent ids of each of the atomsSimFiles caches, so their ids don't clash
+		Gaffer::IntVectorDataPlug *agentIdOffsetsPlug();
+		const Gaffer::IntVectorDataPlug *agentIdOffsetsPlug() const;
+
+		// The directory the loaded frames are saved in, so the other processes reading the same
+		// frames load them from there instead of reading and solving the caches again
+		Gaffer::StringPlug *diskCachePathPlug();
+		const Gaffer::StringPlug *diskCachePathPlug() const;
+
+		// The memory in megabytes used to keep the recently loaded frames, so scrubbing back to them
+		// doesn't load them again. Defaults to the ATOMSGAFFER_FRAME_CACHE_MEMORY environment variable.
+		Gaffer::IntPlug *frameCacheMemoryPlug();
+		const Gaffer::IntPlug *frameCacheMemoryPlug() const;
+
+		// Loads the frames of the playback range once in memory in a compact form, so they can be
+		// played back without reading the cache files. See AtomsPlaybackCache.
+		Gaffer::BoolPlug *playbackCachePlug();
+		const Gaffer::BoolPlug *playbackCachePlug() const;
+
+		Gaffer::V2iPlug *playbackRangePlug();
+		const Gaffer::V2iPlug *playbackRangePlug() const;
+
+		// The fraction of the agents kept for the previews. The agents are picked by a hash of their id,
+		// so the same agents are kept on every frame.
+		Gaffer::FloatPlug *previewFractionPlug();
+		const Gaffer::FloatPlug *previewFractionPlug() const;
+
+		// Space separated match patterns of the agent metadata translated to the atoms:agents attribute.
+		// The metadata matching excludeMetadataNames are skipped without being converted.
+		Gaffer::StringPlug *metadataNamesPlug();
+		const Gaffer::StringPlug *metadataNamesPlug() const;
+
+		Gaffer::StringPlug *excludeMetadataNamesPlug();
+		const Gaffer::StringPlug *excludeMetadataNamesPlug() const;
+
 		Gaffer::ObjectPlug *enginePlug();
 		const Gaffer::ObjectPlug *enginePlug() const;
 
+		// Outputs the data of the single agent specified by the agentIdContextName context variable.
+		// The AtomsCrowdGenerator pulls the agents from it when the reader's attributes reach the
+		// generator unchanged, so expanding one agent doesn't compute the whole crowd.
+		Gaffer::ObjectPlug *agentDataPlug();
+		const Gaffer::ObjectPlug *agentDataPlug() const;
+
+		// Outputs the playback caches of the files, loaded once for all the frames of the playback range
+		Gaffer::ObjectPlug *playbackCacheDataPlug();
+		const Gaffer::ObjectPlug *playbackCacheDataPlug() const;
+
+		// The int context variable naming the agent computed by agentDataPlug. It is only set when
+		// pulling that plug, never on the scene, since every node between the reader and the consumer
+		// would then compute and cache its output once per agent.
+		static const IECore::InternedString agentIdContextName;
+
+		// Returns the memory, load time, agent counts and cache hit and miss counters of the
+		// frames loaded by this node. See AtomsStatistics.
+		IECore::CompoundDataPtr statistics() const;
+		void clearStatistics();
+
 		void affects( const Gaffer::Plug *input, AffectedPlugsContainer &outputs ) const override;
 
 	protected:
@@ -96,9 +190,25 @@ class AtomsCrowdReader : public GafferScene::ObjectSource
 	private:
 
 		IE_CORE_FORWARDDECLARE( EngineData );
+		IE_CORE_FORWARDDECLARE( PlaybackCacheData );
+
+		class FrameCache;
+		class FramePrefetcher;
+
+		// Hashes the fingerprints of the cache frames read for the current frame, rather than the frame itself
+		void hashCacheFrame( const Gaffer::Context *context, IECore::MurmurHash &h ) const;
+
+		// Hashes the plugs used to cull the agents before loading them
+		void hashCullRegion( IECore::MurmurHash &h ) const;
 
 		static size_t g_firstPlugIndex;
 
+		mutable AtomsStatistics m_statistics;
+
+		std::unique_ptr<FrameCache> m_frameCache;
+
+		std::unique_ptr<FramePrefetcher> m_framePrefetcher;
+
 };
 
 } // namespace AtomsGaffer
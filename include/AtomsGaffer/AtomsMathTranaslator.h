@@ -44,6 +44,10 @@
 #include "ImathBox.h"
 #include "ImathMatrix.h"
 
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
 template<typename T, typename Y>
 inline void convertFromAtoms( T& out, const Y& in )
 {
@@ -177,15 +181,51 @@ inline void convertFromAtoms( Imath::Box3f& out, const AtomsCore::Box3& in )
 // vectors
 ///////////
 
+// The atoms and Imath types storing the same components in the same order,
+// so the arrays of them are converted with a single copy
+template<typename T, typename Y>
+struct AtomsSameLayout : std::is_same<T, Y> {};
+
+template<> struct AtomsSameLayout<Imath::V2d, AtomsCore::Vector2> : std::true_type {};
+template<> struct AtomsSameLayout<Imath::V2f, AtomsCore::Vector2f> : std::true_type {};
+template<> struct AtomsSameLayout<Imath::V3d, AtomsCore::Vector3> : std::true_type {};
+template<> struct AtomsSameLayout<Imath::V3f, AtomsCore::Vector3f> : std::true_type {};
+template<> struct AtomsSameLayout<Imath::M44d, AtomsCore::Matrix> : std::true_type {};
+template<> struct AtomsSameLayout<Imath::M44f, AtomsCore::Matrixf> : std::true_type {};
+
 template<typename T, typename Y>
 inline void convertFromAtoms( std::vector<T>& out, const std::vector<Y>& in )
 {
     size_t startIndex = out.size();
     out.resize( out.size() + in.size() );
-    for ( size_t i = 0; i < in.size(); ++i)
+    if constexpr ( AtomsSameLayout<T, Y>::value )
+    {
+        static_assert( sizeof( T ) == sizeof( Y ), "AtomsSameLayout types must have the same size" );
+        if ( !in.empty() )
+        {
+            std::memcpy( static_cast<void*>( out.data() + startIndex ), in.data(), in.size() * sizeof( Y ) );
+        }
+    }
+    else
     {
-        convertFromAtoms( out[startIndex + i], in[i] );
+        for ( size_t i = 0; i < in.size(); ++i)
+        {
+            convertFromAtoms( out[startIndex + i], in[i] );
+        }
+    }
+}
+
+// A temporary array of the same type is moved, so its buffer is adopted without copying
+template<typename T>
+inline void convertFromAtoms( std::vector<T>& out, std::vector<T>&& in )
+{
+    if ( out.empty() )
+    {
+        out = std::move( in );
+        return;
     }
+
+    out.insert( out.end(), in.begin(), in.end() );
 }
 
 
@@ -79,8 +79,6 @@ namespace AtomsGaffer
 
     private:
 
-        void parseVisibleAgents( std::vector<int>& agentsFiltered, std::vector<int>& agentIds, const std::string& filter, bool invert = false ) const;
-
         template <typename T, typename OUT, typename IN>
         void setMetadataOnPoints(
                 IECoreScene::PointsPrimitivePtr& primitive,
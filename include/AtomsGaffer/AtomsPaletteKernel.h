@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSPALETTEKERNEL_H
+#define ATOMSGAFFER_ATOMSPALETTEKERNEL_H
+
+#include "ImathMatrix.h"
+
+#include <cstddef>
+
+namespace AtomsGaffer
+{
+
+// Batched math used to build the skinning palettes of the agents.
+// All the matrices must be affine, with ( 0, 0, 0, 1 ) as last column.
+class AtomsPaletteKernel
+{
+
+    public:
+
+        enum class Implementation
+        {
+            Scalar,
+            AVX2
+        };
+
+        // The fastest implementation supported by the cpu, detected once at the first call
+        static Implementation bestImplementation();
+
+        static bool isSupported( Implementation implementation );
+
+        // Computes skinning[i] = bindInverse[i] * world[i] and, if normals isn't null,
+        // normals[i] = skinning[i].inverse().transpose(). A singular skinning matrix gets an identity normal matrix.
+        // skinning can be the same array as world.
+        static void skinningMatrices(
+                const Imath::M44d* bindInverse,
+                const Imath::M44d* world,
+                size_t count,
+                Imath::M44d* skinning,
+                Imath::M44d* normals
+        );
+
+        // As above, using the given implementation. Throws if the implementation isn't supported by the cpu.
+        static void skinningMatrices(
+                const Imath::M44d* bindInverse,
+                const Imath::M44d* world,
+                size_t count,
+                Imath::M44d* skinning,
+                Imath::M44d* normals,
+                Implementation implementation
+        );
+
+};
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSPALETTEKERNEL_H
@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSPLAYBACKCACHE_H
+#define ATOMSGAFFER_ATOMSPLAYBACKCACHE_H
+
+#include "IECore/Canceller.h"
+#include "IECore/RefCounted.h"
+
+#include "AtomsCore/Metadata/MapMetadata.h"
+#include "AtomsCore/Metadata/PoseMetadata.h"
+#include "AtomsCore/AtomsMath.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Atoms
+{
+class AtomsCache;
+}
+
+namespace AtomsGaffer
+{
+
+IE_CORE_FORWARDDECLARE( AtomsPlaybackCache )
+
+// A frame range of an atoms cache loaded once in memory in a compact form, so the range can be played back
+// many times without reading the frame files. The joint rotations are quantised to 16 bit quaternions, the
+// joint translations and scales are stored as floats, and the agent type, variation and lod names are stored
+// once in a table shared by all the frames. Only the variation, lod, position, direction, velocity and scale
+// metadata of the agents are kept. The interpolated frames aren't stored.
+class AtomsPlaybackCache : public IECore::RefCounted
+{
+
+    public:
+
+        IE_CORE_DECLAREMEMBERPTR( AtomsPlaybackCache );
+
+        // Load the frames between startFrame and endFrame, clamped to the frame range of the cache.
+        // Throws an IECore::IOException if the cache can't be opened, and IECore::Cancelled if the canceller
+        // is cancelled while the frames are loaded.
+        AtomsPlaybackCache( const std::string& cachePath, const std::string& cacheName, int startFrame, int endFrame, const IECore::Canceller* canceller = nullptr );
+
+        ~AtomsPlaybackCache() override;
+
+        int startFrame() const;
+
+        int endFrame() const;
+
+        bool hasFrame( int frame ) const;
+
+        // The ids of the agents of a stored frame, sorted
+        const std::vector<int>& agentIds( int frame ) const;
+
+        // The agent type and the bounding box of an agent. Throws an IECore::InvalidArgumentException
+        // if the agent isn't in the frame.
+        const std::string& agentType( int frame, int agentId ) const;
+        void agentBoundingBox( int frame, int agentId, AtomsCore::Box3& box ) const;
+
+        // Decode the pose and the metadata of an agent. Throws an IECore::InvalidArgumentException
+        // if the agent isn't in the frame.
+        void loadAgent( int frame, int agentId, AtomsCore::PoseMetadata& pose, AtomsCore::MapMetadata& metadata ) const;
+
+        // Memory used by all the stored frames
+        size_t memorySize() const;
+
+    private:
+
+        struct Frame;
+
+        const Frame& frame( int frame ) const;
+
+        static size_t agentIndex( const Frame& frame, int agentId );
+
+        void loadFrame( Atoms::AtomsCache& cache, int frame );
+
+        uint32_t stringIndex( const std::string& value );
+
+        int m_startFrame;
+
+        int m_endFrame;
+
+        std::vector<Frame> m_frames;
+
+        // The names shared by all the frames, and their index in the table while the frames are loaded
+        std::vector<std::string> m_strings;
+        std::unordered_map<std::string, uint32_t> m_stringIndices;
+        std::mutex m_stringsMutex;
+
+};
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSPLAYBACKCACHE_H
@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ATOMSGAFFER_ATOMSSTATISTICS_H
+#define ATOMSGAFFER_ATOMSSTATISTICS_H
+
+#include "IECore/CompoundData.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace AtomsGaffer
+{
+
+// Thread safe load statistics of the readers, used to find where the memory and the load time go.
+// The statistics are grouped in :
+// - memory : bytes used by every category of loaded data, as measured by the last load
+// - counts : number of loaded items, like agents or meshes, as measured by the last load
+// - time : wall time in seconds spent in every load stage, accumulated over all the loads
+// - events : number of times something happened, like a cache hit or miss, accumulated over all the loads
+class AtomsStatistics
+{
+
+    public:
+
+        AtomsStatistics() = default;
+
+        AtomsStatistics( const AtomsStatistics& other );
+
+        AtomsStatistics& operator=( const AtomsStatistics& other );
+
+        void setMemory( const std::string& category, size_t bytes );
+
+        void setCount( const std::string& name, int64_t count );
+
+        void addTime( const std::string& stage, double seconds );
+
+        void addEvent( const std::string& name, int64_t count = 1 );
+
+        // Sum of all the memory categories
+        size_t totalMemory() const;
+
+        // Add the statistics of a load. Its memory and counts replace the current ones,
+        // its times and events are accumulated.
+        void merge( const AtomsStatistics& other );
+
+        // Add the statistics of a load made of several parts loaded together, like the caches of
+        // a multi cache reader. Everything is accumulated, memory and counts included.
+        void accumulate( const AtomsStatistics& other );
+
+        void clear();
+
+        // Return the statistics as a CompoundData with a member for every group
+        IECore::CompoundDataPtr data() const;
+
+        // Add the wall time spent in its scope to a load stage
+        class ScopedTimer
+        {
+
+            public:
+
+                ScopedTimer( AtomsStatistics& statistics, const std::string& stage );
+
+                ~ScopedTimer();
+
+            private:
+
+                AtomsStatistics& m_statistics;
+
+                std::string m_stage;
+
+                std::chrono::steady_clock::time_point m_start;
+
+        };
+
+    private:
+
+        mutable std::mutex m_mutex;
+
+        std::map<std::string, uint64_t> m_memory;
+
+        std::map<std::string, int64_t> m_counts;
+
+        std::map<std::string, double> m_times;
+
+        std::map<std::string, int64_t> m_events;
+
+};
+
+} // namespace AtomsGaffer
+
+#endif // ATOMSGAFFER_ATOMSSTATISTICS_H
@@ -37,6 +37,7 @@
 #ifndef ATOMSGAFFER_ATOMSAGENTREADER_H
 #define ATOMSGAFFER_ATOMSAGENTREADER_H
 
+#include "AtomsGaffer/AtomsStatistics.h"
 #include "AtomsGaffer/TypeIds.h"
 
 #include "GafferScene/SceneNode.h"
@@ -81,6 +82,11 @@ class AtomsVariationReader : public GafferScene::SceneNode
         Gaffer::ObjectPlug *enginePlug();
         const Gaffer::ObjectPlug *enginePlug() const;
 
+		// Returns the memory, load time and mesh counts of the variations loaded by this node.
+		// See AtomsStatistics.
+		IECore::CompoundDataPtr statistics() const;
+		void clearStatistics();
+
 		void affects( const Gaffer::Plug *input, AffectedPlugsContainer &outputs ) const override;
 
 	protected:
@@ -131,6 +137,8 @@ class AtomsVariationReader : public GafferScene::SceneNode
 
 		static size_t g_firstPlugIndex;
 
+		mutable AtomsStatistics m_statistics;
+
 };
 
 } // namespace AtomsGaffer
@@ -51,6 +51,9 @@ enum class TypeId
 	AtomsMetadataTypeId = 120004,
     AtomsAttributesTypeId = 120005,
 	AtomsCrowdClothReaderTypeId = 120006,
+	AtomsCrowdDataTypeId = 120007,
+	AtomsCrowdReaderEngineDataTypeId = 120008,
+	AtomsCrowdReaderPlaybackCacheDataTypeId = 120009,
 
 	LastTypeId = 120499,
 };
@@ -40,6 +40,7 @@ import imath
 import IECore
 import IECoreScene
 
+import Gaffer
 import GafferScene
 
 import GafferTest
@@ -426,6 +427,44 @@ class AtomsCrowdGeneratorTest( GafferSceneTest.SceneTestCase ) :
 		obj = node["out"].transform( "/crowd/agents/atomsRobot/Robot1/0/RobotSkin1/flag_group/pole" )
 		self.assertEqual( obj, imath.M44f() )
 
+	def testAgentContext( self ) :
+		crowd_input = AtomsGaffer.AtomsCrowdReader()
+		crowd_input["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		metadata = AtomsGaffer.AtomsMetadata()
+		metadata["in"].setInput( crowd_input["out"] )
+		metadata["metadata"].addMember( "tint", IECore.V3fData( imath.V3f( 1.0, 0.0, 0.0 ) ) )
+
+		variations = AtomsGaffer.AtomsVariationReader()
+		variations["atomsVariationFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/atomsRobot.json" )
+
+		node = AtomsGaffer.AtomsCrowdGenerator()
+		node["parent"].setValue( "/crowd" )
+		node["in"].setInput( metadata["out"] )
+		node["variations"].setInput( variations["out"] )
+
+		# The agents are sliced in the generator, so the upstream nodes see a single context for all of them
+		with Gaffer.ContextMonitor( metadata ) as monitor :
+			for path in ( "/crowd/agents/atomsRobot/Robot1/0", "/crowd/agents/atomsRobot/Robot2/1", "/crowd/agents/atoms2Robot/RedRobot/5" ) :
+				node["out"].transform( path )
+				node["out"].bound( path )
+
+		statistics = monitor.plugStatistics( metadata["out"]["attributes"] )
+		self.assertFalse( "atoms:agentId" in statistics.variableNames() )
+
+		# Connected to the reader directly, the agents are computed individually by the reader
+		# and the crowd attributes are never computed
+		node["in"].setInput( crowd_input["out"] )
+		with Gaffer.PerformanceMonitor() as performanceMonitor :
+			with Gaffer.ContextMonitor( crowd_input ) as monitor :
+				for path in ( "/crowd/agents/atomsRobot/Robot1/0", "/crowd/agents/atomsRobot/Robot2/1" ) :
+					node["out"].transform( path )
+					node["out"].bound( path )
+
+		self.assertTrue( "atoms:agentId" in monitor.plugStatistics( crowd_input["__agentData"] ).variableNames() )
+		self.assertFalse( "atoms:agentId" in monitor.plugStatistics( crowd_input["out"]["attributes"] ).variableNames() )
+		self.assertEqual( performanceMonitor.plugStatistics( crowd_input["out"]["attributes"] ).computeCount, 0 )
+
 	def testSets( self ):
 		crowd_input = AtomsGaffer.AtomsCrowdReader()
 		crowd_input["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
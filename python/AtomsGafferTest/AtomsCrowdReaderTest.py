@@ -34,6 +34,8 @@
 #
 ##########################################################################
 
+import os
+import shutil
 import unittest
 import imath
 
@@ -227,12 +229,13 @@ class AtomsCrowdReaderTest( GafferSceneTest.SceneTestCase ) :
 
 		attributes = a["out"].attributes( "/crowd" )
 		self.assertTrue( "atoms:agents" in  attributes )
-		self.assertTrue( attributes["atoms:agents"].typeName(), IECore.BlindDataHolder.staticTypeName() )
-		blind_data = attributes["atoms:agents"].blindData()
+		self.assertTrue( isinstance( attributes["atoms:agents"], AtomsGaffer.AtomsCrowdData ) )
+		crowd_data = attributes["atoms:agents"]
+		self.assertEqual( crowd_data.numAgents(), 25 )
 
 		for i in range( 25 ):
-			self.assertTrue( str( i ) in blind_data )
-			agent_data = blind_data[str( i )]
+			self.assertTrue( crowd_data.agentIndex( i ) >= 0 )
+			agent_data = crowd_data.agentData( i )
 
 			self.assertTrue( "hash" in agent_data )
 			self.assertEqual( hash_data[i], agent_data["hash"].value )
@@ -251,6 +254,673 @@ class AtomsCrowdReaderTest( GafferSceneTest.SceneTestCase ) :
 
 			self.assertTrue( "boundingBox" in agent_data )
 
+	def testSharedCache( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		# load a few frames, so the agent types of the later frames are shared through the pool
+		c = Gaffer.Context()
+		for frame in ( 1, 2, 3 ) :
+			c.setFrame( frame )
+			with c :
+				a["out"].attributes( "/crowd" )
+
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		b["agentIds"].setValue( "0-24" )
+
+		c.setFrame( 1 )
+		with c :
+			self.assertEqual( a["out"].object( "/crowd" ), b["out"].object( "/crowd" ) )
+			aAgents = a["out"].attributes( "/crowd" )["atoms:agents"]
+			bAgents = b["out"].attributes( "/crowd" )["atoms:agents"]
+			for i in range( 25 ) :
+				self.assertEqual( aAgents.agentData( i )["hash"], bAgents.agentData( i )["hash"] )
+				self.assertEqual( aAgents.agentData( i )["poseWorldMatrices"], bAgents.agentData( i )["poseWorldMatrices"] )
+
+	def testPrefetch( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["prefetchFrames"].setValue( 2 )
+
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		b["refreshCount"].setValue( 1 )
+
+		c = Gaffer.Context()
+		for frame in ( 1, 2, 3, 5 ) :
+			c.setFrame( frame )
+			with c :
+				self.assertEqual( a["out"].object( "/crowd" ), b["out"].object( "/crowd" ) )
+				aAgents = a["out"].attributes( "/crowd" )["atoms:agents"]
+				bAgents = b["out"].attributes( "/crowd" )["atoms:agents"]
+				for i in range( 25 ) :
+					self.assertEqual( aAgents.agentData( i )["hash"], bAgents.agentData( i )["hash"] )
+
+	def testPrefetchReaders( self ) :
+
+		# Every reader prefetches its own frames, so interleaved readers don't drop each other's requests
+		readers = []
+		# Use refresh counts of their own, so the engines aren't already in the cache
+		for refreshCount in ( 100, 101 ) :
+			reader = AtomsGaffer.AtomsCrowdReader()
+			reader["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+			reader["refreshCount"].setValue( refreshCount )
+			reader["prefetchFrames"].setValue( 2 )
+			readers.append( reader )
+
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		b["refreshCount"].setValue( 1 )
+
+		c = Gaffer.Context()
+		for frame in ( 1, 2, 3, 4 ) :
+			c.setFrame( frame )
+			with c :
+				for reader in readers :
+					self.assertEqual( reader["out"].object( "/crowd" ), b["out"].object( "/crowd" ) )
+
+		for reader in readers :
+			events = reader.statistics()["events"]
+			self.assertEqual( events["prefetchHits"].value + events["prefetchMisses"].value, 4 )
+			# The frames still loading are joined rather than loaded again, so only the first frame misses
+			self.assertEqual( events["prefetchHits"].value, 3 )
+
+		# Deleting a reader cancels its pending loads
+		del readers
+
+	def testMotionBlurSamples( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		def engineHash( frame ) :
+
+			c = Gaffer.Context()
+			c.setFrame( frame )
+			with c :
+				return a["__engine"].hash()
+
+		# The samples between the same two frames share the loaded frames
+		self.assertEqual( engineHash( 2.25 ), engineHash( 2.75 ) )
+		self.assertNotEqual( engineHash( 2 ), engineHash( 2.25 ) )
+		self.assertNotEqual( engineHash( 2.75 ), engineHash( 3.25 ) )
+
+		# but every sample still has its own interpolated poses
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		b["refreshCount"].setValue( 1 )
+
+		c = Gaffer.Context()
+		samples = {}
+		for frame in ( 2.25, 2.75 ) :
+			c.setFrame( frame )
+			with c :
+				aAgents = a["out"].attributes( "/crowd" )["atoms:agents"]
+				# b loads its frames again for every sample
+				b["refreshCount"].setValue( b["refreshCount"].getValue() + 1 )
+				bAgents = b["out"].attributes( "/crowd" )["atoms:agents"]
+				self.assertEqual( a["out"].object( "/crowd" ), b["out"].object( "/crowd" ) )
+				for i in range( 25 ) :
+					self.assertEqual( aAgents.agentData( i )["poseWorldMatrices"], bAgents.agentData( i )["poseWorldMatrices"] )
+				samples[frame] = aAgents
+
+		self.assertNotEqual( samples[2.25].agentData( 0 )["poseWorldMatrices"], samples[2.75].agentData( 0 )["poseWorldMatrices"] )
+
+	def testClampedFramesHash( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		def hashes( frame ) :
+
+			c = Gaffer.Context()
+			c.setFrame( frame )
+			with c :
+				return ( a["out"].objectHash( "/crowd" ), a["out"].attributesHash( "/crowd" ) )
+
+		# The frames before the cache start read the first cache frame, so they reuse its results
+		self.assertEqual( hashes( -10 ), hashes( 1 ) )
+		self.assertEqual( hashes( 0.5 ), hashes( 1 ) )
+		self.assertNotEqual( hashes( 1 ), hashes( 2 ) )
+
+		a["timeOffset"].setValue( 1 )
+		self.assertEqual( hashes( 0 ), hashes( -10 ) )
+		self.assertNotEqual( hashes( 1 ), hashes( 2 ) )
+
+	def testHeldFramesHash( self ) :
+
+		cachePath = os.path.join( self.temporaryDirectory(), "cache" )
+		shutil.copytree( os.path.expandvars( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache" ), cachePath )
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( os.path.join( cachePath, "test_sim.atoms" ) )
+		a["refreshCount"].setValue( 110 )
+
+		def hashes( frame ) :
+
+			c = Gaffer.Context()
+			c.setFrame( frame )
+			with c :
+				return ( a["out"].objectHash( "/crowd" ), a["out"].attributesHash( "/crowd" ) )
+
+		self.assertNotEqual( hashes( 1 ), hashes( 2 ) )
+
+		# Hold the first frame, writing its files again as the second frame
+		for fileType in ( "frame", "header", "meta", "pose" ) :
+			shutil.copyfile(
+				os.path.join( cachePath, "test_sim.0001.{}.atoms".format( fileType ) ),
+				os.path.join( cachePath, "test_sim.0002.{}.atoms".format( fileType ) )
+			)
+
+		# The held frame reads the same data, so it reuses the results of the first frame
+		a["refreshCount"].setValue( 111 )
+		self.assertEqual( hashes( 1 ), hashes( 2 ) )
+		self.assertNotEqual( hashes( 1 ), hashes( 3 ) )
+
+	def testStatistics( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		# Use a refresh count of its own, so the engines aren't already in the cache
+		a["refreshCount"].setValue( 10 )
+		self.assertEqual( a.statistics()["events"], IECore.CompoundData() )
+
+		c = Gaffer.Context()
+		for frame in ( 1, 2 ) :
+			c.setFrame( frame )
+			with c :
+				a["out"].attributes( "/crowd" )
+
+		statistics = a.statistics()
+		self.assertEqual( statistics["events"]["engineLoads"].value, 2 )
+		# The agent types are loaded for the first frame, and shared with the second one
+		self.assertEqual( statistics["events"]["cachePoolMisses"].value, 1 )
+		self.assertEqual( statistics["events"]["cachePoolHits"].value, 1 )
+		self.assertEqual( statistics["counts"]["agents"].value, 25 )
+		for category in ( "frame", "header", "metadata", "pose", "agentTypes", "bindPoses" ) :
+			self.assertTrue( category in statistics["memory"] )
+		self.assertGreater( statistics["memory"]["pose"].value, 0 )
+		# The shared agent types are counted once by the node, not by every engine
+		self.assertGreater( statistics["memory"]["agentTypes"].value, 0 )
+		for stage in ( "total", "openCache", "loadFrameHeader", "loadFrame", "loadAgentTypes" ) :
+			self.assertGreaterEqual( statistics["time"][stage].value, 0 )
+
+		a.clearStatistics()
+		self.assertEqual( a.statistics()["events"], IECore.CompoundData() )
+
+	def testPoolRefreshCounts( self ) :
+
+		# Readers with different refresh counts keep their own agent types in the pool, without evicting each other's
+		readers = []
+		for refreshCount in ( 80, 81 ) :
+			reader = AtomsGaffer.AtomsCrowdReader()
+			reader["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+			reader["refreshCount"].setValue( refreshCount )
+			readers.append( reader )
+
+		c = Gaffer.Context()
+		for frame in ( 1, 2, 3 ) :
+			c.setFrame( frame )
+			with c :
+				for reader in readers :
+					reader["out"].attributes( "/crowd" )
+
+		for reader in readers :
+			self.assertEqual( reader.statistics()["events"]["cachePoolMisses"].value, 1 )
+			self.assertEqual( reader.statistics()["events"]["cachePoolHits"].value, 2 )
+
+	def testSampleMemory( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["refreshCount"].setValue( 90 )
+
+		engine = a["__engine"].getValue( _copy = False )
+		engineMemory = engine.memoryUsage()
+
+		# The decoded agents are only held by the computes using them, so the engine stored in
+		# the cache never grows, whichever outputs are built
+		a["out"].object( "/crowd" )
+		self.assertEqual( engine.memoryUsage(), engineMemory )
+
+		a["out"].attributes( "/crowd" )
+		self.assertEqual( engine.memoryUsage(), engineMemory )
+
+	def testCulling( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["refreshCount"].setValue( 20 )
+
+		allAgents = a["out"].attributes( "/crowd" )["atoms:agents"].agentIds()
+		self.assertEqual( len( allAgents ), 25 )
+
+		a["cullMode"].setValue( AtomsGaffer.AtomsCrowdReader.CullMode.CullBox )
+		a["cullBox"].setValue( imath.Box3f( imath.V3f( -1e6 ), imath.V3f( 1e6 ) ) )
+		self.assertEqual( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds(), allAgents )
+		self.assertEqual( a.statistics()["counts"]["culledAgents"].value, 0 )
+
+		a["cullBox"].setValue( imath.Box3f( imath.V3f( 1e5 ), imath.V3f( 1e5 + 1 ) ) )
+		culled = a["out"].attributes( "/crowd" )["atoms:agents"].agentIds()
+		self.assertLess( len( culled ), len( allAgents ) )
+		self.assertEqual( a.statistics()["counts"]["culledAgents"].value, len( allAgents ) - len( culled ) )
+
+		# Padding grows the region until everything is kept again
+		a["cullPadding"].setValue( 1e6 )
+		self.assertEqual( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds(), allAgents )
+
+		a["cullMode"].setValue( AtomsGaffer.AtomsCrowdReader.CullMode.CullOff )
+		self.assertEqual( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds(), allAgents )
+
+	def testMultipleCaches( self ) :
+
+		simFile = "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms"
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( simFile )
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		points = a["out"].object( "/crowd" )
+		agentIds = list( crowd.agentIds() )
+
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setValue( simFile )
+		b["atomsSimFiles"].setValue( IECore.StringVectorData( [ simFile ] ) )
+
+		# The agent ids of the two caches clash
+		self.assertRaises( RuntimeError, b["out"].object, "/crowd" )
+
+		b["agentIdOffsets"].setValue( IECore.IntVectorData( [ 1000 ] ) )
+		merged = b["out"].attributes( "/crowd" )["atoms:agents"]
+		mergedPoints = b["out"].object( "/crowd" )
+		self.assertEqual( list( merged.agentIds() ), agentIds + [ i + 1000 for i in agentIds ] )
+		self.assertEqual( mergedPoints.numPoints, 2 * points.numPoints )
+		self.assertEqual( list( mergedPoints["atoms:agentId"].data ), agentIds + [ i + 1000 for i in agentIds ] )
+		self.assertEqual( b.statistics()["counts"]["caches"].value, 2 )
+
+		for agentId in agentIds :
+			self.assertEqual( merged.agentData( agentId + 1000 ), crowd.agentData( agentId ) )
+
+		# The filter uses the offset ids
+		b["agentIds"].setValue( "1000-1004" )
+		filtered = b["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertEqual( list( filtered.agentIds() ), [ i for i in range( 1000, 1005 ) if i - 1000 in agentIds ] )
+
+	def testCacheIndex( self ) :
+
+		cachePath = os.path.join( self.temporaryDirectory(), "cache" )
+		shutil.copytree( os.path.expandvars( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache" ), cachePath )
+		simFile = os.path.join( cachePath, "test_sim.atoms" )
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( simFile )
+		a["agentIds"].setValue( "2-4" )
+		a["refreshCount"].setValue( 30 )
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		points = a["out"].object( "/crowd" )
+
+		# The index duplicates the agent data, so reading a cache never writes it
+		self.assertFalse( os.path.exists( AtomsGaffer.AtomsCacheIndex.indexPath( cachePath, "test_sim", 1 ) ) )
+
+		self.assertGreater( AtomsGaffer.AtomsCacheIndex.build( simFile ), 0 )
+		self.assertTrue( os.path.exists( AtomsGaffer.AtomsCacheIndex.indexPath( cachePath, "test_sim", 1 ) ) )
+
+		# The filtered agents are read from the index, with the same result
+		a["refreshCount"].setValue( 31 )
+		a.clearStatistics()
+		indexedCrowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertEqual( a.statistics()["events"]["indexedLoads"].value, 1 )
+		self.assertEqual( indexedCrowd.agentIds(), crowd.agentIds() )
+		for agentId in crowd.agentIds() :
+			self.assertEqual( indexedCrowd.agentData( agentId ), crowd.agentData( agentId ) )
+		self.assertEqual( a["out"].object( "/crowd" ), points )
+
+		# An index older than its frame files is ignored
+		poseFile = os.path.join( cachePath, "test_sim.0001.pose.atoms" )
+		modificationTime = os.path.getmtime( poseFile ) + 10
+		os.utime( poseFile, ( modificationTime, modificationTime ) )
+
+		a["refreshCount"].setValue( 32 )
+		a.clearStatistics()
+		with IECore.CapturingMessageHandler() as mh :
+			self.assertEqual( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds(), crowd.agentIds() )
+		self.assertFalse( "indexedLoads" in a.statistics()["events"] )
+		self.assertTrue( any( "out of date" in m.message for m in mh.messages ) )
+
+	def testTruncatedCacheIndex( self ) :
+
+		cachePath = os.path.join( self.temporaryDirectory(), "cache" )
+		shutil.copytree( os.path.expandvars( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache" ), cachePath )
+		simFile = os.path.join( cachePath, "test_sim.atoms" )
+		self.assertGreater( AtomsGaffer.AtomsCacheIndex.build( simFile ), 0 )
+
+		# The blocks of the agents now point past the end of the index
+		indexFile = AtomsGaffer.AtomsCacheIndex.indexPath( cachePath, "test_sim", 1 )
+		with open( indexFile, "r+b" ) as f :
+			f.truncate( os.path.getsize( indexFile ) - 16 )
+
+		# The index is ignored rather than read
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( simFile )
+		a["agentIds"].setValue( "2-4" )
+		a["refreshCount"].setValue( 130 )
+		with IECore.CapturingMessageHandler() as mh :
+			crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertEqual( list( crowd.agentIds() ), [ 2, 3, 4 ] )
+		self.assertFalse( "indexedLoads" in a.statistics()["events"] )
+		self.assertTrue( any( "invalid index" in m.message for m in mh.messages ) )
+
+		# The temporary files of the build have been renamed
+		self.assertEqual( [ f for f in os.listdir( cachePath ) if ".agents.idx." in f ], [] )
+
+	def testDiskCache( self ) :
+
+		diskCachePath = os.path.join( self.temporaryDirectory(), "engines" )
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["refreshCount"].setValue( 40 )
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		points = a["out"].object( "/crowd" )
+
+		# The first reader loads the caches and saves the frame
+		a["diskCachePath"].setValue( diskCachePath )
+		a["refreshCount"].setValue( 41 )
+		self.assertEqual( a["out"].attributes( "/crowd" )["atoms:agents"], crowd )
+		self.assertEqual( a.statistics()["events"]["diskCacheMisses"].value, 1 )
+		self.assertEqual( len( [ f for f in os.listdir( diskCachePath ) if f.endswith( ".cob" ) ] ), 1 )
+		# The temporary file it was written to has been renamed
+		self.assertEqual( len( os.listdir( diskCachePath ) ), 1 )
+		# The baked sample is part of the memory of the engine
+		self.assertGreater( a.statistics()["memory"]["diskCache"].value, 0 )
+
+		# The engine is baked once when it is created, the other computes only read it
+		modificationTime = os.path.getmtime( os.path.join( diskCachePath, os.listdir( diskCachePath )[0] ) )
+		a["out"].object( "/crowd" )
+		a["compactPalette"].setValue( True )
+		a["out"].attributes( "/crowd" )
+		a["compactPalette"].setValue( False )
+		self.assertEqual( os.path.getmtime( os.path.join( diskCachePath, os.listdir( diskCachePath )[0] ) ), modificationTime )
+
+		# The other readers load the saved frame, with the same result
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setValue( a["atomsSimFile"].getValue() )
+		b["refreshCount"].setValue( 41 )
+		b["diskCachePath"].setValue( diskCachePath )
+		self.assertEqual( b["out"].attributes( "/crowd" )["atoms:agents"], crowd )
+		self.assertEqual( b["out"].object( "/crowd" ), points )
+		self.assertEqual( b.statistics()["events"]["diskCacheHits"].value, 1 )
+		self.assertFalse( "engineLoads" in b.statistics()["events"] )
+
+		agentId = crowd.agentIds()[0]
+		c = Gaffer.Context()
+		c["atoms:agentId"] = agentId
+		with c :
+			self.assertEqual( b["out"].attributes( "/crowd" )["atoms:agents"].agentData( agentId ), crowd.agentData( agentId ) )
+
+		# The compact crowds are built from the saved frame too
+		b["compactPalette"].setValue( True )
+		self.assertEqual( b["out"].attributes( "/crowd" )["atoms:agents"].agentIds(), crowd.agentIds() )
+
+	def testFrameCache( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["refreshCount"].setValue( 50 )
+		a["frameCacheMemory"].setValue( 1024 )
+
+		crowds = {}
+		c = Gaffer.Context()
+		for frame in ( 1, 2, 1, 2 ) :
+			c.setFrame( frame )
+			with c :
+				crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+			if frame in crowds :
+				self.assertEqual( crowd, crowds[frame] )
+			crowds[frame] = crowd
+			# Evict the engines from the Gaffer cache, as it would under memory pressure
+			Gaffer.ValuePlug.clearCache()
+
+		statistics = a.statistics()
+		self.assertEqual( statistics["events"]["frameCacheMisses"].value, 2 )
+		self.assertEqual( statistics["events"]["frameCacheHits"].value, 2 )
+		self.assertEqual( statistics["events"]["engineLoads"].value, 2 )
+		self.assertGreater( statistics["memory"]["frameCache"].value, 0 )
+
+		# A zero budget disables the cache and releases the frames
+		a["frameCacheMemory"].setValue( 0 )
+		c.setFrame( 1 )
+		with c :
+			a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertEqual( a.statistics()["memory"]["frameCache"].value, 0 )
+
+	def testPlaybackCache( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["refreshCount"].setValue( 60 )
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		points = a["out"].object( "/crowd" )
+
+		a["playbackCache"].setValue( True )
+		a["playbackRange"].setValue( imath.V2i( 1, 3 ) )
+		a.clearStatistics()
+
+		c = Gaffer.Context()
+		for frame in ( 1, 2, 3 ) :
+			c.setFrame( frame )
+			with c :
+				a["out"].attributes( "/crowd" )["atoms:agents"]
+
+		# The range is loaded once, and the frames are decoded from memory
+		statistics = a.statistics()
+		self.assertEqual( statistics["events"]["playbackCacheLoads"].value, 1 )
+		self.assertEqual( statistics["events"]["playbackLoads"].value, 3 )
+		self.assertGreater( statistics["memory"]["playbackCache"].value, 0 )
+
+		playbackCrowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		playbackPoints = a["out"].object( "/crowd" )
+		self.assertEqual( playbackCrowd.agentIds(), crowd.agentIds() )
+		self.assertEqual( playbackPoints["atoms:variation"], points["atoms:variation"] )
+		self.assertEqual( playbackPoints["atoms:lod"], points["atoms:lod"] )
+		for i in range( 0, len( points["P"].data ) ) :
+			self.assertTrue( playbackPoints["P"].data[i].equalWithAbsError( points["P"].data[i], 0.01 ) )
+
+		# The frames outside the range are read from the cache files
+		c.setFrame( 4 )
+		with c :
+			a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertEqual( a.statistics()["events"]["playbackLoads"].value, 3 )
+
+	def testPlaybackCacheData( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		a["refreshCount"].setValue( 120 )
+
+		# The range is ignored while the playback cache is off
+		engineHash = a["__engine"].hash()
+		a["playbackRange"].setValue( imath.V2i( 1, 2 ) )
+		self.assertEqual( a["__engine"].hash(), engineHash )
+
+		a["playbackCache"].setValue( True )
+		self.assertNotEqual( a["__engine"].hash(), engineHash )
+
+		# The copies share the loaded caches
+		with IECore.CapturingMessageHandler() as mh :
+			playbackCacheData = a["__playbackCache"].getValue()
+		self.assertEqual( mh.messages, [] )
+		self.assertEqual( playbackCacheData, a["__playbackCache"].getValue( _copy = False ) )
+		self.assertGreater( playbackCacheData.memoryUsage(), 0 )
+
+		# The range is loaded again from the cache files
+		fileName = os.path.join( self.temporaryDirectory(), "playbackCache.cob" )
+		IECore.ObjectWriter( playbackCacheData, fileName ).write()
+		with IECore.CapturingMessageHandler() as mh :
+			loaded = IECore.ObjectReader( fileName ).read()
+		self.assertEqual( mh.messages, [] )
+		self.assertNotEqual( loaded, playbackCacheData )
+		self.assertEqual( loaded.memoryUsage(), playbackCacheData.memoryUsage() )
+
+	def testPreviewFraction( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		allAgents = set( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds() )
+
+		a["previewFraction"].setValue( 0.5 )
+		c = Gaffer.Context()
+		previews = []
+		for frame in ( 1, 2 ) :
+			c.setFrame( frame )
+			with c :
+				crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+				self.assertEqual( list( a["out"].object( "/crowd" )["atoms:agentId"].data ), list( crowd.agentIds() ) )
+			previews.append( list( crowd.agentIds() ) )
+
+		# The same agents are kept on every frame
+		self.assertEqual( previews[0], previews[1] )
+		self.assertTrue( set( previews[0] ).issubset( allAgents ) )
+		self.assertLess( len( previews[0] ), len( allAgents ) )
+
+		a["previewFraction"].setValue( 0 )
+		self.assertEqual( len( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds() ), 0 )
+
+		a["previewFraction"].setValue( 1 )
+		self.assertEqual( set( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds() ), allAgents )
+
+	def testCancellation( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		# Use a refresh count of its own, so the engine isn't already in the cache
+		a["refreshCount"].setValue( 70 )
+
+		canceller = IECore.Canceller()
+		canceller.cancel()
+		with Gaffer.Context( Gaffer.Context(), canceller ) :
+			with self.assertRaises( IECore.Cancelled ) :
+				a["out"].attributes( "/crowd" )
+			with self.assertRaises( IECore.Cancelled ) :
+				a["out"].object( "/crowd" )
+
+		# The cancelled loads leave nothing behind, so the next computes load the whole crowd
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		points = a["out"].object( "/crowd" )
+		self.assertGreater( len( crowd.agentIds() ), 0 )
+		self.assertEqual( list( points["atoms:agentId"].data ), list( crowd.agentIds() ) )
+
+		b = AtomsGaffer.AtomsCrowdReader()
+		b["atomsSimFile"].setInput( a["atomsSimFile"] )
+		self.assertEqual( b["out"].attributes( "/crowd" )["atoms:agents"], crowd )
+
+	def testMetadataNames( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		def metadataNames( agentId ) :
+			return set( a["out"].attributes( "/crowd" )["atoms:agents"].agentData( agentId )["metadata"].keys() )
+
+		allNames = metadataNames( 3 )
+		self.assertTrue( { "variation", "lod" }.issubset( allNames ) )
+
+		a["metadataNames"].setValue( "variation lod" )
+		self.assertEqual( metadataNames( 3 ), { "variation", "lod" } )
+
+		a["metadataNames"].setValue( "*" )
+		a["excludeMetadataNames"].setValue( "lod" )
+		self.assertEqual( metadataNames( 3 ), allNames - { "lod" } )
+
+		# The single agents are filtered too
+		c = Gaffer.Context()
+		c["atoms:agentId"] = 3
+		with c :
+			self.assertEqual( set( a["__agentData"].getValue().agentData( 3 )["metadata"].keys() ), allNames - { "lod" } )
+
+		a["excludeMetadataNames"].setValue( "" )
+		self.assertEqual( metadataNames( 3 ), allNames )
+
+	def testAgentContext( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+
+		for agentId in ( 3, 4 ) :
+			c = Gaffer.Context()
+			c["atoms:agentId"] = agentId
+			with c :
+				agents = a["__agentData"].getValue()
+				self.assertEqual( agents.agentIds(), IECore.IntVectorData( [ agentId ] ) )
+				self.assertEqual( agents.agentData( agentId ), crowd.agentData( agentId ) )
+				# The variable only selects the agent of the internal plug, the scene is unchanged
+				self.assertEqual( a["out"].attributes( "/crowd" )["atoms:agents"].agentIds(), crowd.agentIds() )
+
+	def testSourceMatchesAttributes( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		# Evaluate the attributes first, so the points reuse the agents solved for them
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		points = a["out"].object( "/crowd" )
+
+		for i, agentId in enumerate( points["atoms:agentId"].data ) :
+			self.assertEqual( points["P"].data[i], imath.V3f( crowd.agentData( agentId )["rootMatrix"].value.translation() ) )
+
+	def testCrowdData( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertEqual( crowd.agentIds(), IECore.IntVectorData( list( range( 25 ) ) ) )
+		self.assertEqual( crowd.agentIndex( 100 ), -1 )
+		for i in range( 25 ) :
+			self.assertEqual( crowd.numJoints( i ), 68 )
+
+		crowdCopy = crowd.copy()
+		self.assertEqual( crowdCopy, crowd )
+		self.assertEqual( crowdCopy.hash(), crowd.hash() )
+
+		agent = crowdCopy.agentData( 3 )
+		agent["rootMatrix"] = IECore.M44dData( imath.M44d().translate( imath.V3d( 1, 2, 3 ) ) )
+		crowdCopy.setAgentData( 3, agent )
+		self.assertEqual( crowdCopy.agentData( 3 )["rootMatrix"], agent["rootMatrix"] )
+		self.assertNotEqual( crowdCopy, crowd )
+		self.assertNotEqual( crowdCopy.hash(), crowd.hash() )
+
+		# the crowd data must survive a round trip to disk
+		m = IECore.MemoryIndexedIO( IECore.CharVectorData(), [], IECore.IndexedIO.OpenMode.Write )
+		crowd.save( m, "crowd" )
+		self.assertEqual( IECore.Object.load( m, "crowd" ), crowd )
+
+	def testCompactPalette( self ) :
+
+		a = AtomsGaffer.AtomsCrowdReader()
+		a["atomsSimFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/cache/test_sim.atoms" )
+		crowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertFalse( crowd.isCompact() )
+
+		a["compactPalette"].setValue( True )
+		compactCrowd = a["out"].attributes( "/crowd" )["atoms:agents"]
+		self.assertTrue( compactCrowd.isCompact() )
+		self.assertLess( compactCrowd.memoryUsage(), crowd.memoryUsage() / 2 )
+
+		for i in range( 25 ) :
+			agent = crowd.agentData( i )
+			compactAgent = compactCrowd.agentData( i )
+			self.assertEqual( agent["rootMatrix"], compactAgent["rootMatrix"] )
+			self.assertEqual( agent["hash"], compactAgent["hash"] )
+			self.assertEqual( len( compactAgent["poseWorldMatrices"] ), 68 )
+			for j in range( 68 ) :
+				self.assertTrue( agent["poseWorldMatrices"][j].equalWithAbsError( compactAgent["poseWorldMatrices"][j], 1e-3 ) )
+				self.assertTrue( agent["poseNormalWorldMatrices"][j].equalWithAbsError( compactAgent["poseNormalWorldMatrices"][j], 1e-3 ) )
+
 	def testAffects( self ) :
 
 		a = AtomsGaffer.AtomsCrowdReader()
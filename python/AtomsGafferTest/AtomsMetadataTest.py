@@ -162,6 +162,47 @@ class AtomsMetadataTest( GafferSceneTest.SceneTestCase ) :
 		self.assertEqual( variation_data[2], "Robot3" )
 		self.assertNotEqual( variation_data[3], "Robot3" )
 
+	def testWideRangeFilter( self ) :
+		crowd_input = GafferSceneTest.CompoundObjectSource()
+		crowd_input["in"].setValue( buildCrowdTest() )
+
+		node = AtomsGaffer.AtomsMetadata()
+		node["in"].setInput( crowd_input["out"] )
+		node["metadata"].addMember( "testData", IECore.IntData( 1 ) )
+
+		# The ranges are never expanded, so huge and overlapping ranges cost nothing
+		node["agentIds"].setValue( "0-2000000000, 1-3, !2-1500000000" )
+		test_data = node["out"].object( "/crowd" )["atoms:testData"].data
+		self.assertEqual( list( test_data ), [ 1, 1, 2, 2 ] )
+
+		node["agentIds"].setValue( "!2-1500000000" )
+		node["invert"].setValue( True )
+		test_data = node["out"].object( "/crowd" )["atoms:testData"].data
+		self.assertEqual( list( test_data ), [ 2, 2, 1, 1 ] )
+
+	def testUnsortedAgentIds( self ) :
+		scene = buildCrowdTest()
+		points = scene["children"]["crowd"]["object"]
+		points["atoms:agentId"] = IECoreScene.PrimitiveVariable( IECoreScene.PrimitiveVariable.Interpolation.Vertex, IECore.IntVectorData( [ 3, 0, 2, 1 ] ) )
+
+		crowd = AtomsGaffer.AtomsCrowdData()
+		crowd.setAgents( [ 0, 1, 2, 3 ], [ 1, 1, 1, 1 ] )
+		for agentId in range( 4 ) :
+			crowd.setAgentData( agentId, IECore.CompoundData( { "metadata" : { "testData" : IECore.IntData( agentId * 10 ) } } ) )
+		scene["children"]["crowd"]["attributes"] = IECore.CompoundObject( { "atoms:agents" : crowd } )
+
+		crowd_input = GafferSceneTest.CompoundObjectSource()
+		crowd_input["in"].setValue( scene )
+
+		node = AtomsGaffer.AtomsMetadata()
+		node["in"].setInput( crowd_input["out"] )
+		node["metadata"].addMember( "testData", IECore.IntData( 1 ) )
+		node["agentIds"].setValue( "2" )
+
+		# The ids are no longer sorted before the defaults are read, so each point keeps its own agent's value
+		test_data = node["out"].object( "/crowd" )["atoms:testData"].data
+		self.assertEqual( list( test_data ), [ 30, 0, 1, 10 ] )
+
 
 if __name__ == "__main__":
 	unittest.main()
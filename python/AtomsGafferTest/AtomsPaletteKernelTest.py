@@ -0,0 +1,106 @@
+##########################################################################
+#
+#  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+#
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are
+#  met:
+#
+#      * Redistributions of source code must retain the above
+#        copyright notice, this list of conditions and the following
+#        disclaimer.
+#
+#      * Redistributions in binary form must reproduce the above
+#        copyright notice, this list of conditions and the following
+#        disclaimer in the documentation and/or other materials provided with
+#        the distribution.
+#
+#      * Neither the name of John Haddon nor the names of
+#        any other contributors to this software may be used to endorse or
+#        promote products derived from this software without specific prior
+#        written permission.
+#
+#  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+#  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+#  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+#  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+#  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+#  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+#  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+#  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+#  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+#  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+#  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+##########################################################################
+
+import random
+import unittest
+import imath
+
+import IECore
+
+import GafferTest
+
+import AtomsGaffer
+from six.moves import range
+
+class AtomsPaletteKernelTest( GafferTest.TestCase ) :
+
+	def __randomAffineMatrix( self, r ) :
+
+		m = imath.M44d()
+		for i in range( 4 ) :
+			for j in range( 3 ) :
+				m[i][j] = r.uniform( -2, 2 ) * ( 100 if i == 3 else 1 )
+		return m
+
+	def __assertMatricesAlmostEqual( self, result, expected ) :
+
+		self.assertEqual( len( result ), len( expected ) )
+		for m, e in zip( result, expected ) :
+			for i in range( 4 ) :
+				for j in range( 4 ) :
+					self.assertAlmostEqual( m[i][j], e[i][j], delta = 1e-9 * max( 1.0, abs( e[i][j] ) ) )
+
+	def __testImplementation( self, implementation ) :
+
+		r = random.Random( 0 )
+		# use a length that isn't a multiple of the simd width, so the remainder is tested too
+		bindInverse = IECore.M44dVectorData( [ self.__randomAffineMatrix( r ) for i in range( 67 ) ] )
+		world = IECore.M44dVectorData( [ self.__randomAffineMatrix( r ) for i in range( 67 ) ] )
+
+		skinning, normals = AtomsGaffer.AtomsPaletteKernel.skinningMatrices( bindInverse, world, implementation )
+
+		expectedSkinning = [ b * w for b, w in zip( bindInverse, world ) ]
+		expectedNormals = [ m.inverse().transpose() for m in expectedSkinning ]
+		self.__assertMatricesAlmostEqual( skinning, expectedSkinning )
+		self.__assertMatricesAlmostEqual( normals, expectedNormals )
+
+	def testScalar( self ) :
+
+		self.__testImplementation( AtomsGaffer.AtomsPaletteKernel.Implementation.Scalar )
+
+	def testAVX2( self ) :
+
+		if not AtomsGaffer.AtomsPaletteKernel.isSupported( AtomsGaffer.AtomsPaletteKernel.Implementation.AVX2 ) :
+			self.skipTest( "AVX2 not supported" )
+
+		self.__testImplementation( AtomsGaffer.AtomsPaletteKernel.Implementation.AVX2 )
+
+	def testSingularMatrix( self ) :
+
+		bindInverse = IECore.M44dVectorData( [ imath.M44d().scale( imath.V3d( 0, 1, 1 ) ) ] * 5 )
+		world = IECore.M44dVectorData( [ imath.M44d() ] * 5 )
+		for implementation in ( AtomsGaffer.AtomsPaletteKernel.Implementation.Scalar, AtomsGaffer.AtomsPaletteKernel.Implementation.AVX2 ) :
+			if not AtomsGaffer.AtomsPaletteKernel.isSupported( implementation ) :
+				continue
+			skinning, normals = AtomsGaffer.AtomsPaletteKernel.skinningMatrices( bindInverse, world, implementation )
+			self.assertEqual( list( normals ), [ imath.M44d() ] * 5 )
+
+	def testBestImplementation( self ) :
+
+		self.assertTrue( AtomsGaffer.AtomsPaletteKernel.isSupported( AtomsGaffer.AtomsPaletteKernel.bestImplementation() ) )
+
+if __name__ == "__main__":
+	unittest.main()
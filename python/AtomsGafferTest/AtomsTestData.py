@@ -39,6 +39,8 @@ import imath
 import IECore
 import IECoreScene
 
+import AtomsGaffer
+
 def buildTestPoints():
     positions = [ imath.V3f( 1, 0, 0 ), imath.V3f( 1, 0, 1 ), imath.V3f( 0, 0, 1 ), imath.V3f( 0, 0, 0 ) ]
     agent_id = [0, 1, 2, 3]
@@ -116,10 +118,15 @@ def buildTestAttributes():
             "poseNormalWorldMatrices": IECore.M44dVectorData( [ imath.M44d() ]),
             "poseWorldMatrices": IECore.M44dVectorData( [ imath.M44d() ]),
         },
-        "frameOffset": IECore.FloatData( 0 ),
     }
 
-    return { "atoms:agents": IECore.BlindDataHolder( attributes_map ) }
+    crowd = AtomsGaffer.AtomsCrowdData()
+    crowd.setAgents( [ 0, 1, 2, 3 ], [ 1, 1, 1, 1 ] )
+    for agentId, agentData in attributes_map.items():
+        crowd.setAgentData( int( agentId ), IECore.CompoundData( agentData ) )
+    crowd.setFrameOffset( 0 )
+
+    return { "atoms:agents": crowd }
 
 def buildCrowdTest():
     points = buildTestPoints()
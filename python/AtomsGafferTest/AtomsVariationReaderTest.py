@@ -785,6 +785,24 @@ class AtomsVariationReaderTest( GafferSceneTest.SceneTestCase ) :
 			}
 		)
 
+	def testStatistics( self ) :
+
+		node = AtomsGaffer.AtomsVariationReader()
+		node["atomsVariationFile"].setValue( "${ATOMS_GAFFER_ROOT}/examples/assets/atomsRobot/atomsRobot.json" )
+		# Use a refresh count of its own, so the engine isn't already in the cache
+		node["refreshCount"].setValue( 10 )
+		node["out"].childNames( "/" )
+
+		statistics = node.statistics()
+		self.assertEqual( statistics["events"]["engineLoads"].value, 1 )
+		self.assertGreater( statistics["counts"]["meshes"].value, 0 )
+		self.assertGreater( statistics["memory"]["meshes"].value, 0 )
+		for stage in ( "total", "loadVariations", "loadMeshes" ) :
+			self.assertTrue( stage in statistics["time"] )
+
+		node.clearStatistics()
+		self.assertEqual( node.statistics()["counts"], IECore.CompoundData() )
+
 
 if __name__ == "__main__":
 	unittest.main()
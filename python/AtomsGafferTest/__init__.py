@@ -40,6 +40,7 @@ from .AtomsCrowdClothReaderTest import AtomsCrowdClothReaderTest
 from .AtomsCrowdGeneratorTest import AtomsCrowdGeneratorTest
 from .AtomsAttributesTest import AtomsAttributesTest
 from .AtomsMetadataTest import AtomsMetadataTest
+from .AtomsPaletteKernelTest import AtomsPaletteKernelTest
 
 if __name__ == "__main__":
 	import unittest
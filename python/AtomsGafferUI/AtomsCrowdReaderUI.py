@@ -76,6 +76,30 @@ Gaffer.Metadata.registerNode(
 
         ],
 
+        "atomsSimFiles" : [
+
+            "description",
+            """
+            Additional Atoms simulation files, loaded in parallel with the
+            Atoms Sim File and merged with it in a single crowd. Useful when a
+            crowd is simulated in several independent caches.
+            """,
+            "label", "Atoms Sim Files",
+            "layout:section", "Caches",
+        ],
+
+        "agentIdOffsets" : [
+
+            "description",
+            """
+            The offset added to the agent ids of each of the Atoms Sim Files,
+            so the ids of the merged caches don't clash. The caches without an
+            offset keep their ids. The Agent Indices filter uses the offset ids.
+            """,
+            "label", "Agent Id Offsets",
+            "layout:section", "Caches",
+        ],
+
         "agentIds" : [
 
             "description",
@@ -88,6 +112,42 @@ Gaffer.Metadata.registerNode(
             "label", "Agent Indices",
         ],
 
+        "previewFraction" : [
+
+            "description",
+            """
+            The fraction of the agents kept, for fast lighting and lookdev
+            previews. The agents are picked by a hash of their id, so the same
+            agents are kept on every frame and on every machine, and they are
+            spread uniformly over the crowd. The other agents are dropped
+            before their poses and metadata are loaded.
+            """,
+            "label", "Preview Fraction",
+        ],
+
+        "metadataNames" : [
+
+            "description",
+            """
+            The names of the agent metadata stored in the atoms:agents
+            attribute, as space separated match patterns. The other metadata
+            aren't translated at all, which speeds up the attributes compute
+            of crowds with many metadata. The metadata used by the deformers,
+            such as the blend shape weights, must be kept.
+            """,
+            "label", "Metadata Names",
+        ],
+
+        "excludeMetadataNames" : [
+
+            "description",
+            """
+            The names of the agent metadata skipped, as space separated match
+            patterns. They are excluded even if they match the metadataNames.
+            """,
+            "label", "Exclude Metadata Names",
+        ],
+
         "timeOffset" : [
             "description",
             """
@@ -111,6 +171,156 @@ Gaffer.Metadata.registerNode(
             "layout:index", 1,
         ],
 
+        "prefetchFrames" : [
+
+            "description",
+            """
+            The number of following frames to load in the background while
+            the current frame is processed. Useful when rendering a frame
+            sequence from a cache on slow storage. Zero disables the prefetch.
+            """,
+            "label", "Prefetch Frames",
+            "layout:section", "Performance",
+        ],
+
+        "compactPalette" : [
+
+            "description",
+            """
+            Stores the skinning matrices of the agents as single precision
+            affine matrices and doesn't store the normal matrices, which are
+            computed from the skinning matrices when needed. Reduces the memory
+            used by the crowd attributes at the cost of some precision.
+            """,
+            "label", "Compact Palette",
+            "layout:section", "Performance",
+        ],
+
+        "diskCachePath" : [
+
+            "description",
+            """
+            A directory the loaded frames are saved in, with the solved
+            matrices, metadata and bounds of their agents. The other processes
+            reading the same frames with the same settings load them from there
+            instead of reading and solving the caches again, which makes the
+            render passes of a frame cheaper to start. Use a local directory,
+            eg. ${TMPDIR}/atomsGaffer. Empty disables the disk cache.
+
+            The saved frames are named after the content of the cache files
+            and the settings they were loaded with, so a cache written again is
+            saved in new files rather than replacing the old ones. Nothing is
+            ever deleted from the directory and its size isn't limited : it
+            grows with every frame, cache and setting loaded, so clear it once
+            the renders are done, or use a directory cleaned by the system.
+            """,
+            "label", "Disk Cache Path",
+            "layout:section", "Performance",
+            "plugValueWidget:type", "GafferUI.FileSystemPathPlugValueWidget",
+            "path:leaf", False,
+        ],
+
+        "frameCacheMemory" : [
+
+            "description",
+            """
+            The memory in megabytes used to keep the frames recently loaded by
+            this node, so scrubbing back to them doesn't read and decode them
+            again. The least recently used frames are released first. Defaults
+            to the ATOMSGAFFER_FRAME_CACHE_MEMORY environment variable. Zero
+            disables the frame cache.
+            """,
+            "label", "Frame Cache Memory",
+            "layout:section", "Performance",
+        ],
+
+        "playbackCache" : [
+
+            "description",
+            """
+            Loads the frames of the Playback Range once in memory in a compact
+            form, so they can be played back many times without reading the
+            cache files, eg. for layout and animation reviews. The joint
+            rotations are stored with 16 bit precision, and only the variation,
+            lod, position, direction, velocity and scale metadata of the agents
+            are kept : the other metadata are missing from the crowd and from
+            the nodes reading it downstream while the playback cache is on. The
+            fractional frames and the frames outside the range are read from
+            the cache files.
+            """,
+            "label", "Playback Cache",
+            "layout:section", "Performance",
+        ],
+
+        "playbackRange" : [
+
+            "description",
+            """
+            The first and last frames loaded in memory by the Playback Cache.
+            """,
+            "label", "Playback Range",
+            "layout:section", "Performance",
+        ],
+
+        "cullMode" : [
+
+            "description",
+            """
+            Culls the agents outside a region before their poses and metadata
+            are loaded, using the agent bounding boxes stored in the cache.
+            The region is either the cull box, or the frustum of the cull camera.
+            """,
+            "label", "Mode",
+            "layout:section", "Culling",
+            "preset:Off", AtomsGaffer.AtomsCrowdReader.CullMode.CullOff,
+            "preset:Box", AtomsGaffer.AtomsCrowdReader.CullMode.CullBox,
+            "preset:Camera", AtomsGaffer.AtomsCrowdReader.CullMode.CullCamera,
+            "plugValueWidget:type", "GafferUI.PresetsPlugValueWidget",
+        ],
+
+        "cullBox" : [
+
+            "description",
+            """
+            The world space box used by the Box cull mode.
+            """,
+            "label", "Box",
+            "layout:section", "Culling",
+        ],
+
+        "cullScene" : [
+
+            "description",
+            """
+            The scene containing the cull camera.
+            """,
+            "plugValueWidget:type", "",
+            "nodule:type", "GafferUI::StandardNodule",
+            "noduleLayout:section", "left",
+        ],
+
+        "cullCamera" : [
+
+            "description",
+            """
+            The location of the camera in the cull scene used by the Camera
+            cull mode.
+            """,
+            "label", "Camera",
+            "layout:section", "Culling",
+        ],
+
+        "cullPadding" : [
+
+            "description",
+            """
+            Extends the cull region by this distance, so the agents moving into
+            the region during the frame, or casting shadows into it, are kept.
+            """,
+            "label", "Padding",
+            "layout:section", "Culling",
+        ],
+
     },
 
 )
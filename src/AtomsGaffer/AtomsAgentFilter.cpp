@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsAgentFilter.h"
+
+#include "AtomsUtils/Utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+using namespace AtomsGaffer;
+
+namespace
+{
+
+// Maximum number of compiled filters kept in memory. The filters are tiny, this only
+// stops an animated filter string from growing the cache forever.
+const size_t g_maxCachedFilters = 256;
+
+} // namespace
+
+AtomsAgentFilter::AtomsAgentFilter( const std::string& filter )
+{
+    std::vector<std::string> idsEntryStr;
+    AtomsUtils::splitString( AtomsUtils::eraseFromString( filter, ' ' ), ',', idsEntryStr );
+    for ( const auto& entryStr : idsEntryStr )
+    {
+        std::string currentStr = entryStr;
+        if ( currentStr.empty() )
+        {
+            continue;
+        }
+
+        Intervals* currentIntervals = &m_included;
+        // is a remove id
+        if ( currentStr[0] == '!' )
+        {
+            currentIntervals = &m_excluded;
+            currentStr = currentStr.substr( 1, currentStr.length() );
+        }
+
+        //remove all the parenthesis
+        currentStr = AtomsUtils::eraseFromString( currentStr, '(' );
+        currentStr = AtomsUtils::eraseFromString( currentStr, ')' );
+
+        // is a range
+        if ( currentStr.find( '-' ) != std::string::npos )
+        {
+            std::vector<std::string> rangeEntryStr;
+            AtomsUtils::splitString( currentStr, '-', rangeEntryStr );
+            if ( rangeEntryStr.size() > 1 )
+            {
+                const int startRange = atoi( rangeEntryStr[0].c_str() );
+                const int endRange = atoi( rangeEntryStr[1].c_str() );
+                if ( startRange < endRange )
+                {
+                    currentIntervals->push_back( Interval( startRange, endRange ) );
+                }
+            }
+        }
+        else
+        {
+            const int agentId = atoi( currentStr.c_str() );
+            currentIntervals->push_back( Interval( agentId, agentId ) );
+        }
+    }
+
+    merge( m_included );
+    merge( m_excluded );
+}
+
+AtomsAgentFilter::ConstPtr AtomsAgentFilter::get( const std::string& filter )
+{
+    static std::mutex mutex;
+    static std::map<std::string, ConstPtr> filters;
+
+    std::lock_guard<std::mutex> lock( mutex );
+    auto it = filters.find( filter );
+    if ( it != filters.end() )
+    {
+        return it->second;
+    }
+
+    if ( filters.size() >= g_maxCachedFilters )
+    {
+        filters.clear();
+    }
+
+    ConstPtr result = std::make_shared<const AtomsAgentFilter>( filter );
+    filters[filter] = result;
+    return result;
+}
+
+bool AtomsAgentFilter::empty() const
+{
+    return m_included.empty() && m_excluded.empty();
+}
+
+bool AtomsAgentFilter::match( int agentId, bool invert ) const
+{
+    const Intervals& included = invert ? m_excluded : m_included;
+    const Intervals& excluded = invert ? m_included : m_excluded;
+    return ( included.empty() || contains( included, agentId ) ) && !contains( excluded, agentId );
+}
+
+void AtomsAgentFilter::filter( const std::vector<int>& agentIds, std::vector<int>& agentsFiltered, bool invert ) const
+{
+    agentsFiltered.clear();
+    agentsFiltered.reserve( agentIds.size() );
+    for ( int agentId : agentIds )
+    {
+        if ( match( agentId, invert ) )
+        {
+            agentsFiltered.push_back( agentId );
+        }
+    }
+}
+
+void AtomsAgentFilter::merge( Intervals& intervals )
+{
+    if ( intervals.empty() )
+    {
+        return;
+    }
+
+    // Sort the intervals and join the overlapping and adjacent ones
+    std::sort( intervals.begin(), intervals.end() );
+    size_t last = 0;
+    for ( size_t i = 1; i < intervals.size(); ++i )
+    {
+        if ( static_cast<long long>( intervals[i].first ) <= static_cast<long long>( intervals[last].second ) + 1 )
+        {
+            intervals[last].second = std::max( intervals[last].second, intervals[i].second );
+        }
+        else
+        {
+            intervals[++last] = intervals[i];
+        }
+    }
+    intervals.resize( last + 1 );
+}
+
+bool AtomsAgentFilter::contains( const Intervals& intervals, int agentId )
+{
+    // Find the last interval starting before the agent
+    auto it = std::upper_bound(
+            intervals.begin(), intervals.end(), agentId,
+            []( int id, const Interval& interval ) { return id < interval.first; }
+    );
+    if ( it == intervals.begin() )
+    {
+        return false;
+    }
+    --it;
+    return agentId <= it->second;
+}
@@ -0,0 +1,474 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsCacheIndex.h"
+#include "AtomsGaffer/AtomsCachePool.h"
+
+#include "IECore/Exception.h"
+#include "IECore/MessageHandler.h"
+
+#include "Atoms/AtomsCache.h"
+#include "AtomsCore/Archive.h"
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace IECore;
+using namespace AtomsGaffer;
+
+namespace
+{
+
+const char g_magic[8] = { 'A', 'T', 'O', 'M', 'S', 'I', 'D', 'X' };
+const uint32_t g_version = 1;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numFiles;
+    uint64_t numAgents;
+};
+
+// Size and write time of a frame file when the index was built, used to find out of date indices.
+// A missing file has a zero size and write time.
+struct FileStamp
+{
+    uint64_t size;
+    int64_t writeTime;
+
+    bool operator==( const FileStamp& other ) const
+    {
+        return size == other.size && writeTime == other.writeTime;
+    }
+};
+
+FileStamp fileStamp( const std::string& path )
+{
+    FileStamp result = { 0, 0 };
+    std::error_code errorCode;
+    const uintmax_t size = std::filesystem::file_size( path, errorCode );
+    if ( errorCode )
+    {
+        return result;
+    }
+
+    result.size = size;
+    result.writeTime = std::filesystem::last_write_time( path, errorCode ).time_since_epoch().count();
+    return result;
+}
+
+std::vector<FileStamp> frameFileStamps( const std::string& cachePath, const std::string& cacheName, int frame )
+{
+    std::vector<FileStamp> result;
+    for ( const std::string& fileType : AtomsCachePool::frameFileTypes() )
+    {
+        result.push_back( fileStamp( AtomsCachePool::frameFilePath( cachePath, cacheName, frame, fileType ) ) );
+    }
+    return result;
+}
+
+} // namespace
+
+// Read only memory mapping of an index file. A mapped file that is truncated or rewritten in place makes
+// the reads of the mapping fail with SIGBUS, which is safe here since the indices are only ever replaced
+// atomically by build(). The atoms cache files are written by other applications and are never mapped.
+class AtomsCacheIndex::MappedFile
+{
+
+    public:
+
+        MappedFile( const std::string& path ) : m_valid( false ), m_data( nullptr ), m_size( 0 )
+        {
+            const int file = ::open( path.c_str(), O_RDONLY );
+            if ( file < 0 )
+            {
+                return;
+            }
+
+            struct stat fileStat;
+            if ( ::fstat( file, &fileStat ) != 0 )
+            {
+                ::close( file );
+                return;
+            }
+
+            m_size = static_cast<size_t>( fileStat.st_size );
+            if ( m_size == 0 )
+            {
+                // Nothing to map
+                ::close( file );
+                m_valid = true;
+                return;
+            }
+
+            // The mapping keeps its own reference to the file, so the descriptor isn't needed anymore
+            void* data = ::mmap( nullptr, m_size, PROT_READ, MAP_SHARED, file, 0 );
+            ::close( file );
+            if ( data == MAP_FAILED )
+            {
+                m_size = 0;
+                return;
+            }
+
+            // The blocks are read a few at a time, so there's no point reading ahead
+            ::madvise( data, m_size, MADV_RANDOM );
+            m_data = data;
+            m_valid = true;
+        }
+
+        ~MappedFile()
+        {
+            if ( m_data )
+            {
+                ::munmap( m_data, m_size );
+            }
+        }
+
+        MappedFile( const MappedFile& ) = delete;
+
+        MappedFile& operator=( const MappedFile& ) = delete;
+
+        // False if the file doesn't exist or can't be mapped
+        bool isValid() const
+        {
+            return m_valid;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        // Copies size bytes at the given offset. Returns false if they are outside the file.
+        bool read( void* data, size_t size, size_t offset ) const
+        {
+            if ( offset > m_size || size > m_size - offset )
+            {
+                return false;
+            }
+
+            if ( size )
+            {
+                std::memcpy( data, static_cast<const char*>( m_data ) + offset, size );
+            }
+            return true;
+        }
+
+    private:
+
+        bool m_valid;
+
+        void* m_data;
+
+        size_t m_size;
+
+};
+
+AtomsCacheIndex::AtomsCacheIndex( const std::string& path ) :
+    m_path( path ),
+    m_file( new MappedFile( path ) )
+{
+}
+
+AtomsCacheIndex::~AtomsCacheIndex()
+{
+}
+
+std::string AtomsCacheIndex::indexPath( const std::string& cachePath, const std::string& cacheName, int frame )
+{
+    char frameStr[16];
+    snprintf( frameStr, sizeof( frameStr ), "%04d", frame );
+    return cachePath + "/" + cacheName + "." + frameStr + ".agents.idx";
+}
+
+int AtomsCacheIndex::build( const std::string& atomsSimFile )
+{
+    std::string cachePath, cacheName;
+    AtomsCachePool::splitFilePath( atomsSimFile, cachePath, cacheName );
+    if ( cacheName.empty() )
+    {
+        throw InvalidArgumentException( "AtomsCacheIndex : " + atomsSimFile + " is not an atoms cache" );
+    }
+
+    Atoms::AtomsCache cache;
+    if ( !cache.openCache( cachePath, cacheName ) )
+    {
+        throw IOException( "AtomsCacheIndex : Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
+    }
+
+    const int startFrame = static_cast<int>( std::ceil( cache.startFrame() ) );
+    const int endFrame = static_cast<int>( std::floor( cache.endFrame() ) );
+    if ( endFrame < startFrame )
+    {
+        return 0;
+    }
+
+    // Every frame is written in its own files, so the frames are indexed in parallel, each chunk with its own cache
+    tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+    tbb::parallel_for( tbb::blocked_range<int>( startFrame, endFrame + 1 ), [&]( const tbb::blocked_range<int>& range )
+    {
+        Atoms::AtomsCache chunkCache;
+        if ( !chunkCache.openCache( cachePath, cacheName ) )
+        {
+            throw IOException( "AtomsCacheIndex : Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
+        }
+
+        for ( int frame = range.begin(); frame != range.end(); ++frame )
+        {
+            buildFrame( chunkCache, cachePath, cacheName, frame );
+        }
+    }, taskGroupContext );
+
+    return endFrame - startFrame + 1;
+}
+
+void AtomsCacheIndex::build( const std::string& cachePath, const std::string& cacheName, int frame )
+{
+    Atoms::AtomsCache cache;
+    if ( !cache.openCache( cachePath, cacheName ) )
+    {
+        throw IOException( "AtomsCacheIndex : Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
+    }
+
+    buildFrame( cache, cachePath, cacheName, frame );
+}
+
+void AtomsCacheIndex::buildFrame( Atoms::AtomsCache& cache, const std::string& cachePath, const std::string& cacheName, int frame )
+{
+    // The stamps are taken before reading the frame, so a frame written during the build makes the index out of date
+    const std::vector<FileStamp> stamps = frameFileStamps( cachePath, cacheName, frame );
+
+    cache.loadFrameHeader( frame );
+    std::vector<int> agentIds = cache.agentIds( frame );
+    std::sort( agentIds.begin(), agentIds.end() );
+    cache.setAgentsToLoad( agentIds );
+    cache.loadFrame( frame );
+
+    std::vector<Block> blocks( agentIds.size() );
+    const uint64_t dataOffset = sizeof( Header ) + stamps.size() * sizeof( FileStamp ) + blocks.size() * sizeof( Block );
+
+    std::string data;
+    for ( size_t i = 0; i < agentIds.size(); ++i )
+    {
+        AtomsCore::PoseMetadata pose;
+        cache.loadAgentPose( frame, agentIds[i], pose.get() );
+        AtomsCore::MapMetadata metadata;
+        cache.loadAgentMetadata( frame, agentIds[i], metadata );
+
+        AtomsCore::Archive archive( pose.memSize() + metadata.memSize() );
+        pose.serialise( archive );
+        metadata.serialise( archive );
+
+        Block& block = blocks[i];
+        block.agentId = agentIds[i];
+        block.reserved = 0;
+        block.offset = dataOffset + data.size();
+        block.size = archive.size();
+        data.append( archive.data(), archive.size() );
+    }
+
+    Header header;
+    std::memcpy( header.magic, g_magic, sizeof( g_magic ) );
+    header.version = g_version;
+    header.numFiles = stamps.size();
+    header.numAgents = blocks.size();
+
+    // Write a temporary file first, so the readers never see a partial index. The index is replaced
+    // with a rename and never rewritten in place, so the processes still mapping the old one keep reading it.
+    // The temporary file has a unique name, so the processes building the same index never write to the
+    // same file, the last rename wins.
+    const std::string path = indexPath( cachePath, cacheName, frame );
+    std::string temporaryPath = path + ".XXXXXX";
+    const int temporaryFile = ::mkstemp( &temporaryPath[0] );
+    if ( temporaryFile < 0 )
+    {
+        throw IOException( "AtomsCacheIndex : Unable to write " + path + " : " + std::strerror( errno ) );
+    }
+    ::close( temporaryFile );
+
+    bool written = false;
+    {
+        std::ofstream file( temporaryPath, std::ios::binary | std::ios::trunc );
+        file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+        file.write( reinterpret_cast<const char*>( stamps.data() ), stamps.size() * sizeof( FileStamp ) );
+        file.write( reinterpret_cast<const char*>( blocks.data() ), blocks.size() * sizeof( Block ) );
+        file.write( data.data(), data.size() );
+        written = static_cast<bool>( file );
+    }
+
+    std::error_code errorCode;
+    if ( !written )
+    {
+        std::filesystem::remove( temporaryPath, errorCode );
+        throw IOException( "AtomsCacheIndex : Unable to write " + temporaryPath );
+    }
+
+    // mkstemp creates the file readable by its owner only
+    std::filesystem::permissions(
+        temporaryPath,
+        std::filesystem::perms::owner_read | std::filesystem::perms::owner_write | std::filesystem::perms::group_read | std::filesystem::perms::others_read,
+        errorCode
+    );
+
+    std::filesystem::rename( temporaryPath, path, errorCode );
+    if ( errorCode )
+    {
+        std::error_code removeErrorCode;
+        std::filesystem::remove( temporaryPath, removeErrorCode );
+        throw IOException( "AtomsCacheIndex : Unable to write " + path + " : " + errorCode.message() );
+    }
+}
+
+ConstAtomsCacheIndexPtr AtomsCacheIndex::open( const std::string& cachePath, const std::string& cacheName, int frame )
+{
+    const std::string path = indexPath( cachePath, cacheName, frame );
+    AtomsCacheIndexPtr result = new AtomsCacheIndex( path );
+    const MappedFile& file = *result->m_file;
+    if ( !file.isValid() )
+    {
+        return nullptr;
+    }
+
+    Header header;
+    if ( !file.read( &header, sizeof( header ), 0 ) || std::memcmp( header.magic, g_magic, sizeof( g_magic ) ) != 0 || header.version != g_version )
+    {
+        msg( Msg::Warning, "AtomsCacheIndex", "Ignoring the invalid index " + path );
+        return nullptr;
+    }
+
+    // Check the sizes against the file before allocating anything
+    const uint64_t stampsSize = static_cast<uint64_t>( header.numFiles ) * sizeof( FileStamp );
+    if ( stampsSize > file.size() || header.numAgents > ( file.size() - stampsSize ) / sizeof( Block ) )
+    {
+        msg( Msg::Warning, "AtomsCacheIndex", "Ignoring the invalid index " + path );
+        return nullptr;
+    }
+
+    std::vector<FileStamp> stamps( header.numFiles );
+    if ( !file.read( stamps.data(), stamps.size() * sizeof( FileStamp ), sizeof( header ) ) )
+    {
+        msg( Msg::Warning, "AtomsCacheIndex", "Ignoring the invalid index " + path );
+        return nullptr;
+    }
+
+    if ( stamps != frameFileStamps( cachePath, cacheName, frame ) )
+    {
+        msg( Msg::Warning, "AtomsCacheIndex", "Ignoring the out of date index " + path );
+        return nullptr;
+    }
+
+    result->m_blocks.resize( header.numAgents );
+    const uint64_t dataOffset = sizeof( header ) + stamps.size() * sizeof( FileStamp );
+    if ( !file.read( result->m_blocks.data(), result->m_blocks.size() * sizeof( Block ), dataOffset ) )
+    {
+        msg( Msg::Warning, "AtomsCacheIndex", "Ignoring the invalid index " + path );
+        return nullptr;
+    }
+
+    // The agents are loaded with an archive of the size of their block, so every block must be in the data
+    // of the file, and the blocks must be sorted for the lookups
+    const uint64_t blocksEnd = dataOffset + result->m_blocks.size() * sizeof( Block );
+    for ( size_t i = 0; i < result->m_blocks.size(); ++i )
+    {
+        const Block& block = result->m_blocks[i];
+        if (
+            block.offset < blocksEnd || block.offset > file.size() || block.size > file.size() - block.offset ||
+            ( i > 0 && block.agentId <= result->m_blocks[i - 1].agentId )
+        )
+        {
+            msg( Msg::Warning, "AtomsCacheIndex", "Ignoring the invalid index " + path );
+            return nullptr;
+        }
+    }
+
+    return result;
+}
+
+size_t AtomsCacheIndex::numAgents() const
+{
+    return m_blocks.size();
+}
+
+bool AtomsCacheIndex::hasAgent( int agentId ) const
+{
+    return block( agentId ) != nullptr;
+}
+
+void AtomsCacheIndex::loadAgent( int agentId, AtomsCore::PoseMetadata& pose, AtomsCore::MapMetadata& metadata ) const
+{
+    const Block* agentBlock = block( agentId );
+    if ( !agentBlock )
+    {
+        throw InvalidArgumentException( "AtomsCacheIndex : No agent " + std::to_string( agentId ) + " in " + m_path );
+    }
+
+    AtomsCore::Archive archive( agentBlock->size );
+    if ( !m_file->read( archive.data(), agentBlock->size, agentBlock->offset ) )
+    {
+        throw IOException( "AtomsCacheIndex : Unable to read agent " + std::to_string( agentId ) + " from " + m_path );
+    }
+
+    pose.deserialise( archive );
+    metadata.deserialise( archive );
+}
+
+size_t AtomsCacheIndex::memorySize() const
+{
+    return sizeof( AtomsCacheIndex ) + m_blocks.capacity() * sizeof( Block );
+}
+
+const AtomsCacheIndex::Block* AtomsCacheIndex::block( int agentId ) const
+{
+    auto it = std::lower_bound(
+            m_blocks.begin(), m_blocks.end(), agentId,
+            []( const Block& block, int id ) { return block.agentId < id; }
+    );
+    return it != m_blocks.end() && it->agentId == agentId ? &*it : nullptr;
+}
@@ -0,0 +1,401 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsCachePool.h"
+
+#include "AtomsUtils/PathSolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+using namespace AtomsGaffer;
+
+namespace
+{
+
+// Maximum number of cache paths and refresh counts having their shared data kept in the pool.
+// The entries still used by a node stay alive until the node releases them.
+const size_t g_maxEntries = 32;
+
+// Maximum number of frame fingerprints kept for every entry
+const size_t g_maxFrameFingerprints = 4096;
+
+// Maximum number of file content hashes kept by the pool
+const size_t g_maxFileHashes = 4 * g_maxFrameFingerprints;
+
+// Size of the blocks read at once when hashing the frame files
+const size_t g_readBlockSize = 1 << 16;
+
+// Returns false if the file doesn't exist
+bool fileStamp( const std::string& filePath, uint64_t& size, int64_t& writeTime )
+{
+    std::error_code errorCode;
+    const uintmax_t fileSize = std::filesystem::file_size( filePath, errorCode );
+    if ( errorCode )
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>( fileSize );
+    writeTime = static_cast<int64_t>( std::filesystem::last_write_time( filePath, errorCode ).time_since_epoch().count() );
+    return true;
+}
+
+// Hashes the content of a file. The content is read with ordinary reads, so a file rewritten while
+// it is read only gives a different hash.
+IECore::MurmurHash hashFileContent( const std::string& filePath )
+{
+    IECore::MurmurHash h;
+    std::ifstream file( filePath, std::ios::binary );
+    std::vector<char> buffer( g_readBlockSize );
+    while ( file )
+    {
+        file.read( buffer.data(), buffer.size() );
+        if ( file.gcount() > 0 )
+        {
+            h.append( buffer.data(), static_cast<size_t>( file.gcount() ) );
+        }
+    }
+    return h;
+}
+
+} // namespace
+
+AtomsCachePool& AtomsCachePool::instance()
+{
+    static AtomsCachePool pool;
+    return pool;
+}
+
+AtomsCachePool::CachePtr AtomsCachePool::open( const std::string& cachePath, const std::string& cacheName, int refreshCount )
+{
+    EntryPtr entry = this->entry( cachePath, cacheName, refreshCount );
+    CachePtr cache = entryCache( *entry, cachePath, cacheName );
+    if ( !cache )
+    {
+        return CachePtr();
+    }
+
+    // The entry cache is never modified once opened, so it can be copied from several threads.
+    // The copy has the header without reading it again, and loads its frames on its own.
+    return CachePtr( new Atoms::AtomsCache( *cache ) );
+}
+
+size_t AtomsCachePool::loadAgentTypes( const std::string& cachePath, const std::string& cacheName, int refreshCount, Atoms::AtomsCache& cache, const std::vector<std::string>& agentTypeNames )
+{
+    EntryPtr entry = this->entry( cachePath, cacheName, refreshCount );
+
+    size_t loaded = 0;
+    auto& cacheAgentTypes = cache.agentTypes();
+    for ( const std::string& agentTypeName : agentTypeNames )
+    {
+        if ( cacheAgentTypes.agentType( agentTypeName ) )
+        {
+            continue;
+        }
+
+        Atoms::AgentTypePtr agentType;
+        {
+            std::lock_guard<std::mutex> lock( entry->mutex );
+            auto it = entry->agentTypes.find( agentTypeName );
+            if ( it != entry->agentTypes.end() )
+            {
+                agentType = it->second;
+            }
+        }
+
+        if ( agentType )
+        {
+            cacheAgentTypes.addAgentType( agentTypeName, agentType );
+            continue;
+        }
+
+        // The type is loaded without holding the lock, so two caches may load it at the same time.
+        // The first one to finish shares its type, the other one drops its own copy.
+        cache.loadAgentType( agentTypeName, false );
+        ++loaded;
+        agentType = cacheAgentTypes.agentType( agentTypeName );
+        if ( !agentType )
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock( entry->mutex );
+        auto inserted = entry->agentTypes.insert( std::make_pair( agentTypeName, agentType ) );
+        if ( !inserted.second )
+        {
+            cacheAgentTypes.addAgentType( agentTypeName, inserted.first->second );
+        }
+    }
+
+    return loaded;
+}
+
+size_t AtomsCachePool::agentTypesMemory( const std::string& cachePath, const std::string& cacheName, int refreshCount )
+{
+    EntryPtr entry = this->entry( cachePath, cacheName, refreshCount );
+
+    size_t memory = 0;
+    std::lock_guard<std::mutex> lock( entry->mutex );
+    for ( const auto& agentType : entry->agentTypes )
+    {
+        if ( agentType.second )
+        {
+            memory += agentType.second->memSize();
+        }
+    }
+    return memory;
+}
+
+IECore::MurmurHash AtomsCachePool::frameHash( const std::string& cachePath, const std::string& cacheName, int refreshCount, double frame )
+{
+    EntryPtr entry = this->entry( cachePath, cacheName, refreshCount );
+
+    // The frame range is read from the header of the cache opened for the entry
+    CachePtr cache = entryCache( *entry, cachePath, cacheName );
+    if ( !cache )
+    {
+        // The caches that can't be opened never share a hash with each other
+        IECore::MurmurHash h;
+        h.append( "unopenedCache" );
+        h.append( cachePath );
+        h.append( cacheName );
+        h.append( frame );
+        return h;
+    }
+
+    const double startFrame = cache->startFrame();
+    const double endFrame = cache->endFrame();
+
+    // Clamp the frame, as the crowd reader does
+    frame = frame < startFrame ? startFrame : frame;
+    frame = frame > endFrame ? endFrame : frame;
+
+    const int cacheFrame = static_cast<int>( std::floor( frame ) );
+    const double frameReminder = frame - cacheFrame;
+
+    // The cache identifies the agent types, the frame files identify the data loaded for the frame
+    IECore::MurmurHash h;
+    h.append( cachePath );
+    h.append( cacheName );
+    h.append( frameFingerprint( *entry, cachePath, cacheName, cacheFrame ) );
+    if ( frameReminder > 0.0 )
+    {
+        h.append( frameFingerprint( *entry, cachePath, cacheName, cacheFrame + 1 ) );
+        h.append( frameReminder );
+    }
+
+    return h;
+}
+
+void AtomsCachePool::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_entries.clear();
+        m_entriesOrder.clear();
+    }
+
+    std::lock_guard<std::mutex> lock( m_fileHashesMutex );
+    m_fileHashes.clear();
+    m_fileHashesOrder.clear();
+}
+
+void AtomsCachePool::splitFilePath( const std::string& filePath, std::string& cachePath, std::string& cacheName, const std::string& extension )
+{
+    cachePath = filePath;
+    std::string fullPath = cachePath;
+    fullPath = AtomsUtils::solvePath( fullPath );
+    std::replace( fullPath.begin(), fullPath.end(), '\\', '/' );
+
+    const size_t lastSlashIdx = fullPath.rfind( '/' );
+    if ( std::string::npos != lastSlashIdx )
+    {
+
+        cacheName = fullPath.substr( lastSlashIdx + 1, fullPath.length() );
+        const size_t lastDotIdx = cacheName.rfind( '.' );
+        if ( !( std::string::npos == lastDotIdx || cacheName.substr( lastDotIdx + 1, cacheName.length() ) != extension ) )
+        {
+            const size_t firstDotIdx = cacheName.find( '.' );
+            cacheName = cacheName.substr( 0, firstDotIdx );
+            cachePath = fullPath.substr( 0, lastSlashIdx );
+        }
+        else
+        {
+            cacheName = "";
+        }
+    }
+}
+
+const std::vector<std::string>& AtomsCachePool::frameFileTypes()
+{
+    static const std::vector<std::string> fileTypes = { "header", "frame", "pose", "meta" };
+    return fileTypes;
+}
+
+std::string AtomsCachePool::frameFilePath( const std::string& cachePath, const std::string& cacheName, int frame, const std::string& fileType )
+{
+    char frameStr[16];
+    snprintf( frameStr, sizeof( frameStr ), "%04d", frame );
+    return cachePath + "/" + cacheName + "." + frameStr + "." + fileType + ".atoms";
+}
+
+AtomsCachePool::EntryPtr AtomsCachePool::entry( const std::string& cachePath, const std::string& cacheName, int refreshCount )
+{
+    const EntryKey key( cachePath + "/" + cacheName, refreshCount );
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    auto it = m_entries.find( key );
+    if ( it != m_entries.end() )
+    {
+        m_entriesOrder.splice( m_entriesOrder.begin(), m_entriesOrder, it->second.second );
+        return it->second.first;
+    }
+
+    m_entriesOrder.push_front( key );
+    EntryPtr result = std::make_shared<Entry>();
+    m_entries[key] = std::make_pair( result, m_entriesOrder.begin() );
+
+    // The nodes still using an evicted entry keep it alive, but it is no longer shared with the new caches
+    while ( m_entries.size() > g_maxEntries )
+    {
+        m_entries.erase( m_entriesOrder.back() );
+        m_entriesOrder.pop_back();
+    }
+
+    return result;
+}
+
+AtomsCachePool::CachePtr AtomsCachePool::entryCache( Entry& entry, const std::string& cachePath, const std::string& cacheName )
+{
+    // The cache is opened under the lock, so it is opened only once even when several engines start together.
+    // A cache that can't be opened isn't tried again until the refresh count changes.
+    std::lock_guard<std::mutex> lock( entry.mutex );
+    if ( !entry.cacheOpened )
+    {
+        entry.cacheOpened = true;
+        CachePtr cache( new Atoms::AtomsCache );
+        if ( cache->openCache( cachePath, cacheName ) )
+        {
+            entry.cache = cache;
+        }
+    }
+    return entry.cache;
+}
+
+IECore::MurmurHash AtomsCachePool::frameFingerprint( Entry& entry, const std::string& cachePath, const std::string& cacheName, int frame )
+{
+    {
+        std::lock_guard<std::mutex> lock( entry.mutex );
+        auto it = entry.frameFingerprints.find( frame );
+        if ( it != entry.frameFingerprints.end() )
+        {
+            entry.frameFingerprintsOrder.splice( entry.frameFingerprintsOrder.begin(), entry.frameFingerprintsOrder, it->second.second );
+            return it->second.first;
+        }
+    }
+
+    // The content of the files is hashed, without the frame number, so the held frames written in files
+    // of their own get the same fingerprint
+    IECore::MurmurHash result;
+    for ( const std::string& fileType : frameFileTypes() )
+    {
+        result.append( fileHash( frameFilePath( cachePath, cacheName, frame, fileType ) ) );
+    }
+
+    std::lock_guard<std::mutex> lock( entry.mutex );
+    if ( entry.frameFingerprints.find( frame ) == entry.frameFingerprints.end() )
+    {
+        entry.frameFingerprintsOrder.push_front( frame );
+        entry.frameFingerprints[frame] = std::make_pair( result, entry.frameFingerprintsOrder.begin() );
+        while ( entry.frameFingerprints.size() > g_maxFrameFingerprints )
+        {
+            entry.frameFingerprints.erase( entry.frameFingerprintsOrder.back() );
+            entry.frameFingerprintsOrder.pop_back();
+        }
+    }
+    return result;
+}
+
+IECore::MurmurHash AtomsCachePool::fileHash( const std::string& filePath )
+{
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+    if ( !fileStamp( filePath, size, writeTime ) )
+    {
+        // A missing file is part of the frame content too
+        IECore::MurmurHash h;
+        h.append( "missingFile" );
+        return h;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( m_fileHashesMutex );
+        auto it = m_fileHashes.find( filePath );
+        if ( it != m_fileHashes.end() && it->second.size == size && it->second.writeTime == writeTime )
+        {
+            m_fileHashesOrder.splice( m_fileHashesOrder.begin(), m_fileHashesOrder, it->second.order );
+            return it->second.hash;
+        }
+    }
+
+    // Hashed without holding the lock, a file is hashed twice at worst
+    const IECore::MurmurHash hash = hashFileContent( filePath );
+
+    std::lock_guard<std::mutex> lock( m_fileHashesMutex );
+    auto it = m_fileHashes.find( filePath );
+    if ( it == m_fileHashes.end() )
+    {
+        m_fileHashesOrder.push_front( filePath );
+        it = m_fileHashes.emplace( filePath, FileHash{ size, writeTime, hash, m_fileHashesOrder.begin() } ).first;
+        while ( m_fileHashes.size() > g_maxFileHashes )
+        {
+            m_fileHashes.erase( m_fileHashesOrder.back() );
+            m_fileHashesOrder.pop_back();
+        }
+    }
+    else
+    {
+        it->second.size = size;
+        it->second.writeTime = writeTime;
+        it->second.hash = hash;
+        m_fileHashesOrder.splice( m_fileHashesOrder.begin(), m_fileHashesOrder, it->second.order );
+    }
+    return hash;
+}
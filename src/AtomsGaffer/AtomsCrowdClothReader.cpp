@@ -35,6 +35,7 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "AtomsGaffer/AtomsCrowdClothReader.h"
+#include "AtomsGaffer/AtomsCrowdData.h"
 #include "AtomsGaffer/AtomsMathTranaslator.h"
 
 #include "IECoreScene/PointsPrimitive.h"
@@ -96,6 +97,16 @@ const IntPlug* AtomsCrowdClothReader::refreshCountPlug() const
     return getChild<IntPlug>( g_firstPlugIndex + 1 );
 }
 
+IECore::CompoundDataPtr AtomsCrowdClothReader::statistics() const
+{
+    return m_statistics.data();
+}
+
+void AtomsCrowdClothReader::clearStatistics()
+{
+    m_statistics.clear();
+}
+
 void AtomsCrowdClothReader::affects( const Plug *input, AffectedPlugsContainer &outputs ) const
 {
     SceneProcessor::affects(input, outputs);
@@ -138,16 +149,16 @@ ConstObjectPtr AtomsCrowdClothReader::computeObject( const ScenePath &path, cons
     auto crowdAttributes = runTimeCast<const IECore::CompoundObject>( inPlug()->attributesPlug()->getValue() );
     if ( crowdAttributes )
     {
-        auto& crowdAttributesData = crowdAttributes->members();
-        auto attrIt = crowdAttributesData.find( "frameOffset" );
-        if ( attrIt != crowdAttributesData.cend() )
+        auto crowdData = crowdAttributes->member<const AtomsCrowdData>( "atoms:agents" );
+        if ( crowdData )
         {
-            auto frameOffsetData = runTimeCast<const FloatData>( attrIt->second );
-            if ( frameOffsetData )
-                frameOffset = frameOffsetData->readable();
+            frameOffset = crowdData->getFrameOffset();
         }
     }
 
+    AtomsStatistics::ScopedTimer totalTimer( m_statistics, "total" );
+    m_statistics.addEvent( "frameLoads" );
+
     Atoms::AtomsClothCache cache;
     std::string cachePath, cacheName;
     std::string filePath = atomsClothFilePlug()->getValue();
@@ -155,7 +166,12 @@ ConstObjectPtr AtomsCrowdClothReader::computeObject( const ScenePath &path, cons
 
     getAtomsCacheName( filePath, cachePath, cacheName, "clothcache" );
 
-    if( !cache.openCache( cachePath, cacheName ) )
+    bool opened = false;
+    {
+        AtomsStatistics::ScopedTimer timer( m_statistics, "openCache" );
+        opened = cache.openCache( cachePath, cacheName );
+    }
+    if( !opened )
     {
         IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
         return NullObject::defaultNullObject();
@@ -172,11 +188,21 @@ ConstObjectPtr AtomsCrowdClothReader::computeObject( const ScenePath &path, cons
         cache.setAgentsToLoad( *agentIdVec );
     }
 
-    cache.loadFrame( cacheFrame );
-    if ( frameReminder > 0.0 )
-        cache.loadNextFrame( cacheFrame + 1 );
+    {
+        AtomsStatistics::ScopedTimer timer( m_statistics, "loadFrame" );
+        cache.loadFrame( cacheFrame );
+        if ( frameReminder > 0.0 )
+            cache.loadNextFrame( cacheFrame + 1 );
+    }
 
     auto agentIds = cache.agentIds( cacheFrame );
+    if ( cache.frameData() )
+    {
+        m_statistics.setMemory( "frame", cache.frameData()->memSize() );
+    }
+
+    AtomsStatistics::ScopedTimer meshesTimer( m_statistics, "loadMeshes" );
+    int64_t numMeshes = 0;
 
     CompoundDataPtr clothCompound = new CompoundData;
     auto& clothData = clothCompound->writable();
@@ -220,8 +246,9 @@ ConstObjectPtr AtomsCrowdClothReader::computeObject( const ScenePath &path, cons
             cache.loadAgentClothMesh( frame, agentId, meshName, clothPoints, clothNormals );
             cache.loadAgentClothMeshBoundingBox( frame, agentId, meshName, clothBound );
 
-            convertFromAtoms( p->writable(), clothPoints );
-            convertFromAtoms( n->writable(), clothNormals );
+            // The loaded arrays aren't needed anymore, so they are moved in the data when they have the same type
+            convertFromAtoms( p->writable(), std::move( clothPoints ) );
+            convertFromAtoms( n->writable(), std::move( clothNormals ) );
             convertFromAtoms( bbox->writable(), clothBound );
 
             stackOrder->writable() = cache.getAgentClothMeshStackOrder( frame, agentId, meshName );
@@ -232,6 +259,7 @@ ConstObjectPtr AtomsCrowdClothReader::computeObject( const ScenePath &path, cons
 
             agentData[ meshName ] = meshCompound;
             agentBBox.extendBy(bbox->readable());
+            ++numMeshes;
         }
 
         Box3dDataPtr agBox = new Box3dData;
@@ -241,6 +269,9 @@ ConstObjectPtr AtomsCrowdClothReader::computeObject( const ScenePath &path, cons
         clothData[ agentIdStr ] = agentCompound;
     }
 
+    m_statistics.setCount( "agents", agentIds.size() );
+    m_statistics.setCount( "meshes", numMeshes );
+
     BlindDataHolderPtr result = new BlindDataHolder( clothCompound );
     return result;
 }
@@ -0,0 +1,527 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsCrowdData.h"
+
+#include "IECore/Exception.h"
+#include "IECore/MurmurHash.h"
+
+#include <algorithm>
+
+using namespace IECore;
+using namespace AtomsGaffer;
+
+namespace
+{
+
+const IndexedIO::EntryID g_agentIdsEntry( "agentIds" );
+const IndexedIO::EntryID g_matrixOffsetsEntry( "matrixOffsets" );
+const IndexedIO::EntryID g_worldMatricesEntry( "worldMatrices" );
+const IndexedIO::EntryID g_normalMatricesEntry( "normalMatrices" );
+const IndexedIO::EntryID g_compactMatricesEntry( "compactMatrices" );
+const IndexedIO::EntryID g_rootMatricesEntry( "rootMatrices" );
+const IndexedIO::EntryID g_boundsEntry( "bounds" );
+const IndexedIO::EntryID g_poseHashesEntry( "poseHashes" );
+const IndexedIO::EntryID g_agentTypesEntry( "agentTypes" );
+const IndexedIO::EntryID g_metadataEntry( "metadata" );
+const IndexedIO::EntryID g_frameOffsetEntry( "frameOffset" );
+
+template<typename T>
+void writeArray( IndexedIO *container, const IndexedIO::EntryID &name, const T *data, size_t size )
+{
+    if ( size )
+    {
+        container->write( name, data, size );
+    }
+}
+
+template<typename T>
+void readArray( const IndexedIO *container, const IndexedIO::EntryID &name, T *data, size_t size )
+{
+    if ( size && container->hasEntry( name ) )
+    {
+        container->read( name, data, size );
+    }
+}
+
+// Number of floats stored for every compact matrix
+const size_t g_compactMatrixSize = 12;
+
+} // namespace
+
+const unsigned int AtomsCrowdData::m_ioVersion = 0;
+
+IE_CORE_DEFINEOBJECTTYPEDESCRIPTION( AtomsCrowdData );
+
+AtomsCrowdData::AtomsCrowdData() : m_matrixOffsets( 1, 0 ), m_compact( false ), m_frameOffset( 0.0f )
+{
+}
+
+void AtomsCrowdData::setAgents( const std::vector<int>& agentIds, const std::vector<size_t>& numJoints, bool compact )
+{
+    if ( agentIds.size() != numJoints.size() )
+    {
+        throw InvalidArgumentException( "AtomsCrowdData : agentIds and numJoints must have the same length" );
+    }
+
+    const size_t numAgents = agentIds.size();
+    m_agentIds = agentIds;
+    m_matrixOffsets.resize( numAgents + 1 );
+    m_matrixOffsets[0] = 0;
+    for ( size_t i = 0; i < numAgents; ++i )
+    {
+        m_matrixOffsets[i + 1] = m_matrixOffsets[i] + numJoints[i];
+    }
+
+    m_compact = compact;
+    if ( m_compact )
+    {
+        m_worldMatrices.clear();
+        m_normalMatrices.clear();
+        m_compactMatrices.resize( m_matrixOffsets.back() * g_compactMatrixSize );
+        for ( size_t i = 0; i < m_matrixOffsets.back(); ++i )
+        {
+            compactMatrix( Imath::M44d(), m_compactMatrices.data() + i * g_compactMatrixSize );
+        }
+    }
+    else
+    {
+        m_worldMatrices.assign( m_matrixOffsets.back(), Imath::M44d() );
+        m_normalMatrices.assign( m_matrixOffsets.back(), Imath::M44d() );
+        m_compactMatrices.clear();
+    }
+    m_rootMatrices.assign( numAgents, Imath::M44d() );
+    m_bounds.assign( numAgents, Imath::Box3d() );
+    m_poseHashes.assign( numAgents, 0 );
+    m_agentTypes.assign( numAgents, std::string() );
+    m_metadata.assign( numAgents, ConstCompoundDataPtr() );
+
+    updateAgentIndices();
+}
+
+bool AtomsCrowdData::isCompact() const
+{
+    return m_compact;
+}
+
+size_t AtomsCrowdData::numAgents() const
+{
+    return m_agentIds.size();
+}
+
+int AtomsCrowdData::agentIndex( int agentId ) const
+{
+    auto it = m_agentIndices.find( agentId );
+    return it != m_agentIndices.end() ? static_cast<int>( it->second ) : -1;
+}
+
+const std::vector<int>& AtomsCrowdData::agentIds() const
+{
+    return m_agentIds;
+}
+
+const std::vector<size_t>& AtomsCrowdData::matrixOffsets() const
+{
+    return m_matrixOffsets;
+}
+
+size_t AtomsCrowdData::numJoints( size_t index ) const
+{
+    return m_matrixOffsets[index + 1] - m_matrixOffsets[index];
+}
+
+const std::vector<Imath::M44d>& AtomsCrowdData::worldMatrices() const
+{
+    return m_worldMatrices;
+}
+
+std::vector<Imath::M44d>& AtomsCrowdData::worldMatrices()
+{
+    return m_worldMatrices;
+}
+
+const std::vector<Imath::M44d>& AtomsCrowdData::normalMatrices() const
+{
+    return m_normalMatrices;
+}
+
+std::vector<Imath::M44d>& AtomsCrowdData::normalMatrices()
+{
+    return m_normalMatrices;
+}
+
+const Imath::M44d* AtomsCrowdData::worldMatrices( size_t index ) const
+{
+    return m_worldMatrices.data() + m_matrixOffsets[index];
+}
+
+Imath::M44d* AtomsCrowdData::worldMatrices( size_t index )
+{
+    return m_worldMatrices.data() + m_matrixOffsets[index];
+}
+
+const Imath::M44d* AtomsCrowdData::normalMatrices( size_t index ) const
+{
+    return m_normalMatrices.data() + m_matrixOffsets[index];
+}
+
+Imath::M44d* AtomsCrowdData::normalMatrices( size_t index )
+{
+    return m_normalMatrices.data() + m_matrixOffsets[index];
+}
+
+const std::vector<float>& AtomsCrowdData::compactMatrices() const
+{
+    return m_compactMatrices;
+}
+
+std::vector<float>& AtomsCrowdData::compactMatrices()
+{
+    return m_compactMatrices;
+}
+
+const float* AtomsCrowdData::compactMatrices( size_t index ) const
+{
+    return m_compactMatrices.data() + m_matrixOffsets[index] * g_compactMatrixSize;
+}
+
+float* AtomsCrowdData::compactMatrices( size_t index )
+{
+    return m_compactMatrices.data() + m_matrixOffsets[index] * g_compactMatrixSize;
+}
+
+void AtomsCrowdData::skinningMatrices( size_t index, std::vector<Imath::M44d>& matrices ) const
+{
+    const size_t jointCount = numJoints( index );
+    matrices.resize( jointCount );
+    if ( !m_compact )
+    {
+        std::copy( worldMatrices( index ), worldMatrices( index ) + jointCount, matrices.begin() );
+        return;
+    }
+
+    const float* compact = compactMatrices( index );
+    for ( size_t j = 0; j < jointCount; ++j )
+    {
+        matrices[j] = expandMatrix( compact + j * g_compactMatrixSize );
+    }
+}
+
+void AtomsCrowdData::compactMatrix( const Imath::M44d& matrix, float* compact )
+{
+    for ( int row = 0; row < 4; ++row )
+    {
+        for ( int column = 0; column < 3; ++column )
+        {
+            *compact++ = static_cast<float>( matrix[row][column] );
+        }
+    }
+}
+
+Imath::M44d AtomsCrowdData::expandMatrix( const float* compact )
+{
+    Imath::M44d matrix;
+    for ( int row = 0; row < 4; ++row )
+    {
+        for ( int column = 0; column < 3; ++column )
+        {
+            matrix[row][column] = *compact++;
+        }
+    }
+    return matrix;
+}
+
+const std::vector<Imath::M44d>& AtomsCrowdData::rootMatrices() const
+{
+    return m_rootMatrices;
+}
+
+std::vector<Imath::M44d>& AtomsCrowdData::rootMatrices()
+{
+    return m_rootMatrices;
+}
+
+const std::vector<Imath::Box3d>& AtomsCrowdData::bounds() const
+{
+    return m_bounds;
+}
+
+std::vector<Imath::Box3d>& AtomsCrowdData::bounds()
+{
+    return m_bounds;
+}
+
+const std::vector<uint64_t>& AtomsCrowdData::poseHashes() const
+{
+    return m_poseHashes;
+}
+
+std::vector<uint64_t>& AtomsCrowdData::poseHashes()
+{
+    return m_poseHashes;
+}
+
+const std::vector<std::string>& AtomsCrowdData::agentTypes() const
+{
+    return m_agentTypes;
+}
+
+std::vector<std::string>& AtomsCrowdData::agentTypes()
+{
+    return m_agentTypes;
+}
+
+const std::vector<ConstCompoundDataPtr>& AtomsCrowdData::metadata() const
+{
+    return m_metadata;
+}
+
+std::vector<ConstCompoundDataPtr>& AtomsCrowdData::metadata()
+{
+    return m_metadata;
+}
+
+float AtomsCrowdData::getFrameOffset() const
+{
+    return m_frameOffset;
+}
+
+void AtomsCrowdData::setFrameOffset( float frameOffset )
+{
+    m_frameOffset = frameOffset;
+}
+
+void AtomsCrowdData::updateAgentIndices()
+{
+    m_agentIndices.clear();
+    m_agentIndices.reserve( m_agentIds.size() );
+    for ( size_t i = 0; i < m_agentIds.size(); ++i )
+    {
+        m_agentIndices[m_agentIds[i]] = i;
+    }
+}
+
+bool AtomsCrowdData::isEqualTo( const Object *other ) const
+{
+    if ( !Object::isEqualTo( other ) )
+    {
+        return false;
+    }
+
+    const AtomsCrowdData *tOther = static_cast<const AtomsCrowdData *>( other );
+    if (
+        m_agentIds != tOther->m_agentIds ||
+        m_matrixOffsets != tOther->m_matrixOffsets ||
+        m_compact != tOther->m_compact ||
+        m_compactMatrices != tOther->m_compactMatrices ||
+        m_poseHashes != tOther->m_poseHashes ||
+        m_agentTypes != tOther->m_agentTypes ||
+        m_rootMatrices != tOther->m_rootMatrices ||
+        m_bounds != tOther->m_bounds ||
+        m_worldMatrices != tOther->m_worldMatrices ||
+        m_normalMatrices != tOther->m_normalMatrices ||
+        m_frameOffset != tOther->m_frameOffset
+    )
+    {
+        return false;
+    }
+
+    for ( size_t i = 0; i < m_metadata.size(); ++i )
+    {
+        const CompoundData *metadata = m_metadata[i].get();
+        const CompoundData *otherMetadata = tOther->m_metadata[i].get();
+        if ( metadata == otherMetadata )
+        {
+            continue;
+        }
+
+        if ( !metadata || !otherMetadata || !metadata->isEqualTo( otherMetadata ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void AtomsCrowdData::memoryUsage( Object::MemoryAccumulator &a ) const
+{
+    Object::memoryUsage( a );
+    a.accumulate( m_agentIds.capacity() * sizeof( int ) );
+    // The index map stores a key, a value and a bucket pointer for every agent
+    a.accumulate( m_agentIndices.size() * ( sizeof( int ) + sizeof( size_t ) + sizeof( void * ) ) );
+    a.accumulate( m_matrixOffsets.capacity() * sizeof( size_t ) );
+    a.accumulate( ( m_worldMatrices.capacity() + m_normalMatrices.capacity() + m_rootMatrices.capacity() ) * sizeof( Imath::M44d ) );
+    a.accumulate( m_compactMatrices.capacity() * sizeof( float ) );
+    a.accumulate( m_bounds.capacity() * sizeof( Imath::Box3d ) );
+    a.accumulate( m_poseHashes.capacity() * sizeof( uint64_t ) );
+    for ( const auto& agentType : m_agentTypes )
+    {
+        a.accumulate( sizeof( std::string ) + agentType.capacity() );
+    }
+
+    for ( const auto& metadata : m_metadata )
+    {
+        if ( metadata )
+        {
+            a.accumulate( metadata.get() );
+        }
+    }
+}
+
+void AtomsCrowdData::hash( MurmurHash &h ) const
+{
+    Object::hash( h );
+    h.append( m_agentIds.data(), m_agentIds.size() );
+    for ( auto offset : m_matrixOffsets )
+    {
+        h.append( static_cast<uint64_t>( offset ) );
+    }
+    h.append( m_worldMatrices.data(), m_worldMatrices.size() );
+    h.append( m_normalMatrices.data(), m_normalMatrices.size() );
+    h.append( m_compact ? 1 : 0 );
+    h.append( m_compactMatrices.data(), m_compactMatrices.size() );
+    h.append( m_rootMatrices.data(), m_rootMatrices.size() );
+    h.append( m_bounds.data(), m_bounds.size() );
+    h.append( m_poseHashes.data(), m_poseHashes.size() );
+    h.append( m_agentTypes.data(), m_agentTypes.size() );
+    for ( const auto& metadata : m_metadata )
+    {
+        if ( metadata )
+        {
+            metadata->hash( h );
+        }
+        else
+        {
+            h.append( 0 );
+        }
+    }
+    h.append( m_frameOffset );
+}
+
+void AtomsCrowdData::copyFrom( const Object *other, CopyContext *context )
+{
+    Object::copyFrom( other, context );
+    const AtomsCrowdData *tOther = static_cast<const AtomsCrowdData *>( other );
+    m_agentIds = tOther->m_agentIds;
+    m_agentIndices = tOther->m_agentIndices;
+    m_matrixOffsets = tOther->m_matrixOffsets;
+    m_worldMatrices = tOther->m_worldMatrices;
+    m_normalMatrices = tOther->m_normalMatrices;
+    m_compactMatrices = tOther->m_compactMatrices;
+    m_compact = tOther->m_compact;
+    m_rootMatrices = tOther->m_rootMatrices;
+    m_bounds = tOther->m_bounds;
+    m_poseHashes = tOther->m_poseHashes;
+    m_agentTypes = tOther->m_agentTypes;
+    // The metadata is never modified after it's stored, so it can be shared
+    m_metadata = tOther->m_metadata;
+    m_frameOffset = tOther->m_frameOffset;
+}
+
+void AtomsCrowdData::save( SaveContext *context ) const
+{
+    Object::save( context );
+    IndexedIOPtr container = context->container( staticTypeName(), m_ioVersion );
+
+    std::vector<uint64_t> matrixOffsets( m_matrixOffsets.begin(), m_matrixOffsets.end() );
+    writeArray( container.get(), g_agentIdsEntry, m_agentIds.data(), m_agentIds.size() );
+    writeArray( container.get(), g_matrixOffsetsEntry, matrixOffsets.data(), matrixOffsets.size() );
+    writeArray( container.get(), g_worldMatricesEntry, m_worldMatrices.empty() ? nullptr : m_worldMatrices[0].getValue(), m_worldMatrices.size() * 16 );
+    writeArray( container.get(), g_normalMatricesEntry, m_normalMatrices.empty() ? nullptr : m_normalMatrices[0].getValue(), m_normalMatrices.size() * 16 );
+    writeArray( container.get(), g_compactMatricesEntry, m_compactMatrices.data(), m_compactMatrices.size() );
+    writeArray( container.get(), g_rootMatricesEntry, m_rootMatrices.empty() ? nullptr : m_rootMatrices[0].getValue(), m_rootMatrices.size() * 16 );
+    writeArray( container.get(), g_boundsEntry, m_bounds.empty() ? nullptr : &m_bounds[0].min.x, m_bounds.size() * 6 );
+    writeArray( container.get(), g_poseHashesEntry, m_poseHashes.data(), m_poseHashes.size() );
+    writeArray( container.get(), g_agentTypesEntry, m_agentTypes.data(), m_agentTypes.size() );
+    container->write( g_frameOffsetEntry, m_frameOffset );
+
+    IndexedIOPtr metadataContainer = container->subdirectory( g_metadataEntry, IndexedIO::CreateIfMissing );
+    for ( size_t i = 0; i < m_metadata.size(); ++i )
+    {
+        if ( m_metadata[i] )
+        {
+            context->save( m_metadata[i].get(), metadataContainer.get(), std::to_string( i ) );
+        }
+    }
+}
+
+void AtomsCrowdData::load( LoadContextPtr context )
+{
+    Object::load( context );
+    unsigned int v = m_ioVersion;
+    ConstIndexedIOPtr container = context->container( staticTypeName(), v );
+
+    std::vector<int> agentIds;
+    if ( container->hasEntry( g_agentIdsEntry ) )
+    {
+        agentIds.resize( container->entry( g_agentIdsEntry ).arrayLength() );
+        readArray( container.get(), g_agentIdsEntry, agentIds.data(), agentIds.size() );
+    }
+
+    std::vector<uint64_t> matrixOffsets( agentIds.size() + 1, 0 );
+    readArray( container.get(), g_matrixOffsetsEntry, matrixOffsets.data(), matrixOffsets.size() );
+    std::vector<size_t> numJoints( agentIds.size() );
+    for ( size_t i = 0; i < agentIds.size(); ++i )
+    {
+        numJoints[i] = matrixOffsets[i + 1] - matrixOffsets[i];
+    }
+
+    // Only the compact crowds store the compact matrices, an empty compact crowd is loaded as a regular one
+    setAgents( agentIds, numJoints, container->hasEntry( g_compactMatricesEntry ) );
+
+    readArray( container.get(), g_worldMatricesEntry, m_worldMatrices.empty() ? nullptr : m_worldMatrices[0].getValue(), m_worldMatrices.size() * 16 );
+    readArray( container.get(), g_normalMatricesEntry, m_normalMatrices.empty() ? nullptr : m_normalMatrices[0].getValue(), m_normalMatrices.size() * 16 );
+    readArray( container.get(), g_compactMatricesEntry, m_compactMatrices.data(), m_compactMatrices.size() );
+    readArray( container.get(), g_rootMatricesEntry, m_rootMatrices.empty() ? nullptr : m_rootMatrices[0].getValue(), m_rootMatrices.size() * 16 );
+    readArray( container.get(), g_boundsEntry, m_bounds.empty() ? nullptr : &m_bounds[0].min.x, m_bounds.size() * 6 );
+    readArray( container.get(), g_poseHashesEntry, m_poseHashes.data(), m_poseHashes.size() );
+    readArray( container.get(), g_agentTypesEntry, m_agentTypes.data(), m_agentTypes.size() );
+    container->read( g_frameOffsetEntry, m_frameOffset );
+
+    ConstIndexedIOPtr metadataContainer = container->subdirectory( g_metadataEntry, IndexedIO::NullIfMissing );
+    if ( metadataContainer )
+    {
+        for ( size_t i = 0; i < m_metadata.size(); ++i )
+        {
+            const std::string name = std::to_string( i );
+            if ( metadataContainer->hasEntry( name ) )
+            {
+                m_metadata[i] = context->load<CompoundData>( metadataContainer.get(), name );
+            }
+        }
+    }
+}
@@ -36,6 +36,7 @@
 
 #include <AtomsUtils/Logger.h>
 #include "AtomsGaffer/AtomsCrowdGenerator.h"
+#include "AtomsGaffer/AtomsCrowdReader.h"
 
 #include "Atoms/GlobalNames.h"
 
@@ -341,7 +342,7 @@ void AtomsCrowdGenerator::hashBranchBound( const ScenePath &parentPath, const Sc
 		// "/agents/<agentType>/<variation>/<id>"
 		BranchCreator::hashBranchBound( parentPath, branchPath, context, h );
 
-		inPlug()->attributesPlug()->hash( h );
+		agentCacheHash( branchPath, h );
         boundingBoxPaddingPlug()->hash( h );
 		clothCachePlug()->objectPlug()->hash( h );
 		h.append( branchPath.back() );
@@ -371,41 +372,17 @@ Imath::Box3f AtomsCrowdGenerator::computeBranchBound( const ScenePath &parentPat
 
         // If there is any cloth extract the bounding box
         Imath::Box3d agentClothBBox;
-		ConstCompoundObjectPtr crowd;
+        ConstAtomsCrowdDataPtr agentData;
+        size_t agentIndex = 0;
 		{
 			ScenePlug::PathScope scope( context, &parentPath );
-			crowd = runTimeCast<const CompoundObject>( inPlug()->attributesPlug()->getValue() );
+			agentData = agentCacheData( branchPath, agentIndex );
             agentClothBBox = agentClothBoudingBox( parentPath, branchPath );
 		}
 
-
         // Extract the bound from the agent bound stored inside the atoms cache
         // This bound is computed from the agent joints and not from the skinned mesh,
         // so it's not 100% right
-        if( !crowd )
-        {
-            throw InvalidArgumentException( "AtomsCrowdGenerator : Input crowd must be a Compound Object." );
-        }
-
-        // The atoms:agents contain the atoms cache, so extract the bounding box from it
-        auto atomsData = crowd->member<const BlindDataHolder>( "atoms:agents" );
-        if( !atomsData )
-        {
-            throw InvalidArgumentException( "AtomsCrowdGenerator :  computeBranchBound : No agents data found." );
-        }
-
-        auto agentsData = atomsData->blindData();
-        if( !agentsData )
-        {
-            throw InvalidArgumentException( "AtomsCrowdGenerator : computeBranchBound : No agents data found." );
-        }
-
-        // Extract the current agent
-        auto agentData = agentsData->member<const CompoundData>( branchPath[3].string() );
-        if( !agentData )
-        {
-            throw InvalidArgumentException( "AtomsCrowdGenerator : computeBranchBound : No agent found." );
-        }
 
         Imath::M44d transformMtx;
         Imath::M44d transformInvMtx;
@@ -421,37 +398,24 @@ Imath::Box3f AtomsCrowdGenerator::computeBranchBound( const ScenePath &parentPat
         }
 
         // Extract the agent root matrix
-        Imath::M44d rootInvMatrix;
-        Imath::M44d rootMatrix;
-        auto poseData = agentData->member<const M44dData>( "rootMatrix" );
-        if ( poseData ) {
-            rootMatrix = poseData->readable();
-            rootInvMatrix = rootMatrix.inverse();
-        }
-
+        const Imath::M44d& rootMatrix = agentData->rootMatrices()[agentIndex];
+        Imath::M44d rootInvMatrix = rootMatrix.inverse();
 
-        auto boxData = agentData->member<const Box3dData>( "boundingBox" );
+        const Imath::Box3d& agentBounds = agentData->bounds()[agentIndex];
         Imath::Box3f result;
-        if ( boxData )
-        {
-            float padding  = boundingBoxPaddingPlug()->getValue();
-            Imath::Box3d agentBox;
-            agentBox.extendBy( boxData->readable().min * transformInvMtx );
-            agentBox.extendBy( boxData->readable().max * transformInvMtx );
-            if ( !agentClothBBox.isEmpty() )
-            {
-                // The cloth bounding box is in world space. Convert in local space
-                agentBox.extendBy( agentClothBBox.min * transformInvMtx * rootInvMatrix );
-                agentBox.extendBy( agentClothBBox.max * transformInvMtx * rootInvMatrix );
-            }
-
-            result.extendBy( agentBox.min - Imath::V3f( padding, padding, padding ) );
-            result.extendBy( agentBox.max + Imath::V3f( padding, padding, padding ) );
-        }
-        else
+        float padding  = boundingBoxPaddingPlug()->getValue();
+        Imath::Box3d agentBox;
+        agentBox.extendBy( agentBounds.min * transformInvMtx );
+        agentBox.extendBy( agentBounds.max * transformInvMtx );
+        if ( !agentClothBBox.isEmpty() )
         {
-            throw InvalidArgumentException( "AtomsCrowdGenerator : No boundingBox or rootMatrix data found." );
+            // The cloth bounding box is in world space. Convert in local space
+            agentBox.extendBy( agentClothBBox.min * transformInvMtx * rootInvMatrix );
+            agentBox.extendBy( agentClothBBox.max * transformInvMtx * rootInvMatrix );
         }
+
+        result.extendBy( agentBox.min - Imath::V3f( padding, padding, padding ) );
+        result.extendBy( agentBox.max + Imath::V3f( padding, padding, padding ) );
         return result;
     }
 
@@ -475,7 +439,7 @@ void AtomsCrowdGenerator::hashBranchTransform( const ScenePath &parentPath, cons
 	else if( branchPath.size() == 4 )
 	{
 		// "/agents/<agentType>/<variation>/<id>"
-        inPlug()->attributesPlug()->hash( h );
+        agentCacheHash( branchPath, h );
 		h.append( branchPath[3] );
 	}
 	else
@@ -546,9 +510,9 @@ void AtomsCrowdGenerator::hashBranchAttributes( const ScenePath &parentPath, con
         inPlug()->objectPlug()->hash( h );
 
         // The other attributes are stored inside the agent metadata map inside the cache
-        auto agentData = agentCacheData( branchPath );
-        auto metadataData = agentData->member<const CompoundData>( "metadata" );
-        auto& metadataMap = metadataData->readable();
+        size_t agentIndex = 0;
+        auto agentData = agentCacheData( branchPath, agentIndex );
+        auto& metadataMap = agentData->metadata()[agentIndex]->readable();
         for ( auto memberIt = metadataMap.cbegin(); memberIt != metadataMap.cend(); ++memberIt )
         {
             memberIt->second->hash( h );
@@ -588,10 +552,9 @@ ConstCompoundObjectPtr AtomsCrowdGenerator::computeBranchAttributes( const Scene
         auto& objMap = baseAttributes->members();
 
         // Get the agent metadata and convert them in gaffer attributes
-        auto agentData = agentCacheData(branchPath);
-        auto metadataData = agentData->member<const CompoundData>( "metadata" );
-
-        auto& metadataMap = metadataData->readable();
+        size_t agentIndex = 0;
+        auto agentData = agentCacheData( branchPath, agentIndex );
+        auto& metadataMap = agentData->metadata()[agentIndex]->readable();
         for (auto memberIt = metadataMap.cbegin(); memberIt != metadataMap.cend(); ++memberIt)
         {
             std::string variableName = "user:atoms:" + memberIt->first.string();
@@ -817,7 +780,7 @@ void AtomsCrowdGenerator::hashBranchObject( const ScenePath &parentPath, const S
         AgentScope instanceScope( context, branchPath );
         variationsPlug()->objectPlug()->hash( h );
         variationsPlug()->transformPlug()->hash( h );
-        inPlug()->attributesPlug()->hash( h );
+        agentCacheHash( branchPath, h );
         inPlug()->objectPlug()->hash( h );
 		atomsPoseHash( parentPath, branchPath, context, h );
 	}
@@ -911,30 +874,26 @@ ConstObjectPtr AtomsCrowdGenerator::computeBranchObject( const ScenePath &parent
     }
 
 
-    auto agentData = agentCacheData( branchPath );
-    auto metadataData = agentData->member<const CompoundData>( "metadata" );
+    size_t agentIndex = 0;
+    auto agentData = agentCacheData( branchPath, agentIndex );
+    const CompoundData* metadataData = agentData->metadata()[agentIndex].get();
 
     // Extract the pose matricies. Every matrix must be worldBindPoseInverseMatrix * worldMatrix * rootMatrixInverse
-    auto poseData = agentData->member<const M44dVectorData>( "poseWorldMatrices" );
-    if ( !poseData )
+    if ( agentData->numJoints( agentIndex ) == 0 )
     {
-
-        IECore::msg( IECore::Msg::Warning, "AtomsCrowdGenerator", "No poseWorldMatrices found" );
+        IECore::msg( IECore::Msg::Warning, "AtomsCrowdGenerator", "Empty pose matrices found for agent " + branchPath[3].string() );
         return variationsPlug()->objectPlug()->getValue();
     }
-
-    auto poseNormalData = agentData->member<const M44dVectorData>( "poseNormalWorldMatrices" );
-    if ( !poseNormalData )
+    const Imath::M44d* worldMatrices = nullptr;
+    std::vector<Imath::M44d> expandedMatrices;
+    if ( agentData->isCompact() )
     {
-        IECore::msg( IECore::Msg::Warning, "AtomsCrowdGenerator", "No poseNormalWorldMatrices found" );
-        return variationsPlug()->objectPlug()->getValue();
+        agentData->skinningMatrices( agentIndex, expandedMatrices );
+        worldMatrices = expandedMatrices.data();
     }
-    auto& worldMatrices = poseData->readable();
-    auto& worldNormalMatrices = poseNormalData->readable();
-    if ( worldMatrices.empty() || worldNormalMatrices.empty() )
+    else
     {
-        IECore::msg( IECore::Msg::Warning, "AtomsCrowdGenerator", "Empty poseWorldMatrices or poseNormalWorldMatrices attribute" );
-        return variationsPlug()->objectPlug()->getValue();
+        worldMatrices = agentData->worldMatrices( agentIndex );
     }
 
 
@@ -1223,44 +1182,81 @@ void AtomsCrowdGenerator::atomsPoseHash( const ScenePath &parentPath, const Scen
     auto meshAttributes = runTimeCast<const CompoundObject>( variationsPlug()->attributesPlug()->getValue() );
     if ( meshAttributes )
     {
-        auto agentData = agentCacheData(branchPath);
-        auto hashPoseData = agentData->member<const UInt64Data>( "hash" );
-        if ( hashPoseData )
-        {
-            h.append( hashPoseData->readable() );
-            return;
-        }
+        size_t agentIndex = 0;
+        auto agentData = agentCacheData( branchPath, agentIndex );
+        h.append( agentData->poseHashes()[agentIndex] );
+        return;
     }
     h.append( branchPath[3] );
 }
 
-ConstCompoundDataPtr AtomsCrowdGenerator::agentCacheData(const ScenePath &branchPath) const
+const AtomsCrowdReader *AtomsCrowdGenerator::crowdReader() const
 {
-    auto crowd = runTimeCast<const CompoundObject>( inPlug()->attributesPlug()->getValue() );
-    if( !crowd )
+    const Plug *source = inPlug()->attributesPlug()->source();
+    const AtomsCrowdReader *reader = runTimeCast<const AtomsCrowdReader>( source->node() );
+    return reader && source == reader->outPlug()->attributesPlug() ? reader : nullptr;
+}
+
+void AtomsCrowdGenerator::agentCacheHash( const ScenePath &branchPath, MurmurHash &h ) const
+{
+    if ( const AtomsCrowdReader *reader = crowdReader() )
     {
-        throw InvalidArgumentException( "AtomsCrowdGenerator : Input crowd must be a Compound Object." );
+        const int agentId = atoi( branchPath[3].c_str() );
+        ScenePlug::GlobalScope scope( Context::current() );
+        scope.set( AtomsCrowdReader::agentIdContextName, &agentId );
+        reader->agentDataPlug()->hash( h );
+        return;
     }
 
-    auto atomsData = crowd->member<const BlindDataHolder>( "atoms:agents" );
-    if( !atomsData )
+    inPlug()->attributesPlug()->hash( h );
+}
+
+ConstAtomsCrowdDataPtr AtomsCrowdGenerator::agentCacheData( const ScenePath &branchPath, size_t &agentIndex ) const
+{
+    // The variable is set on the internal plug of the reader only, so the reader computes and caches
+    // the agents individually without the other nodes ever seeing it
+    if ( const AtomsCrowdReader *reader = crowdReader() )
     {
-        throw InvalidArgumentException( "AtomsCrowdGenerator :  No agents data found." );
+        ConstObjectPtr agentData;
+        {
+            const int agentId = atoi( branchPath[3].c_str() );
+            ScenePlug::GlobalScope scope( Context::current() );
+            scope.set( AtomsCrowdReader::agentIdContextName, &agentId );
+            agentData = reader->agentDataPlug()->getValue();
+        }
+
+        ConstAtomsCrowdDataPtr agentCrowd = runTimeCast<const AtomsCrowdData>( agentData );
+        if( !agentCrowd )
+        {
+            throw InvalidArgumentException( "AtomsCrowdGenerator : No agent found." );
+        }
+
+        agentIndex = 0;
+        return agentCrowd;
     }
 
-    auto agentsData = atomsData->blindData();
+    // Otherwise the crowd is pulled in the context of the generator, so the upstream nodes compute and
+    // cache it once for all the agents, and the agent is sliced from it
+    ConstCompoundObjectPtr crowd = runTimeCast<const CompoundObject>( inPlug()->attributesPlug()->getValue() );
+    if( !crowd )
+    {
+        throw InvalidArgumentException( "AtomsCrowdGenerator : Input crowd must be a Compound Object." );
+    }
+
+    ConstAtomsCrowdDataPtr agentsData = crowd->member<const AtomsCrowdData>( "atoms:agents" );
     if( !agentsData )
     {
         throw InvalidArgumentException( "AtomsCrowdGenerator :  No agents data found." );
     }
 
-    auto agentData = agentsData->member<const CompoundData>( branchPath[3].string() );
-    if( !agentData )
+    const int index = agentsData->agentIndex( atoi( branchPath[3].c_str() ) );
+    if( index < 0 )
     {
         throw InvalidArgumentException( "AtomsCrowdGenerator : No agent found." );
     }
 
-    return agentData;
+    agentIndex = index;
+    return agentsData;
 }
 
 ConstCompoundDataPtr AtomsCrowdGenerator::agentClothMeshData( const ScenePath &parentPath, const ScenePath &branchPath ) const
@@ -1361,7 +1357,7 @@ void AtomsCrowdGenerator::applySkinDeformer(
         MeshPrimitivePtr& result,
         ConstMeshPrimitivePtr& meshPrim,
         ConstCompoundObjectPtr& meshAttributes,
-        const std::vector<Imath::M44d>& worldMatrices,
+        const Imath::M44d* worldMatrices,
         const Imath::M44f& transformMatrix
         ) const
 {
@@ -1652,44 +1648,14 @@ Imath::M44f AtomsCrowdGenerator::agentRootMatrix(
         const Gaffer::Context *context
         ) const
 {
-    ConstCompoundObjectPtr crowd;
+    ConstAtomsCrowdDataPtr agentData;
+    size_t agentIndex = 0;
     {
         ScenePlug::PathScope scope( context, &parentPath );
-        crowd = runTimeCast<const CompoundObject>( inPlug()->attributesPlug()->getValue() );
+        agentData = agentCacheData( branchPath, agentIndex );
     }
 
-    if( !crowd )
-    {
-        throw InvalidArgumentException( "AtomsCrowdGenerator : Input crowd must be a Compound Object." );
-    }
-
-    auto atomsData = crowd->member<const BlindDataHolder>( "atoms:agents" );
-    if( !atomsData )
-    {
-        throw InvalidArgumentException( "AtomsCrowdGenerator :  computeBranchTransform : No agents data found." );
-    }
-
-    auto agentsData = atomsData->blindData();
-    if( !agentsData )
-    {
-        throw InvalidArgumentException( "AtomsCrowdGenerator : computeBranchTransform : No agents data found." );
-    }
-
-    auto agentData = agentsData->member<const CompoundData>( branchPath[3].string() );
-    if( !agentData )
-    {
-        throw InvalidArgumentException( "AtomsCrowdGenerator : computeBranchTransform : No agent found." );
-    }
-
-    auto poseData = agentData->member<const M44dData>( "rootMatrix" );
-    if ( poseData )
-    {
-        return Imath::M44f( poseData->readable() );
-    }
-    else
-    {
-        throw InvalidArgumentException( "AtomsCrowdGenerator : No rootMatrix data found." );
-    }
+    return Imath::M44f( agentData->rootMatrices()[agentIndex] );
 }
 
 bool AtomsCrowdGenerator::applyClothDeformer(
@@ -35,15 +35,26 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "AtomsGaffer/AtomsCrowdReader.h"
+#include "AtomsGaffer/AtomsAgentFilter.h"
+#include "AtomsGaffer/AtomsCacheIndex.h"
+#include "AtomsGaffer/AtomsCachePool.h"
+#include "AtomsGaffer/AtomsCrowdData.h"
 #include "AtomsGaffer/AtomsMetadataTranslator.h"
+#include "AtomsGaffer/AtomsPaletteKernel.h"
+#include "AtomsGaffer/AtomsPlaybackCache.h"
 #include "AtomsGaffer/AtomsMathTranaslator.h"
 
+#include "Gaffer/Private/IECorePreview/TaskMutex.h"
+
+#include "IECoreScene/Camera.h"
 #include "IECoreScene/PointsPrimitive.h"
 
+#include "IECore/Canceller.h"
+#include "IECore/FileIndexedIO.h"
 #include "IECore/NullObject.h"
-#include "IECore/BlindDataHolder.h"
+#include "IECore/StringAlgo.h"
+#include "IECore/VectorTypedData.h"
 
-#include "AtomsUtils/PathSolver.h"
 #include "AtomsUtils/Utils.h"
 
 #include "Atoms/AtomsCache.h"
@@ -70,6 +81,32 @@
 #include "AtomsCore/Metadata/PoseMetadata.h"
 #include "AtomsCore/Poser.h"
 
+#include "ImathPlane.h"
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_group.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include <unistd.h>
 
 
 IE_CORE_DEFINERUNTIMETYPED( AtomsGaffer::AtomsCrowdReader );
@@ -80,119 +117,562 @@ using namespace Gaffer;
 using namespace GafferScene;
 using namespace AtomsGaffer;
 
-class AtomsCrowdReader::EngineData : public Data
+namespace
 {
 
-public :
+// The region used to cull the agents before their poses are loaded. It is stored as a convex
+// set of planes in the space of the cache, with the normals pointing inside the region.
+struct CullRegion
+{
+    std::vector<Imath::Plane3d> planes;
+    double padding = 0.0;
 
-    EngineData( const std::string& filePath, float frame, const std::string& agentIdsStr ):
-            m_filePath( filePath ),
-            m_frame( frame ),
-            m_memorySize( 0 )
+    bool enabled() const
     {
-        m_frame = frame;
+        return !planes.empty();
+    }
+
+    // An agent is culled when its bounding box is completely outside one of the planes
+    bool intersects( const Imath::Box3d& box ) const
+    {
+        if ( box.isEmpty() )
+        {
+            return true;
+        }
+
+        for ( const auto& plane : planes )
+        {
+            // The corner of the box furthest along the plane normal
+            const Imath::V3d corner(
+                plane.normal.x >= 0.0 ? box.max.x : box.min.x,
+                plane.normal.y >= 0.0 ? box.max.y : box.min.y,
+                plane.normal.z >= 0.0 ? box.max.z : box.min.z
+            );
+            if ( plane.distanceTo( corner ) < -padding )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void hash( MurmurHash &h ) const
+    {
+        for ( const auto& plane : planes )
+        {
+            h.append( plane.normal );
+            h.append( plane.distance );
+        }
+        h.append( padding );
+    }
+};
+
+// Planes bounding a box
+void boxPlanes( const Imath::Box3d& box, std::vector<Imath::Plane3d>& planes )
+{
+    planes.push_back( Imath::Plane3d( Imath::V3d( 1, 0, 0 ), box.min.x ) );
+    planes.push_back( Imath::Plane3d( Imath::V3d( -1, 0, 0 ), -box.max.x ) );
+    planes.push_back( Imath::Plane3d( Imath::V3d( 0, 1, 0 ), box.min.y ) );
+    planes.push_back( Imath::Plane3d( Imath::V3d( 0, -1, 0 ), -box.max.y ) );
+    planes.push_back( Imath::Plane3d( Imath::V3d( 0, 0, 1 ), box.min.z ) );
+    planes.push_back( Imath::Plane3d( Imath::V3d( 0, 0, -1 ), -box.max.z ) );
+}
+
+// Planes bounding the frustum of a camera, in camera space
+void cameraPlanes( const IECoreScene::Camera* camera, std::vector<Imath::Plane3d>& planes )
+{
+    const Imath::Box2f frustum = camera->frustum();
+    const Imath::V2f clippingPlanes = camera->getClippingPlanes();
+    if ( camera->getProjection() == "perspective" )
+    {
+        // The frustum is the screen window at distance 1, looking down -z
+        planes.push_back( Imath::Plane3d( Imath::V3d( 1, 0, frustum.min.x ).normalized(), 0.0 ) );
+        planes.push_back( Imath::Plane3d( Imath::V3d( -1, 0, -frustum.max.x ).normalized(), 0.0 ) );
+        planes.push_back( Imath::Plane3d( Imath::V3d( 0, 1, frustum.min.y ).normalized(), 0.0 ) );
+        planes.push_back( Imath::Plane3d( Imath::V3d( 0, -1, -frustum.max.y ).normalized(), 0.0 ) );
+    }
+    else
+    {
+        planes.push_back( Imath::Plane3d( Imath::V3d( 1, 0, 0 ), frustum.min.x ) );
+        planes.push_back( Imath::Plane3d( Imath::V3d( -1, 0, 0 ), -frustum.max.x ) );
+        planes.push_back( Imath::Plane3d( Imath::V3d( 0, 1, 0 ), frustum.min.y ) );
+        planes.push_back( Imath::Plane3d( Imath::V3d( 0, -1, 0 ), -frustum.max.y ) );
+    }
+    planes.push_back( Imath::Plane3d( Imath::V3d( 0, 0, -1 ), clippingPlanes[0] ) );
+    planes.push_back( Imath::Plane3d( Imath::V3d( 0, 0, 1 ), -clippingPlanes[1] ) );
+}
+
+// The plug values used to build an engine. They are read on the compute thread,
+// so the engine can also be built by the prefetch tasks.
+struct EngineParameters
+{
+    // The caches to load, with the offset added to the ids of their agents
+    std::vector<std::string> filePaths;
+    std::vector<int> agentIdOffsets;
+    int refreshCount;
+    std::string agentIds;
+    float previewFraction;
+    CullRegion cullRegion;
+    // The directory the engines are saved in, it doesn't change the engine so it isn't hashed
+    std::string diskCachePath;
+    // The frames stored in memory for each cache, empty when the playback cache is off
+    std::vector<ConstAtomsPlaybackCachePtr> playbackCaches;
+
+    void hash( MurmurHash &h ) const
+    {
+        for ( size_t i = 0; i < filePaths.size(); ++i )
+        {
+            h.append( filePaths[i] );
+            h.append( agentIdOffsets[i] );
+        }
+        // The playback caches don't store all the metadata, so their engines differ
+        for ( const auto& playbackCache : playbackCaches )
+        {
+            h.append( playbackCache ? playbackCache->startFrame() : 0 );
+            h.append( playbackCache ? playbackCache->endFrame() : -1 );
+        }
+        h.append( refreshCount );
+        h.append( agentIds );
+        h.append( previewFraction );
+        cullRegion.hash( h );
+    }
+};
+
+// Returns the non empty cache files of the reader, the main file first, with their agent id offsets.
+// The offsets missing from the agentIdOffsets plug are zero.
+void cacheFiles( const AtomsCrowdReader* reader, std::vector<std::string>& filePaths, std::vector<int>& agentIdOffsets )
+{
+    const std::string filePath = reader->atomsSimFilePlug()->getValue();
+    if ( !filePath.empty() )
+    {
+        filePaths.push_back( filePath );
+        agentIdOffsets.push_back( 0 );
+    }
+
+    ConstStringVectorDataPtr filePathsData = reader->atomsSimFilesPlug()->getValue();
+    ConstIntVectorDataPtr agentIdOffsetsData = reader->agentIdOffsetsPlug()->getValue();
+    const auto& extraFilePaths = filePathsData->readable();
+    const auto& extraOffsets = agentIdOffsetsData->readable();
+    for ( size_t i = 0; i < extraFilePaths.size(); ++i )
+    {
+        if ( extraFilePaths[i].empty() )
+        {
+            continue;
+        }
+        filePaths.push_back( extraFilePaths[i] );
+        agentIdOffsets.push_back( i < extraOffsets.size() ? extraOffsets[i] : 0 );
+    }
+}
+
+// Builds the cull region from the plugs of the reader. The region is given in world space,
+// so it is moved in the space of the cache with the transform of the reader.
+CullRegion cullRegion( const AtomsCrowdReader* reader )
+{
+    CullRegion result;
+    const int cullMode = reader->cullModePlug()->getValue();
+    if ( cullMode == AtomsCrowdReader::CullOff )
+    {
+        return result;
+    }
+
+    std::vector<Imath::Plane3d> planes;
+    Imath::M44d regionMatrix;
+    if ( cullMode == AtomsCrowdReader::CullBox )
+    {
+        const Imath::Box3f box = reader->cullBoxPlug()->getValue();
+        boxPlanes( Imath::Box3d( Imath::V3d( box.min ), Imath::V3d( box.max ) ), planes );
+    }
+    else
+    {
+        const std::string cameraPath = reader->cullCameraPlug()->getValue();
+        ScenePlug::ScenePath path;
+        ScenePlug::stringToPath( cameraPath, path );
+        if ( cameraPath.empty() || !reader->cullScenePlug()->getInput() || !reader->cullScenePlug()->exists( path ) )
+        {
+            IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Cull camera \"" + cameraPath + "\" not found, culling is disabled" );
+            return result;
+        }
+
+        IECoreScene::ConstCameraPtr camera = runTimeCast<const IECoreScene::Camera>( reader->cullScenePlug()->object( path ) );
+        if ( !camera )
+        {
+            IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Cull camera \"" + cameraPath + "\" is not a camera, culling is disabled" );
+            return result;
+        }
+
+        cameraPlanes( camera.get(), planes );
+        regionMatrix = Imath::M44d( reader->cullScenePlug()->fullTransform( path ) );
+    }
+
+    const Imath::M44d regionToCache = regionMatrix * Imath::M44d( reader->transformPlug()->matrix() ).inverse();
+    for ( const auto& plane : planes )
+    {
+        result.planes.push_back( plane * regionToCache );
+    }
+    result.padding = reader->cullPaddingPlug()->getValue();
+    return result;
+}
+
+// The engine loads the cache frame before the given frame, and the next one when the frame is fractional.
+// All the shutter samples between the same two cache frames hash the same, so they share a single engine.
+void hashEngineFrame( float frame, MurmurHash& h )
+{
+    const float cacheFrame = std::floor( frame );
+    h.append( cacheFrame );
+    h.append( frame > cacheFrame );
+}
+
+// Hashes the fingerprints of the cache frames loaded by the engine of the frame, so the engines
+// are loaded again once the caches are written again
+void hashEngineFrameFiles( const std::vector<std::string>& filePaths, int refreshCount, float frame, MurmurHash& h )
+{
+    const float cacheFrame = std::floor( frame );
+    AtomsCachePool& pool = AtomsCachePool::instance();
+    for ( const std::string& filePath : filePaths )
+    {
+        std::string cachePath, cacheName;
+        AtomsCachePool::splitFilePath( filePath, cachePath, cacheName );
+        if ( cacheName.empty() )
+        {
+            continue;
+        }
+
+        h.append( pool.frameHash( cachePath, cacheName, refreshCount, cacheFrame ) );
+        if ( frame > cacheFrame )
+        {
+            h.append( pool.frameHash( cachePath, cacheName, refreshCount, cacheFrame + 1 ) );
+        }
+    }
+}
+
+// The key of the engine of a frame, identifying the content of the cache frames it loads
+MurmurHash engineKey( const EngineParameters& parameters, float frame )
+{
+    MurmurHash h;
+    parameters.hash( h );
+    hashEngineFrame( frame, h );
+    hashEngineFrameFiles( parameters.filePaths, parameters.refreshCount, frame, h );
+    return h;
+}
+
+// The key of a prefetched frame. It doesn't hash the fingerprints of the frame files, so requesting the next
+// frames doesn't read their files on the compute thread. The prefetched engines are taken within a few frames,
+// and the refresh count is part of the key.
+MurmurHash prefetchKey( const EngineParameters& parameters, float frame )
+{
+    MurmurHash h;
+    parameters.hash( h );
+    hashEngineFrame( frame, h );
+    return h;
+}
+
+// Returns true if the agent is part of the preview subset. The agents are picked by a hash of their id,
+// so the same agents are kept on every frame and every machine, and the subset is spatially uniform.
+bool isPreviewAgent( int agentId, float previewFraction )
+{
+    MurmurHash h;
+    h.append( agentId );
+    // The 53 high bits of the hash give a uniform number in [0, 1)
+    return static_cast<double>( h.h1() >> 11 ) / static_cast<double>( uint64_t( 1 ) << 53 ) < previewFraction;
+}
+
+// The default memory budget of the frame cache in megabytes, set by the ATOMSGAFFER_FRAME_CACHE_MEMORY environment variable
+int defaultFrameCacheMemory()
+{
+    const char *value = std::getenv( "ATOMSGAFFER_FRAME_CACHE_MEMORY" );
+    return value ? std::max( 0, std::atoi( value ) ) : 0;
+}
+
+// The names of the agent metadata translated to the crowd data
+struct MetadataFilter
+{
+    StringAlgo::MatchPattern names = "*";
+    StringAlgo::MatchPattern excludeNames;
+
+    bool all() const
+    {
+        return names == "*" && excludeNames.empty();
+    }
+
+    bool matches( const std::string& name ) const
+    {
+        return StringAlgo::matchMultiple( name, names ) && !StringAlgo::matchMultiple( name, excludeNames );
+    }
+};
+
+MetadataFilter metadataFilter( const AtomsCrowdReader* reader )
+{
+    MetadataFilter result;
+    result.names = reader->metadataNamesPlug()->getValue();
+    result.excludeNames = reader->excludeMetadataNamesPlug()->getValue();
+    return result;
+}
+
+// Loads a frame of one of the caches of the reader
+class CacheEngine
+{
 
+public :
+
+    // The canceller is checked between the loading stages and between the agents, never while the
+    // cache is loading a file.
+    CacheEngine( const EngineParameters& parameters, size_t cacheIndex, float frame, const Canceller* canceller ):
+            m_cache( new Atoms::AtomsCache ),
+            m_filePath( parameters.filePaths[cacheIndex] ),
+            m_agentIdOffset( parameters.agentIdOffsets[cacheIndex] ),
+            m_cacheFrame( static_cast<int>( std::floor( frame ) ) ),
+            m_interpolated( false )
+    {
+        const std::string& filePath = m_filePath;
+        const std::string& agentIdsStr = parameters.agentIds;
         if ( filePath.empty() )
             return;
 
+        AtomsStatistics::ScopedTimer totalTimer( m_statistics, "total" );
+        m_statistics.addEvent( "engineLoads" );
+
         std::string cachePath, cacheName;
-        getAtomsCacheName( filePath, cachePath, cacheName, "atoms" );
+        AtomsCachePool::splitFilePath( filePath, cachePath, cacheName );
 
-        if( !m_cache.openCache( cachePath, cacheName ) )
+        // The engine owns a copy of the cache opened by the pool, so it loads its frames on its own
+        // while the header and the agent types are shared with the other engines
+        AtomsCachePool::CachePtr cache;
+        {
+            AtomsStatistics::ScopedTimer timer( m_statistics, "openCache" );
+            cache = AtomsCachePool::instance().open( cachePath, cacheName, parameters.refreshCount );
+        }
+        if( !cache )
         {
             IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
             return;
         }
+        m_cache = cache;
+        Atoms::AtomsCache& atomsCache = *m_cache;
+        Canceller::check( canceller );
 
         // Clamp the frame
-        m_frame = m_frame < m_cache.startFrame() ? m_cache.startFrame() : m_frame;
-        m_frame = m_frame > m_cache.endFrame() ? m_cache.endFrame() : m_frame;
+        double clampedFrame = frame < atomsCache.startFrame() ? atomsCache.startFrame() : frame;
+        clampedFrame = clampedFrame > atomsCache.endFrame() ? atomsCache.endFrame() : clampedFrame;
 
-        int cacheFrame = static_cast<int>( m_frame );
-        double frameReminder = m_frame - cacheFrame;
+        const int cacheFrame = static_cast<int>( std::floor( clampedFrame ) );
+        m_cacheFrame = cacheFrame;
+        m_interpolated = clampedFrame - cacheFrame > 0.0;
 
-        // Load the frame haeder that contains the agent ids
-        m_cache.loadFrameHeader( cacheFrame );
+        // The frames stored in the playback cache are decoded from memory, without reading the frame files at all
+        const AtomsPlaybackCache* playbackCache = cacheIndex < parameters.playbackCaches.size() ? parameters.playbackCaches[cacheIndex].get() : nullptr;
+        if ( playbackCache && !m_interpolated && playbackCache->hasFrame( cacheFrame ) )
+        {
+            m_playbackCache = playbackCache;
+            m_statistics.addEvent( "playbackLoads" );
+        }
+        else
+        {
+            // Load the frame haeder that contains the agent ids
+            AtomsStatistics::ScopedTimer timer( m_statistics, "loadFrameHeader" );
+            atomsCache.loadFrameHeader( cacheFrame );
+        }
 
-        // filter agents
+        // Filter the agent ids based on the input expression. The expression uses the ids of the
+        // merged crowd, so the offset of the cache is applied first.
+        const std::vector<int> allAgentIds = m_playbackCache ? m_playbackCache->agentIds( cacheFrame ) : atomsCache.agentIds( cacheFrame );
+        std::vector<int> cacheAgentIds = allAgentIds;
+        std::sort( cacheAgentIds.begin(), cacheAgentIds.end() );
+        for ( int& agentId : cacheAgentIds )
+        {
+            agentId += m_agentIdOffset;
+        }
         std::vector<int> agentsIds;
-        // Filter the agnet id based on the input expression
-        parseVisibleAgents( agentsIds, AtomsUtils::eraseFromString( agentIdsStr, ' ' ) );
-        if ( !agentsIds.empty() ) {
-            m_cache.setAgentsToLoad( agentsIds );
+        AtomsAgentFilter::get( agentIdsStr )->filter( cacheAgentIds, agentsIds );
+        for ( int& agentId : agentsIds )
+        {
+            agentId -= m_agentIdOffset;
+        }
+        // A single cache loads all its agents when none matches the filter. With several caches,
+        // only the caches having matching agents load them.
+        if ( !agentsIds.empty() || parameters.filePaths.size() > 1 ) {
             m_agentIds = agentsIds;
         }
         else
         {
-            m_agentIds = m_cache.agentIds( cacheFrame );
-        }
-
-        // Load the pose and metadata
-        m_cache.loadFrame( cacheFrame );
-        if ( frameReminder > 0.0 )
-            m_cache.loadNextFrame( cacheFrame + 1 );
-
-        // Load the agent types in memory
-        for( size_t i = 0; i < m_agentIds.size(); ++i )
-        {
-            int agentId = m_agentIds[i];
-            // load in memory the agent type since you need the skeleton to extract the world matrices from the pose
-            const std::string &agentTypeName = m_cache.agentType( m_frame, agentId );
-            m_cache.loadAgentType( agentTypeName, false );
-        }
-
-        if ( m_cache.prevFrameData().frame )
-            m_memorySize += m_cache.prevFrameData().frame->memSize();
-        if ( m_cache.prevFrameData().header )
-            m_memorySize += m_cache.prevFrameData().header->memSize();
-        if ( m_cache.prevFrameData().metadata )
-            m_memorySize += m_cache.prevFrameData().metadata->memSize();
-        if ( m_cache.prevFrameData().pose )
-            m_memorySize += m_cache.prevFrameData().pose->memSize();
-
-        if ( m_cache.frameData().frame )
-            m_memorySize +=  m_cache.frameData().frame->memSize();
-        if ( m_cache.frameData().header )
-            m_memorySize += m_cache.frameData().header->memSize();
-        if ( m_cache.frameData().metadata )
-            m_memorySize +=  m_cache.frameData().metadata->memSize();
-        if ( m_cache.frameData().pose )
-            m_memorySize +=  m_cache.frameData().pose->memSize();
-
-        if ( m_cache.nextFrameData().frame )
-            m_memorySize +=  m_cache.nextFrameData().frame->memSize();
-        if ( m_cache.nextFrameData().header )
-            m_memorySize += m_cache.nextFrameData().header->memSize();
-        if ( m_cache.nextFrameData().metadata )
-            m_memorySize +=  m_cache.nextFrameData().metadata->memSize();
-        if ( m_cache.nextFrameData().pose )
-            m_memorySize += m_cache.nextFrameData().pose->memSize();
-
-        auto& agentTypes = m_cache.agentTypes();
+            m_agentIds = allAgentIds;
+        }
+
+        // Keep the preview subset of the agents, before anything else is loaded for them
+        if ( parameters.previewFraction < 1.0f )
+        {
+            const size_t numAgents = m_agentIds.size();
+            m_agentIds.erase(
+                std::remove_if(
+                    m_agentIds.begin(), m_agentIds.end(),
+                    [this, &parameters]( int agentId ) { return !isPreviewAgent( agentId + m_agentIdOffset, parameters.previewFraction ); }
+                ),
+                m_agentIds.end()
+            );
+            m_statistics.setCount( "previewSkippedAgents", numAgents - m_agentIds.size() );
+        }
+
+        // Cull the agents using the bounding boxes stored in the frame header, so the poses
+        // and the metadata of the culled agents are never loaded. The atoms cache isn't safe to
+        // read from several threads, so only the bounds of the playback cache are tested in parallel.
+        if ( parameters.cullRegion.enabled() )
+        {
+            AtomsStatistics::ScopedTimer timer( m_statistics, "cull" );
+            std::vector<char> visible( m_agentIds.size(), 0 );
+            if ( m_playbackCache )
+            {
+                tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+                tbb::parallel_for( tbb::blocked_range<size_t>( 0, m_agentIds.size() ), [&]( const tbb::blocked_range<size_t>& range )
+                {
+                    Canceller::check( canceller );
+                    for ( size_t i = range.begin(); i != range.end(); ++i )
+                    {
+                        AtomsCore::Box3 agentBox;
+                        m_playbackCache->agentBoundingBox( cacheFrame, m_agentIds[i], agentBox );
+                        Imath::Box3d bound;
+                        convertFromAtoms( bound, agentBox );
+                        visible[i] = parameters.cullRegion.intersects( bound );
+                    }
+                }, taskGroupContext );
+            }
+            else
+            {
+                for ( size_t i = 0; i < m_agentIds.size(); ++i )
+                {
+                    Canceller::check( canceller );
+                    AtomsCore::Box3 agentBox;
+                    atomsCache.loadAgentBoundingBox( cacheFrame, m_agentIds[i], agentBox );
+                    Imath::Box3d bound;
+                    convertFromAtoms( bound, agentBox );
+                    visible[i] = parameters.cullRegion.intersects( bound );
+                }
+            }
+
+            std::vector<int> visibleAgentIds;
+            visibleAgentIds.reserve( m_agentIds.size() );
+            for ( size_t i = 0; i < m_agentIds.size(); ++i )
+            {
+                if ( visible[i] )
+                {
+                    visibleAgentIds.push_back( m_agentIds[i] );
+                }
+            }
+            m_statistics.setCount( "culledAgents", m_agentIds.size() - visibleAgentIds.size() );
+            m_agentIds.swap( visibleAgentIds );
+        }
+
+        atomsCache.setAgentsToLoad( m_agentIds );
+
+        // When only some of the agents are needed, read them from the index of the frame if it has one,
+        // so the frame files aren't read at all. The interpolated frames always load the frame files.
+        if ( !m_playbackCache && !m_interpolated && m_agentIds.size() < cacheAgentIds.size() )
+        {
+            AtomsStatistics::ScopedTimer timer( m_statistics, "openIndex" );
+            m_index = AtomsCacheIndex::open( cachePath, cacheName, cacheFrame );
+        }
+
+        // Load the pose and metadata. The next frame is loaded for the fractional frames only,
+        // so the samples in between can interpolate the poses without loading anything else.
+        if ( m_index )
+        {
+            m_statistics.addEvent( "indexedLoads" );
+        }
+        else if ( !m_playbackCache )
+        {
+            Canceller::check( canceller );
+            AtomsStatistics::ScopedTimer timer( m_statistics, "loadFrame" );
+            atomsCache.loadFrame( cacheFrame );
+            if ( m_interpolated )
+            {
+                Canceller::check( canceller );
+                atomsCache.loadNextFrame( cacheFrame + 1 );
+            }
+        }
+
+        // Load the agent types in memory, since the skeletons are needed to extract the world matrices from the poses.
+        // The type names of the agents are collected first, then the types are taken from the pool,
+        // which loads every type only once for all the engines of the cache.
+        {
+            AtomsStatistics::ScopedTimer timer( m_statistics, "loadAgentTypes" );
+            std::set<std::string> uniqueNames;
+            for( size_t i = 0; i < m_agentIds.size(); ++i )
+            {
+                Canceller::check( canceller );
+                uniqueNames.insert( agentType( cacheFrame, m_agentIds[i] ) );
+            }
+
+            Canceller::check( canceller );
+            const size_t loaded = AtomsCachePool::instance().loadAgentTypes(
+                cachePath, cacheName, parameters.refreshCount, atomsCache, std::vector<std::string>( uniqueNames.begin(), uniqueNames.end() )
+            );
+            m_statistics.addEvent( loaded ? "cachePoolMisses" : "cachePoolHits" );
+        }
+
+        size_t frameMemory = 0, headerMemory = 0, metadataMemory = 0, poseMemory = 0;
+        auto addFrameMemory = [&]( const auto& frameData )
+        {
+            if ( frameData.frame )
+                frameMemory += frameData.frame->memSize();
+            if ( frameData.header )
+                headerMemory += frameData.header->memSize();
+            if ( frameData.metadata )
+                metadataMemory += frameData.metadata->memSize();
+            if ( frameData.pose )
+                poseMemory += frameData.pose->memSize();
+        };
+        addFrameMemory( atomsCache.prevFrameData() );
+        addFrameMemory( atomsCache.frameData() );
+        addFrameMemory( atomsCache.nextFrameData() );
+
+        // The agent types and the playback cache are shared by the engines, so their memory is reported by the node
+        size_t bindPosesMemory = 0;
+        auto& agentTypes = atomsCache.agentTypes();
         for ( const auto& agentTypeName: agentTypes.agentTypeNames() )
         {
             auto agentType = agentTypes.agentType(agentTypeName);
             if ( !agentType )
                 continue;
 
-            m_memorySize += agentType->memSize();
+            // Convert the bind poses once per frame, so the palettes can be built with the batched kernel
+            AtomsPtr<const AtomsCore::MatrixArrayMetadata> bindPosesInvPtr = agentType->metadata().getTypedEntry<const AtomsCore::MatrixArrayMetadata>( "worldBindPoseInverseMatrices" );
+            if ( bindPosesInvPtr )
+            {
+                std::vector<Imath::M44d>& bindPoses = m_bindPosesInverse[agentTypeName];
+                convertFromAtoms( bindPoses, bindPosesInvPtr->get() );
+                bindPosesMemory += bindPoses.size() * sizeof( Imath::M44d );
+            }
         }
+
+        m_statistics.setMemory( "frame", frameMemory );
+        m_statistics.setMemory( "header", headerMemory );
+        m_statistics.setMemory( "metadata", metadataMemory );
+        m_statistics.setMemory( "pose", poseMemory );
+        m_statistics.setMemory( "bindPoses", bindPosesMemory );
+        m_statistics.setMemory( "index", m_index ? m_index->memorySize() : 0 );
+        m_statistics.setCount( "agents", m_agentIds.size() );
+        m_statistics.setCount( "agentTypes", m_bindPosesInverse.size() );
     }
 
-    virtual ~EngineData()
+    void hash( MurmurHash &h ) const
     {
+        h.append( m_filePath );
+        h.append( m_agentIdOffset );
+        h.append( m_cacheFrame );
+        h.append( m_interpolated );
+    }
 
+    int agentIdOffset() const
+    {
+        return m_agentIdOffset;
     }
 
-    void hash( MurmurHash &h ) const override
+    int cacheFrame() const
     {
-        h.append( m_filePath );
-        h.append( m_frame );
+        return m_cacheFrame;
     }
 
-    double frame() const
+    const AtomsStatistics& statistics() const
     {
-        return m_frame;
+        return m_statistics;
     }
 
     const std::vector<int>& agentIds() const
@@ -200,234 +680,1854 @@ public :
         return m_agentIds;
     }
 
-    const Atoms::AtomsCache& cache() const
+    // The pose and metadata of an agent as loaded from the cache, with its root matrix
+    struct DecodedAgent
     {
-        return m_cache;
-    }
-
-    void getAtomsCacheName( const std::string& filePath, std::string& cachePath, std::string& cacheName, const std::string& extension ) const
+        std::string agentTypeName;
+        AtomsPtr<AtomsCore::PoseMetadata> pose;
+        AtomsPtr<AtomsCore::MapMetadata> metadata;
+        bool hasRootMatrix;
+        AtomsCore::Matrix rootMatrix;
+    };
+
+    // The world matrices of all the joints of an agent, with the detached joints in root space
+    struct SolvedAgent
     {
-        size_t found = filePath.find_last_of( "/\\" );
-        std::string folderPath = filePath.substr( 0, found );
+        std::vector<AtomsCore::Matrix> worldMatrices;
+        uint64_t poseHash;
+    };
+
+    // The agents evaluated at a single frame. The motion blur samples between the loaded cache frames
+    // have their own agents, interpolated from the same frame data. The sample holds the agents
+    // from firstAgent to firstAgent + numAgents.
+    struct Sample
+    {
+        Sample( double sampleFrame, size_t sampleFirstAgent, size_t numAgents ) :
+            frame( sampleFrame ),
+            firstAgent( sampleFirstAgent ),
+            decodedAgents( numAgents ),
+            solvedAgents( numAgents ),
+            decodedOnce( new std::once_flag[numAgents] ),
+            solvedOnce( new std::once_flag[numAgents] )
+        {
+        }
 
-        cachePath = filePath;
-        std::string fullPath = cachePath;
-        fullPath = AtomsUtils::solvePath( fullPath );
-        std::replace( fullPath.begin(), fullPath.end(), '\\', '/' );
+        double frame;
+        size_t firstAgent;
+        mutable std::vector<DecodedAgent> decodedAgents;
+        mutable std::vector<SolvedAgent> solvedAgents;
+        std::unique_ptr<std::once_flag[]> decodedOnce;
+        std::unique_ptr<std::once_flag[]> solvedOnce;
+    };
+
+    typedef std::shared_ptr<const Sample> ConstSamplePtr;
+
+    // Returns the sample of all the agents at the given frame. The computes using the sample at the
+    // same time share it, and it is released once the last of them is done : the points and crowd
+    // built from it are held by Gaffer's cache, so the engine never holds the agents itself. The frame
+    // is clamped to the frames loaded by the engine.
+    ConstSamplePtr sample( double frame ) const
+    {
+        frame = sampleFrame( frame );
 
-        const size_t lastSlashIdx = fullPath.rfind( '/' );
-        if ( std::string::npos != lastSlashIdx )
+        std::lock_guard<std::mutex> lock( m_samplesMutex );
+        std::shared_ptr<Sample> result = m_samples[frame].lock();
+        if ( result )
         {
+            return result;
+        }
 
-            cacheName = fullPath.substr( lastSlashIdx + 1, fullPath.length() );
-            const size_t lastDotIdx = cacheName.rfind( '.' );
-            if ( !( std::string::npos == lastDotIdx || cacheName.substr( lastDotIdx + 1, cacheName.length() ) != extension ) )
-            {
-                const size_t firstDotIdx = cacheName.find( '.' );
-                cacheName = cacheName.substr( 0, firstDotIdx );
-                cachePath = fullPath.substr( 0, lastSlashIdx );
-            }
-            else
-            {
-                cacheName = "";
-            }
+        for ( auto it = m_samples.begin(); it != m_samples.end(); )
+        {
+            it = it->second.expired() ? m_samples.erase( it ) : std::next( it );
         }
+        result = std::make_shared<Sample>( frame, 0, m_agentIds.size() );
+        m_samples[frame] = result;
+        return result;
+    }
+
+    // Returns a sample of the single agent at the given index. It isn't shared, so the many computes of
+    // single agents don't allocate the agents of the whole cache.
+    ConstSamplePtr agentSample( double frame, size_t index ) const
+    {
+        return std::make_shared<Sample>( sampleFrame( frame ), index, 1 );
+    }
+
+    // The decoded and solved agents are built on first use and shared between computeSource and computeAttributes,
+    // so every agent is loaded and solved only once per sample.
+    const DecodedAgent& decodedAgent( const Sample& sample, size_t index ) const
+    {
+        std::call_once( sample.decodedOnce[index - sample.firstAgent], [this, &sample, index]() { decodeAgent( sample, index ); } );
+        return sample.decodedAgents[index - sample.firstAgent];
     }
 
-    void parseVisibleAgents( std::vector<int>& agentsFiltered, const std::string& agentIdsStr )
+    const SolvedAgent& solvedAgent( const Sample& sample, size_t index ) const
     {
-        // The input filter accept '-' to set a range of ids, and ! to exclude an id or a range of ids
-        std::vector<std::string> idsEntryStr;
-        AtomsUtils::splitString( agentIdsStr, ',', idsEntryStr );
-        std::vector<int> idsToRemove;
-        std::vector<int> idsToAdd;
+        std::call_once( sample.solvedOnce[index - sample.firstAgent], [this, &sample, index]() { solveAgent( sample, index ); } );
+        return sample.solvedAgents[index - sample.firstAgent];
+    }
 
-        std::vector<int> agentIds = m_cache.agentIds( m_cache.currentFrame() );
-        std::sort( agentIds.begin(), agentIds.end() );
-        for ( unsigned int eId = 0; eId < idsEntryStr.size(); eId++ )
+    // Stores the agent at the given index in the crowd at crowdIndex, with the metadata matching the filter
+    void fillCrowdData( const Sample& sample, size_t index, AtomsCrowdData& crowd, size_t crowdIndex, const MetadataFilter& filter ) const
+    {
+        const DecodedAgent& decoded = decodedAgent( sample, index );
+        const std::string &agentTypeName = decoded.agentTypeName;
+        auto agentTypePtr = m_cache->agentTypes().agentType( agentTypeName );
+        if ( !agentTypePtr )
         {
-            std::string currentStr = idsEntryStr[eId];
-            currentStr = AtomsUtils::eraseFromString( currentStr, ' ' );
-            if ( currentStr.empty() )
-            {
-                continue;
-            }
+            throw InvalidArgumentException( "AtomsCrowdReader: Invalid agent type " + agentTypeName );
+        }
 
-            std::vector<int>* currentIdArray = &idsToAdd;
-            // is a remove id
-            if (currentStr[0] == '!')
-            {
-                currentIdArray = &idsToRemove;
-                currentStr = currentStr.substr(1, currentStr.length());
-            }
+        auto bindPosesIt = m_bindPosesInverse.find( agentTypeName );
+        if ( bindPosesIt == m_bindPosesInverse.end() )
+        {
+            throw InvalidArgumentException( "AtomsCrowdReader : No worldBindPoseInverseMatrices metadata found on agent type: " +  agentTypeName );
+        }
 
-            //remove all the parenthesis
-            currentStr = AtomsUtils::eraseFromString( currentStr, '(' );
-            currentStr = AtomsUtils::eraseFromString( currentStr, ')' );
+        const std::vector<Imath::M44d>& bindPosesInv = bindPosesIt->second;
+        const SolvedAgent& solved = solvedAgent( sample, index );
+        const size_t numJoints = solved.worldMatrices.size();
+        if ( bindPosesInv.size() < numJoints )
+        {
+            throw InvalidArgumentException( "AtomsCrowdReader : Not enough worldBindPoseInverseMatrices found on agent type: " +  agentTypeName );
+        }
 
-            // is a range
-            if ( currentStr.find('-') != std::string::npos )
-            {
-                std::vector<std::string> rangeEntryStr;
-                AtomsUtils::splitString( currentStr, '-', rangeEntryStr );
+        Imath::Box3d& agentBBox = crowd.bounds()[crowdIndex];
 
-                int startRange = 0;
-                int endRange = 0;
-                if ( !rangeEntryStr.empty() )
-                {
-                    startRange = atoi( rangeEntryStr[0].c_str() );
+        // The skinning matrices are written in the crowd palette directly, or in a temporary
+        // buffer for a compact palette
+        std::vector<Imath::M44d> compactBuffer;
+        Imath::M44d* outMatrices = nullptr;
+        Imath::M44d* outNormalMatrices = nullptr;
+        if ( crowd.isCompact() )
+        {
+            compactBuffer.resize( numJoints );
+            outMatrices = compactBuffer.data();
+        }
+        else
+        {
+            outMatrices = crowd.worldMatrices( crowdIndex );
+            outNormalMatrices = crowd.normalMatrices( crowdIndex );
+        }
 
-                    if (rangeEntryStr.size() > 1)
-                    {
-                        endRange = atoi( rangeEntryStr[1].c_str() );
-                        if ( startRange < endRange )
-                        {
-                            for ( int rId = startRange; rId <= endRange; rId++ )
-                            {
-                                currentIdArray->push_back(rId);
-                            }
-                        }
-                    }
-                }
-            }
-            else
+        for ( unsigned int j = 0; j < numJoints; j++ )
+        {
+            convertFromAtoms( outMatrices[j], solved.worldMatrices[j] );
+            agentBBox.extendBy( outMatrices[j].translation() );
+        }
+
+        // Store the matrices for the skinning, bindPoseInverseMatrix * worldMatrix and its inverse transpose
+        AtomsPaletteKernel::skinningMatrices( bindPosesInv.data(), outMatrices, numJoints, outMatrices, outNormalMatrices );
+
+        if ( crowd.isCompact() )
+        {
+            float* compactMatrices = crowd.compactMatrices( crowdIndex );
+            for ( unsigned int j = 0; j < numJoints; j++ )
             {
-                int tmpId = atoi( currentStr.c_str() );
-                currentIdArray->push_back( tmpId );
+                AtomsCrowdData::compactMatrix( outMatrices[j], compactMatrices + j * 12 );
             }
         }
 
-        agentsFiltered.clear();
-        std::sort( idsToAdd.begin(), idsToAdd.end() );
-        std::sort( idsToRemove.begin(), idsToRemove.end() );
-        if ( !idsToAdd.empty() )
-        {
-            std::vector<int> validIds;
-            std::set_intersection(
-                    agentIds.begin(), agentIds.end(),
-                    idsToAdd.begin(), idsToAdd.end(),
-                    std::back_inserter( validIds )
-            );
+        convertFromAtoms( crowd.rootMatrices()[crowdIndex], decoded.rootMatrix );
 
+        // This is an hash of the agent pose in local space
+        crowd.poseHashes()[crowdIndex] = solved.poseHash;
 
-            std::set_difference(
-                    validIds.begin(), validIds.end(),
-                    idsToRemove.begin(), idsToRemove.end(),
-                    std::back_inserter( agentsFiltered )
-            );
+        // The entries that don't match the filter are skipped before being translated
+        const AtomsMetadataTranslator& translator = AtomsMetadataTranslator::instance();
+        if ( filter.all() )
+        {
+            crowd.metadata()[crowdIndex] = runTimeCast<CompoundData>( translator.translate( decoded.metadata ) );
         }
         else
         {
-            std::set_difference(
-                    agentIds.begin(), agentIds.end(),
-                    idsToRemove.begin(), idsToRemove.end(),
-                    std::back_inserter( agentsFiltered )
-            );
+            CompoundDataPtr metadata = new CompoundData;
+            for ( auto it = decoded.metadata->cbegin(); it != decoded.metadata->cend(); ++it )
+            {
+                if ( !it->second || !filter.matches( it->first ) )
+                    continue;
+
+                if ( DataPtr data = translator.translate( it->second ) )
+                    metadata->writable()[it->first] = data;
+            }
+            crowd.metadata()[crowdIndex] = metadata;
         }
+
+        crowd.agentTypes()[crowdIndex] = agentTypeName;
+    }
+
+private :
+
+    double sampleFrame( double frame ) const
+    {
+        const double lastFrame = m_interpolated ? m_cacheFrame + 1 : m_cacheFrame;
+        frame = frame < m_cacheFrame ? m_cacheFrame : frame;
+        return frame > lastFrame ? lastFrame : frame;
     }
 
-protected :
+    void decodeAgent( const Sample& sample, size_t index ) const
+    {
+        const Atoms::AtomsCache& atomsCache = *m_cache;
+        const int agentId = m_agentIds[index];
+        DecodedAgent& decoded = sample.decodedAgents[index - sample.firstAgent];
+
+        decoded.agentTypeName = agentType( sample.frame, agentId );
+
+        decoded.pose.reset( new AtomsCore::PoseMetadata );
+        decoded.metadata.reset( new AtomsCore::MapMetadata );
+        if ( m_playbackCache )
+        {
+            m_playbackCache->loadAgent( m_cacheFrame, agentId, *decoded.pose, *decoded.metadata );
+        }
+        else if ( m_index )
+        {
+            m_index->loadAgent( agentId, *decoded.pose, *decoded.metadata );
+        }
+        else
+        {
+            // Only the reads are serialised, the agents are still solved in parallel
+            std::lock_guard<std::mutex> lock( m_cacheMutex );
+            atomsCache.loadAgentPose( sample.frame, agentId, decoded.pose->get() );
+            atomsCache.loadAgentMetadata( sample.frame, agentId, *decoded.metadata.get() );
+        }
+
+        decoded.hasRootMatrix = false;
+        auto agentTypePtr = atomsCache.agentTypes().agentType( decoded.agentTypeName );
+        if ( agentTypePtr && decoded.pose->get().numJoints() > 0 )
+        {
+            // get the root world matrix
+            AtomsCore::Poser poser( &agentTypePtr->skeleton() );
+            decoded.rootMatrix = poser.getWorldMatrix( decoded.pose->get(), 0 );
+            decoded.hasRootMatrix = true;
+
+            //update the position metadata
+            auto positionMeta = decoded.metadata->getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_POSITION );
+            if ( positionMeta )
+            {
+                positionMeta->set( decoded.rootMatrix.translation() );
+            }
+        }
+    }
+
+    std::string agentType( double frame, int agentId ) const
+    {
+        if ( m_playbackCache )
+        {
+            return m_playbackCache->agentType( m_cacheFrame, agentId );
+        }
+
+        std::lock_guard<std::mutex> lock( m_cacheMutex );
+        return m_cache->agentType( frame, agentId );
+    }
+
+    void solveAgent( const Sample& sample, size_t index ) const
+    {
+        const DecodedAgent& decoded = decodedAgent( sample, index );
+        SolvedAgent& solved = sample.solvedAgents[index - sample.firstAgent];
+
+        auto agentTypePtr = m_cache->agentTypes().agentType( decoded.agentTypeName );
+        if ( !agentTypePtr )
+        {
+            throw InvalidArgumentException( "AtomsCrowdReader: Invalid agent type " + decoded.agentTypeName );
+        }
+
+        // The decoded pose is shared, so the detached joints are moved on a copy
+        AtomsCore::Pose pose = decoded.pose->get();
+        AtomsCore::Poser poser( &agentTypePtr->skeleton() );
+
+        // now for all the detached joint multiply transform in root local space
+        AtomsCore::Matrix rootInverseMatrix = decoded.rootMatrix.inverse();
+        const std::vector<unsigned short>& detachedJoints = agentTypePtr->skeleton().detachedJoints();
+        for ( unsigned int ii = 0; ii < detachedJoints.size(); ii++ )
+        {
+            poser.setWorldMatrix( pose, poser.getWorldMatrix( pose, detachedJoints[ii] ) * rootInverseMatrix, detachedJoints[ii] );
+        }
+
+        solved.worldMatrices = poser.getAllWorldMatrix( pose );
+        solved.poseHash = pose.hash();    }
+
+    // The atoms cache isn't safe to read from several threads, so once the engine is constructed every read
+    // of its frame data is made under m_cacheMutex : the agents are decoded from the parallel loops building
+    // the points and the crowd. The agent types and the frame range are only loaded by the constructor.
+    AtomsCachePool::CachePtr m_cache;
+    mutable std::mutex m_cacheMutex;
+
+    // The index of the frame, when the agents are read from it
+    ConstAtomsCacheIndexPtr m_index;
+
+    // The playback cache storing the frame, when the agents are decoded from it
+    ConstAtomsPlaybackCachePtr m_playbackCache;
+
+    std::string m_filePath;
+
+    int m_agentIdOffset;
+
+    std::vector<int> m_agentIds;
+
+    std::unordered_map<std::string, std::vector<Imath::M44d>> m_bindPosesInverse;
+
+    // The samples in use, keyed by their frame
+    mutable std::map<double, std::weak_ptr<Sample>> m_samples;
+    mutable std::mutex m_samplesMutex;
+
+    int m_cacheFrame;
+    bool m_interpolated;
+
+    AtomsStatistics m_statistics;
+};
+
+} // namespace
+
+// The engine of the reader, made of the engines of all its caches. The caches are loaded concurrently
+// and their agents are concatenated, with the agent id offset of their cache applied.
+// When the engine has a disk cache file, the sample of the frame it is computed for is baked when the engine
+// is created : its points and the crowd of all its agents are kept in the engine and the engine is saved in
+// the file, so the other processes reading the same frame load the baked sample instead of reading and
+// solving the caches. The baked samples never change once the engine has been created.
+class AtomsCrowdReader::EngineData : public Data
+{
+
+public :
+
+    IE_CORE_DECLAREEXTENSIONOBJECT( AtomsGaffer::AtomsCrowdReader::EngineData, AtomsGaffer::TypeId::AtomsCrowdReaderEngineDataTypeId, IECore::Data );
+
+    // Used by the object factory to load the saved engines, the caches are loaded only
+    // when a sample isn't baked. See setParameters.
+    EngineData():
+            m_frame( 0.0f ),
+            m_cachesLoaded( false ),
+            m_hasAgents( false ),
+            m_memorySize( 0 )
+    {
+    }
+
+    EngineData( const EngineParameters& parameters, float frame, const Canceller* canceller ):
+            m_parameters( parameters ),
+            m_frame( frame ),
+            m_key( engineKey( parameters, frame ) ),
+            m_cachesLoaded( false ),
+            m_hasAgents( false ),
+            m_memorySize( 0 )
+    {
+        caches( canceller );
+        m_memorySize = m_statistics.totalMemory();
+    }
+
+    virtual ~EngineData()
+    {
+
+    }
+
+    // Returns the engine saved in the disk cache of the parameters, or a new engine loading the caches
+    // when there isn't one. The new engine bakes the sample of the frame and is saved in the disk cache.
+    // Throws IECore::Cancelled if the canceller is cancelled while the caches are loaded.
+    static ConstObjectPtr create( const EngineParameters& parameters, float frame, const Canceller* canceller )
+    {
+        if ( parameters.diskCachePath.empty() )
+        {
+            return new EngineData( parameters, frame, canceller );
+        }
+
+        const MurmurHash key = diskCacheKey( parameters, frame );
+        const std::string diskCacheFile = parameters.diskCachePath + "/" + key.toString() + ".cob";
+
+        EngineDataPtr engine;
+        AtomsStatistics statistics;
+        if ( std::filesystem::exists( diskCacheFile ) )
+        {
+            try
+            {
+                AtomsStatistics::ScopedTimer timer( statistics, "loadDiskCache" );
+                engine = runTimeCast<EngineData>( Object::load( new FileIndexedIO( diskCacheFile, IndexedIO::rootPath, IndexedIO::Read ), g_engineEntry ) );
+            }
+            catch ( const std::exception& e )
+            {
+                IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Unable to load the engine cache " + diskCacheFile + " : " + e.what() );
+            }
+        }
+
+        if ( engine && engine->m_key == key )
+        {
+            engine->setParameters( parameters, frame );
+            engine->m_diskCacheFile = diskCacheFile;
+            statistics.addEvent( "diskCacheHits" );
+            statistics.setMemory( "diskCache", engine->m_memorySize );
+            statistics.setCount( "agents", engine->m_agentIds.size() );
+            statistics.setCount( "caches", parameters.filePaths.size() );
+            engine->m_statistics.merge( statistics );
+        }
+        else
+        {
+            engine = new EngineData( parameters, frame, canceller );
+            engine->m_key = key;
+            engine->m_diskCacheFile = diskCacheFile;
+            engine->m_statistics.merge( statistics );
+            engine->m_statistics.addEvent( "diskCacheMisses" );
+            engine->bake( frame, canceller );
+        }
+
+        return engine;
+    }
+
+    const AtomsStatistics& statistics() const
+    {
+        return m_statistics;
+    }
+
+    // The ids of the agents of all the caches, with the offsets of their caches
+    const std::vector<int>& agentIds() const
+    {
+        return m_agentIds;
+    }
+
+    // The points and the crowd of all the agents at a single frame
+    struct BakedSample
+    {
+        ConstPointsPrimitivePtr points;
+        ConstAtomsCrowdDataPtr crowd;
+    };
+
+    // The samples of all the caches at a single frame, or the baked sample of the frame
+    struct Sample
+    {
+        double frame;
+        const BakedSample *baked;
+        std::vector<CacheEngine::ConstSamplePtr> caches;
+    };
+
+    Sample sample( double frame, const Canceller* canceller ) const
+    {
+        Sample result;
+        result.frame = frame;
+        result.baked = bakedSample( frame );
+        if ( result.baked )
+        {
+            return result;
+        }
+
+        if ( !m_agentIds.empty() && m_parameters.filePaths.empty() )
+        {
+            throw IECore::Exception( "AtomsCrowdReader : The engine has no caches to evaluate the frame " + std::to_string( frame ) );
+        }
+
+        const auto& caches = this->caches( canceller );
+        result.caches.reserve( caches.size() );
+        for ( const auto& cache : caches )
+        {
+            result.caches.push_back( cache->sample( frame ) );
+        }
+        return result;
+    }
+
+    // Returns the sample of the single agent at the given index. Only the cache loading the agent has
+    // a sample, holding that agent alone.
+    Sample agentSample( double frame, size_t index, const Canceller* canceller ) const
+    {
+        Sample result;
+        result.frame = frame;
+        result.baked = bakedSample( frame );
+        if ( result.baked )
+        {
+            return result;
+        }
+
+        const auto& caches = this->caches( canceller );
+        size_t cacheAgentIndex = 0;
+        const size_t cache = cacheIndex( index, cacheAgentIndex );
+        result.caches.resize( caches.size() );
+        result.caches[cache] = caches[cache]->agentSample( frame, cacheAgentIndex );
+        return result;
+    }
+
+    // Returns the points of the agents, with their position, orientation and the metadata used
+    // to pick their variations
+    ConstPointsPrimitivePtr points( const Sample& sample, const Canceller* canceller ) const
+    {
+        if ( sample.baked )
+        {
+            return sample.baked->points;
+        }
+
+        return livePoints( sample, canceller );
+    }
+
+    // Returns the skinning matrices, root matrix, metadata and bounding box of the agents at the given indices.
+    // A compact crowd stores float affine skinning matrices only. Only the metadata matching the filter are stored.
+    AtomsCrowdDataPtr crowdData( const Sample& sample, const std::vector<size_t>& indices, bool compact, const MetadataFilter& filter, const Canceller* canceller ) const
+    {
+        if ( sample.baked )
+        {
+            return bakedCrowdData( *sample.baked->crowd, indices, compact, filter, canceller );
+        }
+
+        return liveCrowdData( sample, indices, compact, filter, canceller );
+    }
+
+    // Returns the index of the agent, or -1 if the agent isn't loaded
+    int agentIndex( int agentId ) const
+    {
+        auto it = m_agentIndices.find( agentId );
+        return it != m_agentIndices.end() ? static_cast<int>( it->second ) : -1;
+    }
+
+private :
+
+    // The key of an engine in the disk cache. The engine key hashes the fingerprints of the cache frames
+    // read by the engine, so the engines saved by another process are never used once the caches are written again.
+    static MurmurHash diskCacheKey( const EngineParameters& parameters, float frame )
+    {
+        MurmurHash h = engineKey( parameters, frame );
+        h.append( g_ioVersion );
+        return h;
+    }
+
+    // Sets the parameters used to load the caches of a saved engine, when it's asked a sample it hasn't baked
+    void setParameters( const EngineParameters& parameters, float frame )
+    {
+        m_parameters = parameters;
+        m_frame = frame;
+    }
+
+    // Returns the engines of the caches, loading them on first use. The threads asking for the caches while
+    // they are loaded help with the parallel loads rather than blocking. A cancelled load leaves the caches
+    // unloaded, so the next call loads them again.
+    const std::vector<std::unique_ptr<CacheEngine>>& caches( const Canceller* canceller ) const
+    {
+        if ( !m_cachesLoaded )
+        {
+            IECorePreview::TaskMutex::ScopedLock lock( m_cachesMutex );
+            if ( !m_cachesLoaded )
+            {
+                lock.execute( [this, canceller]() { loadCaches( canceller ); } );
+            }
+        }
+        return m_caches;
+    }
+
+    // The engines are only stored once all of them are loaded, so the engine stays empty if any of them throws
+    void loadCaches( const Canceller* canceller ) const
+    {
+        const size_t numCaches = m_parameters.filePaths.size();
+        std::vector<std::unique_ptr<CacheEngine>> caches( numCaches );
+
+        // Every cache is read from its own files, so the caches are loaded in parallel
+        tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, numCaches, 1 ), [&]( const tbb::blocked_range<size_t>& range )
+        {
+            for( size_t i = range.begin(); i != range.end(); ++i )
+            {
+                caches[i].reset( new CacheEngine( m_parameters, i, m_frame, canceller ) );
+            }
+        }, taskGroupContext );
+
+        std::vector<size_t> firstAgents;
+        std::vector<int> agentIds;
+        std::unordered_map<int, size_t> agentIndices;
+        AtomsStatistics statistics;
+        firstAgents.reserve( numCaches + 1 );
+        for( size_t i = 0; i < numCaches; ++i )
+        {
+            const CacheEngine& cache = *caches[i];
+            firstAgents.push_back( agentIds.size() );
+            for ( int cacheAgentId : cache.agentIds() )
+            {
+                const int agentId = cacheAgentId + cache.agentIdOffset();
+                if ( !agentIndices.emplace( agentId, agentIds.size() ).second )
+                {
+                    throw InvalidArgumentException(
+                        "AtomsCrowdReader : Agent id " + std::to_string( agentId ) + " of " + m_parameters.filePaths[i] +
+                        " is already used by another cache. Use the agentIdOffsets to separate the caches."
+                    );
+                }
+                agentIds.push_back( agentId );
+            }
+
+            // The memory and the agent counts of the caches add up
+            statistics.accumulate( cache.statistics() );
+        }
+        firstAgents.push_back( agentIds.size() );
+        statistics.setCount( "caches", numCaches );
+
+        // A saved engine already has its agents, they can't change without changing its key
+        if ( m_hasAgents && agentIds != m_agentIds )
+        {
+            throw IECore::Exception( "AtomsCrowdReader : The agents of " + m_diskCacheFile + " don't match its caches" );
+        }
+
+        m_caches.swap( caches );
+        m_firstAgents.swap( firstAgents );
+        if ( !m_hasAgents )
+        {
+            m_agentIds.swap( agentIds );
+            m_agentIndices.swap( agentIndices );
+            m_statistics.merge( statistics );
+            m_hasAgents = true;
+        }
+        // Set last, so the threads that skip the lock see the loaded caches and agents
+        m_cachesLoaded = true;
+    }
+
+    // Returns the cache loading the agent at the given index, and the index of the agent in that cache
+    size_t cacheIndex( size_t index, size_t& cacheAgentIndex ) const
+    {
+        // The empty caches share their first agent with the next cache, so take the last cache starting before the agent
+        const size_t result = std::upper_bound( m_firstAgents.begin(), m_firstAgents.end(), index ) - m_firstAgents.begin() - 1;
+        cacheAgentIndex = index - m_firstAgents[result];
+        return result;
+    }
+
+    const CacheEngine::DecodedAgent& decodedAgent( const Sample& sample, size_t index ) const
+    {
+        size_t cacheAgentIndex = 0;
+        const size_t cacheIndex = this->cacheIndex( index, cacheAgentIndex );
+        return m_caches[cacheIndex]->decodedAgent( *sample.caches[cacheIndex], cacheAgentIndex );
+    }
+
+    const BakedSample *bakedSample( double frame ) const
+    {
+        auto it = m_bakedSamples.find( frame );
+        return it != m_bakedSamples.end() ? &it->second : nullptr;
+    }
+
+    // Evaluates all the agents at the frame, stores them in the engine and saves the engine in its disk cache file.
+    // Only called by create(), before the engine is shared, so the baked samples are never modified afterwards.
+    void bake( double frame, const Canceller* canceller )
+    {
+        std::vector<size_t> indices( m_agentIds.size() );
+        std::iota( indices.begin(), indices.end(), 0 );
+
+        // A cancelled engine is never stored nor saved. All the metadata are baked, they are filtered when the crowd is sliced.
+        const Sample sample = this->sample( frame, canceller );
+        BakedSample baked;
+        baked.points = livePoints( sample, canceller );
+        // The agents are only read from the baked sample from now on, the sample is released on return
+        baked.crowd = liveCrowdData( sample, indices, false, MetadataFilter(), canceller );
+
+        const size_t bakedMemory = baked.points->Object::memoryUsage() + baked.crowd->Object::memoryUsage();
+        m_statistics.setMemory( "diskCache", bakedMemory );
+        m_memorySize += bakedMemory;
+        m_bakedSamples.emplace( frame, baked );
+
+        saveDiskCache();
+    }
+
+    void saveDiskCache() const
+    {
+        // Write a temporary file first, so the other processes never load a partial engine. The temporary
+        // file has a unique name, so the processes and hosts saving the same engine never write to the same file.
+        std::error_code errorCode;
+        std::string temporaryPath = m_diskCacheFile + ".XXXXXX";
+        try
+        {
+            std::filesystem::create_directories( std::filesystem::path( m_diskCacheFile ).parent_path() );
+            const int temporaryFile = ::mkstemp( &temporaryPath[0] );
+            if ( temporaryFile < 0 )
+            {
+                throw IOException( std::strerror( errno ) );
+            }
+            ::close( temporaryFile );
+
+            IndexedIOPtr io = new FileIndexedIO( temporaryPath, IndexedIO::rootPath, IndexedIO::Exclusive | IndexedIO::Write );
+            Object::save( io, g_engineEntry );
+        }
+        catch ( const std::exception& e )
+        {
+            IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Unable to save the engine cache " + m_diskCacheFile + " : " + e.what() );
+            std::filesystem::remove( temporaryPath, errorCode );
+            return;
+        }
+
+        // mkstemp creates the file readable by its owner only
+        std::filesystem::permissions(
+            temporaryPath,
+            std::filesystem::perms::owner_read | std::filesystem::perms::owner_write | std::filesystem::perms::group_read | std::filesystem::perms::others_read,
+            errorCode
+        );
+
+        std::filesystem::rename( temporaryPath, m_diskCacheFile, errorCode );
+        if ( errorCode )
+        {
+            IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", "Unable to save the engine cache " + m_diskCacheFile + " : " + errorCode.message() );
+            std::filesystem::remove( temporaryPath, errorCode );
+        }
+    }
+
+    ConstPointsPrimitivePtr livePoints( const Sample& sample, const Canceller* canceller ) const
+    {
+        // The points contain the agentId, agentType, variation, lod, velocity, direction, orientation and scale as
+        // primitive variables with the "atoms:" prefix. This data can be manipulated before the crowd generator
+        size_t numAgents = m_agentIds.size();
+
+        V3fVectorDataPtr positionData = new V3fVectorData;
+        positionData->setInterpretation( IECore::GeometricData::Interpretation::Point );
+        auto &positions = positionData->writable();
+        positions.resize( numAgents );
+
+        IntVectorDataPtr agentCacheIdsData = new IntVectorData;
+        agentCacheIdsData->writable() = m_agentIds;
+
+        StringVectorDataPtr agentCacheIdsStrData = new StringVectorData;
+        auto &agentCacheIdsStr = agentCacheIdsStrData->writable();
+        agentCacheIdsStr.resize( numAgents );
+
+        StringVectorDataPtr agentTypesData = new StringVectorData;
+        auto &agentTypes = agentTypesData->writable();
+        agentTypes.resize( numAgents );
+
+        StringVectorDataPtr agentVariationData = new StringVectorData;
+        auto &agentVariations = agentVariationData->writable();
+        agentVariations.resize( numAgents );
+
+        StringVectorDataPtr agentLodData = new StringVectorData;
+        auto &agentLods = agentLodData->writable();
+        agentLods.resize( numAgents );
+
+        V3fVectorDataPtr velocityData = new V3fVectorData;
+        auto &velocity = velocityData->writable();
+        velocity.resize( numAgents );
+
+        V3fVectorDataPtr directionData = new V3fVectorData;
+        auto &direction = directionData->writable();
+        direction.resize( numAgents );
+
+        V3fVectorDataPtr scaleData = new V3fVectorData;
+        auto &scale = scaleData->writable();
+        scale.resize( numAgents );
+
+        M44fVectorDataPtr rootMatrixData = new M44fVectorData;
+        auto &rootMatrix = rootMatrixData->writable();
+        rootMatrix.resize( numAgents );
+
+        QuatfVectorDataPtr orientationData = new QuatfVectorData;
+        auto &orientation = orientationData->writable();
+        orientation.resize( numAgents );
+
+        // The arrays are already sized, so every chunk of agents writes its points in place. The canceller is
+        // only checked between the agents, so a cancelled chunk never leaves an agent half decoded.
+        tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, numAgents ), [&]( const tbb::blocked_range<size_t>& range )
+        {
+            Canceller::check( canceller );
+            for( size_t i = range.begin(); i != range.end(); ++i )
+            {
+                int agentId = m_agentIds[i];
+                // \todo: In order to use the agentId for cryptomattes we need a string attribute,
+                // but we don't currently have a way of changing attribute data type in Gaffer.
+                // This is just a hack until that functionality exists. Remove when possible.
+                agentCacheIdsStr[i] = std::to_string( agentId );
+
+                // The decoded agent is shared with the crowd data, so it is loaded only once per frame
+                const auto& decoded = decodedAgent( sample, i );
+                agentTypes[i] = decoded.agentTypeName;
+                const AtomsCore::MapMetadata& metadata = *decoded.metadata;
+
+                auto variationMetadata = metadata.getTypedEntry<AtomsCore::StringMetadata>( ATOMS_AGENT_VARIATION );
+                agentVariations[i] = variationMetadata ? variationMetadata->get() : "";
+
+                auto lodMetadata = metadata.getTypedEntry<AtomsCore::StringMetadata>( ATOMS_AGENT_LOD );
+                agentLods[i] = lodMetadata ? lodMetadata->get(): "";
+
+                auto directionMetadata = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_DIRECTION );
+                if ( directionMetadata )
+                {
+                    auto& v = directionMetadata->get();
+                    auto& vOut = direction[i];
+                    vOut.x = v.x;
+                    vOut.y = v.y;
+                    vOut.z = v.z;
+                }
+
+
+                auto velocityMetadata = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_VELOCITY );
+                if ( velocityMetadata )
+                {
+                    auto& v = velocityMetadata->get();
+                    auto& vOut = velocity[i];
+                    vOut.x = v.x;
+                    vOut.y = v.y;
+                    vOut.z = v.z;
+                }
+
+                auto scaleMetadata = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_SCALE );
+                if ( scaleMetadata )
+                {
+                    auto& v = scaleMetadata->get();
+                    auto& vOut = scale[i];
+                    vOut.x = v.x;
+                    vOut.y = v.y;
+                    vOut.z = v.z;
+                }
+
+
+                if ( decoded.hasRootMatrix )
+                {
+                    const auto& pelvisMtx = decoded.rootMatrix;
+                    convertFromAtoms( positions[i], pelvisMtx.translation() );
+                    convertFromAtoms( rootMatrix[i], pelvisMtx );
+                    convertFromAtoms( orientation[i], AtomsMath::extractQuat( pelvisMtx ) );
+                }
+                else if ( decoded.pose->get().numJoints() > 0 )
+                {
+                    convertFromAtoms( positions[i], decoded.pose->get().jointPose( 0 ).translation );
+                }
+            }
+        }, taskGroupContext );
+
+        PointsPrimitivePtr points = new PointsPrimitive( positionData );
+        points->variables["atoms:agentType"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentTypesData );
+        points->variables["atoms:variation"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentVariationData );
+        points->variables["atoms:lod"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentLodData );
+        points->variables["atoms:agentId"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentCacheIdsData );
+        points->variables["atoms:agentIdStr"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentCacheIdsStrData );
+        points->variables["atoms:velocity"] = PrimitiveVariable( PrimitiveVariable::Vertex, velocityData );
+        points->variables["atoms:direction"] = PrimitiveVariable( PrimitiveVariable::Vertex, directionData );
+        points->variables["atoms:scale"] = PrimitiveVariable( PrimitiveVariable::Vertex, scaleData );
+        points->variables["atoms:orientation"] = PrimitiveVariable( PrimitiveVariable::Vertex, orientationData );
+        return points;
+    }
+
+    AtomsCrowdDataPtr liveCrowdData( const Sample& sample, const std::vector<size_t>& indices, bool compact, const MetadataFilter& filter, const Canceller* canceller ) const
+    {
+        // Solve all the agents first, so the palette of the whole crowd is allocated at once
+        std::vector<int> agentIds( indices.size() );
+        std::vector<size_t> numJoints( indices.size() );
+        std::vector<size_t> cacheIndices( indices.size() );
+        std::vector<size_t> cacheAgentIndices( indices.size() );
+        tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, indices.size() ), [&]( const tbb::blocked_range<size_t>& range )
+        {
+            Canceller::check( canceller );
+            for( size_t i = range.begin(); i != range.end(); ++i )
+            {
+                agentIds[i] = m_agentIds[indices[i]];
+                cacheIndices[i] = cacheIndex( indices[i], cacheAgentIndices[i] );
+                numJoints[i] = m_caches[cacheIndices[i]]->solvedAgent( *sample.caches[cacheIndices[i]], cacheAgentIndices[i] ).worldMatrices.size();
+            }
+        }, taskGroupContext );
+
+        AtomsCrowdDataPtr crowd = new AtomsCrowdData;
+        crowd->setAgents( agentIds, numJoints, compact );
+
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, indices.size() ), [&]( const tbb::blocked_range<size_t>& range )
+        {
+            Canceller::check( canceller );
+            for( size_t i = range.begin(); i != range.end(); ++i )
+            {
+                m_caches[cacheIndices[i]]->fillCrowdData( *sample.caches[cacheIndices[i]], cacheAgentIndices[i], *crowd, i, filter );
+            }
+        }, taskGroupContext );
+
+        return crowd;
+    }
+
+    // Copies the agents at the given indices from the crowd of a baked sample. The translated metadata are shared,
+    // or copied without the entries that don't match the filter.
+    static AtomsCrowdDataPtr bakedCrowdData( const AtomsCrowdData& baked, const std::vector<size_t>& indices, bool compact, const MetadataFilter& filter, const Canceller* canceller )
+    {
+        std::vector<int> agentIds( indices.size() );
+        std::vector<size_t> numJoints( indices.size() );
+        for ( size_t i = 0; i < indices.size(); ++i )
+        {
+            agentIds[i] = baked.agentIds()[indices[i]];
+            numJoints[i] = baked.numJoints( indices[i] );
+        }
+
+        AtomsCrowdDataPtr crowd = new AtomsCrowdData;
+        crowd->setAgents( agentIds, numJoints, compact );
+
+        tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, indices.size() ), [&]( const tbb::blocked_range<size_t>& range )
+        {
+            Canceller::check( canceller );
+            for( size_t i = range.begin(); i != range.end(); ++i )
+            {
+                const size_t index = indices[i];
+                const Imath::M44d* matrices = baked.worldMatrices( index );
+                if ( compact )
+                {
+                    float* compactMatrices = crowd->compactMatrices( i );
+                    for ( size_t j = 0; j < numJoints[i]; ++j )
+                    {
+                        AtomsCrowdData::compactMatrix( matrices[j], compactMatrices + j * 12 );
+                    }
+                }
+                else
+                {
+                    std::copy( matrices, matrices + numJoints[i], crowd->worldMatrices( i ) );
+                    std::copy( baked.normalMatrices( index ), baked.normalMatrices( index ) + numJoints[i], crowd->normalMatrices( i ) );
+                }
+
+                crowd->rootMatrices()[i] = baked.rootMatrices()[index];
+                crowd->bounds()[i] = baked.bounds()[index];
+                crowd->poseHashes()[i] = baked.poseHashes()[index];
+                crowd->agentTypes()[i] = baked.agentTypes()[index];
+                const ConstCompoundDataPtr& metadata = baked.metadata()[index];
+                if ( filter.all() || !metadata )
+                {
+                    crowd->metadata()[i] = metadata;
+                }
+                else
+                {
+                    CompoundDataPtr filtered = new CompoundData;
+                    for ( const auto& entry : metadata->readable() )
+                    {
+                        if ( filter.matches( entry.first.string() ) )
+                            filtered->writable()[entry.first] = entry.second;
+                    }
+                    crowd->metadata()[i] = filtered;
+                }
+            }
+        }, taskGroupContext );
+
+        return crowd;
+    }
+
+    static const IndexedIO::EntryID g_engineEntry;
+    static const unsigned int g_ioVersion;
+
+    // Used to load the caches of the samples that aren't baked
+    EngineParameters m_parameters;
+    float m_frame;
+
+    MurmurHash m_key;
+
+    // The file the engine is saved in when a sample is baked, empty when there is no disk cache
+    std::string m_diskCacheFile;
+
+    mutable std::vector<std::unique_ptr<CacheEngine>> m_caches;
+    mutable IECorePreview::TaskMutex m_cachesMutex;
+    mutable std::atomic<bool> m_cachesLoaded;
+
+    // The index of the first agent of every cache, followed by the number of agents
+    mutable std::vector<size_t> m_firstAgents;
+
+    mutable std::vector<int> m_agentIds;
+
+    mutable std::unordered_map<int, size_t> m_agentIndices;
+
+    mutable bool m_hasAgents;
+
+    // Only modified while the engine is created or loaded
+    std::map<double, BakedSample> m_bakedSamples;
+
+    mutable AtomsStatistics m_statistics;
+
+    size_t m_memorySize;
+};
+
+IE_CORE_DEFINEOBJECTTYPEDESCRIPTION( AtomsCrowdReader::EngineData );
+
+const IndexedIO::EntryID AtomsCrowdReader::EngineData::g_engineEntry( "engine" );
+const unsigned int AtomsCrowdReader::EngineData::g_ioVersion = 1;
+
+namespace
+{
+
+const IndexedIO::EntryID g_keyEntry( "key" );
+const IndexedIO::EntryID g_agentIdsEntry( "agentIds" );
+const IndexedIO::EntryID g_samplesEntry( "samples" );
+const IndexedIO::EntryID g_frameEntry( "frame" );
+const IndexedIO::EntryID g_pointsEntry( "points" );
+const IndexedIO::EntryID g_crowdEntry( "crowd" );
+
+} // namespace
+
+bool AtomsCrowdReader::EngineData::isEqualTo( const Object *other ) const
+{
+    if ( !Data::isEqualTo( other ) )
+    {
+        return false;
+    }
+
+    const EngineData *tOther = static_cast<const EngineData *>( other );
+    return m_key == tOther->m_key && m_agentIds == tOther->m_agentIds;
+}
+
+void AtomsCrowdReader::EngineData::hash( MurmurHash &h ) const
+{
+    Data::hash( h );
+    h.append( m_key );
+}
+
+void AtomsCrowdReader::EngineData::copyFrom( const Object *other, CopyContext *context )
+{
+    Data::copyFrom( other, context );
+    const EngineData *tOther = static_cast<const EngineData *>( other );
+
+    // The engines of the caches aren't copied, the copy loads its own caches if it needs a sample that isn't baked
+    m_parameters = tOther->m_parameters;
+    m_frame = tOther->m_frame;
+    m_key = tOther->m_key;
+    m_diskCacheFile = tOther->m_diskCacheFile;
+    m_agentIds = tOther->m_agentIds;
+    m_agentIndices = tOther->m_agentIndices;
+    m_hasAgents = tOther->m_hasAgents;
+    m_bakedSamples = tOther->m_bakedSamples;
+    m_statistics = tOther->m_statistics;
+    m_memorySize = tOther->m_memorySize;
+}
+
+void AtomsCrowdReader::EngineData::save( SaveContext *context ) const
+{
+    Data::save( context );
+    IndexedIOPtr container = context->container( staticTypeName(), g_ioVersion );
+
+    const uint64_t key[2] = { m_key.h1(), m_key.h2() };
+    container->write( g_keyEntry, key, 2 );
+    if ( !m_agentIds.empty() )
+    {
+        container->write( g_agentIdsEntry, m_agentIds.data(), m_agentIds.size() );
+    }
+
+    IndexedIOPtr samplesContainer = container->subdirectory( g_samplesEntry, IndexedIO::CreateIfMissing );
+    size_t i = 0;
+    for ( const auto& baked : m_bakedSamples )
+    {
+        IndexedIOPtr sampleContainer = samplesContainer->subdirectory( std::to_string( i++ ), IndexedIO::CreateIfMissing );
+        sampleContainer->write( g_frameEntry, baked.first );
+        context->save( baked.second.points.get(), sampleContainer.get(), g_pointsEntry );
+        context->save( baked.second.crowd.get(), sampleContainer.get(), g_crowdEntry );
+    }
+}
+
+void AtomsCrowdReader::EngineData::load( LoadContextPtr context )
+{
+    Data::load( context );
+    unsigned int v = g_ioVersion;
+    ConstIndexedIOPtr container = context->container( staticTypeName(), v );
+
+    uint64_t key[2] = { 0, 0 };
+    uint64_t *keyData = key;
+    container->read( g_keyEntry, keyData, 2 );
+    m_key = MurmurHash( key[0], key[1] );
+
+    m_agentIds.clear();
+    if ( container->hasEntry( g_agentIdsEntry ) )
+    {
+        m_agentIds.resize( container->entry( g_agentIdsEntry ).arrayLength() );
+        int *agentIds = m_agentIds.data();
+        container->read( g_agentIdsEntry, agentIds, m_agentIds.size() );
+    }
+    m_agentIndices.clear();
+    for ( size_t i = 0; i < m_agentIds.size(); ++i )
+    {
+        m_agentIndices[m_agentIds[i]] = i;
+    }
+    m_hasAgents = true;
+
+    m_bakedSamples.clear();
+    m_memorySize = 0;
+    ConstIndexedIOPtr samplesContainer = container->subdirectory( g_samplesEntry, IndexedIO::NullIfMissing );
+    if ( samplesContainer )
+    {
+        IndexedIO::EntryIDList names;
+        samplesContainer->entryIds( names, IndexedIO::Directory );
+        for ( const auto& name : names )
+        {
+            ConstIndexedIOPtr sampleContainer = samplesContainer->subdirectory( name );
+            double frame = 0.0;
+            sampleContainer->read( g_frameEntry, frame );
+
+            BakedSample baked;
+            baked.points = context->load<PointsPrimitive>( sampleContainer.get(), g_pointsEntry );
+            baked.crowd = context->load<AtomsCrowdData>( sampleContainer.get(), g_crowdEntry );
+            m_memorySize += baked.points->Object::memoryUsage() + baked.crowd->Object::memoryUsage();
+            m_bakedSamples[frame] = baked;
+        }
+    }
+}
+
+void AtomsCrowdReader::EngineData::memoryUsage( Object::MemoryAccumulator &accumulator ) const
+{
+    accumulator.accumulate( m_memorySize );
+}
+
+// The engines of the frames recently loaded by a reader. Gaffer's value cache evicts the large engines
+// under memory pressure, so scrubbing back to a frame would load it again. This cache keeps them up to its
+// own memory budget, evicting the least recently used engines first. Every engine owns the caches it opened,
+// so an engine kept here doesn't hold the data of any other engine, and the agent types shared through
+// AtomsCachePool are counted once by the node rather than by every engine.
+class AtomsCrowdReader::FrameCache
+{
+
+public :
+
+    FrameCache() : m_memory( 0 )
+    {
+    }
+
+    // Returns the engine stored for this key, or null if there isn't one
+    ConstObjectPtr get( const MurmurHash& key )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto it = m_entries.find( key );
+        if ( it == m_entries.end() )
+        {
+            return nullptr;
+        }
+
+        m_order.splice( m_order.begin(), m_order, it->second );
+        return it->second->engine;
+    }
+
+    // Stores the engine and evicts the least recently used engines until the cache fits in maxMemory.
+    // A zero budget empties the cache.
+    void set( const MurmurHash& key, const ConstObjectPtr& engine, size_t maxMemory )
+    {
+        if ( !maxMemory )
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_entries.clear();
+            m_order.clear();
+            m_memory = 0;
+            return;
+        }
+
+        // The memory usage of an engine doesn't change once it is built, so it is measured once
+        const size_t memory = engine->memoryUsage();
+
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( memory <= maxMemory && m_entries.find( key ) == m_entries.end() )
+        {
+            m_order.push_front( Entry{ key, engine, memory } );
+            m_entries[key] = m_order.begin();
+            m_memory += memory;
+        }
+
+        while ( m_memory > maxMemory )
+        {
+            const Entry& last = m_order.back();
+            m_memory -= last.memory;
+            m_entries.erase( last.key );
+            m_order.pop_back();
+        }
+    }
+
+    size_t memory() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_memory;
+    }
+
+private :
+
+    struct Entry
+    {
+        MurmurHash key;
+        ConstObjectPtr engine;
+        size_t memory;
+    };
+
+    mutable std::mutex m_mutex;
+
+    // The most recently used engine first
+    std::list<Entry> m_order;
+    std::map<MurmurHash, std::list<Entry>::iterator> m_entries;
+
+    size_t m_memory;
+
+};
+
+namespace
+{
+
+// The prefetch loads of every reader run in this arena, so they take a bounded number of threads
+// from the computes, however many readers are prefetching
+tbb::task_arena& prefetchArena()
+{
+    static tbb::task_arena arena( std::max( 1, static_cast<int>( std::thread::hardware_concurrency() ) / 4 ) );
+    return arena;
+}
+
+} // namespace
+
+// Loads the engines of the next frames of a reader as tasks in the prefetch arena while the current
+// frame is processed, one frame at a time. The loaded engines are kept in a bounded buffer until the
+// engine compute of their frame takes them. Every reader has its own prefetcher, so the readers never
+// drop each other's requests.
+class AtomsCrowdReader::FramePrefetcher
+{
+
+public :
+
+    // Loads the engine of a request, throwing IECore::Cancelled when the request is superseded
+    typedef std::function<ConstObjectPtr ( const Canceller* )> Loader;
+
+    struct Request
+    {
+        MurmurHash key;
+        Loader loader;
+    };
+
+    FramePrefetcher() : m_stop( false ), m_loading( false ), m_joining( 0 ), m_maxLoaded( 0 )
+    {
+    }
+
+    ~FramePrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stop = true;
+            m_pending.clear();
+            if ( m_loading )
+            {
+                m_loadingCanceller->cancel();
+            }
+        }
+        waitForLoad();
+    }
+
+    // Return the object loaded for this key and remove it from the buffer. If the object is still
+    // being loaded, the caller joins the load in the prefetch arena and takes its result, rather than
+    // loading the frame a second time. Returns null if the key isn't prefetched, or its load failed.
+    ConstObjectPtr take( const MurmurHash& key )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        ConstObjectPtr result = takeLoaded( key );
+        if ( result )
+        {
+            return result;
+        }
+
+        if ( !m_loading || m_loadingKey != key )
+        {
+            // The caller loads it on its own thread
+            m_pending.erase(
+                std::remove_if( m_pending.begin(), m_pending.end(), [&key]( const Request& request ) { return request.key == key; } ),
+                m_pending.end()
+            );
+            return nullptr;
+        }
+
+        // No other load is started while the load is joined, so waiting on the task group
+        // only waits for this load
+        ++m_joining;
+        while ( m_loading && m_loadingKey == key )
+        {
+            lock.unlock();
+            waitForLoad();
+            std::this_thread::yield();
+            lock.lock();
+        }
+        --m_joining;
+
+        result = takeLoaded( key );
+
+        // Resume the pending loads
+        Request next;
+        const Canceller* nextCanceller = nullptr;
+        const bool started = startLoad( next, nextCanceller );
+        lock.unlock();
+        if ( started )
+        {
+            run( next, nextCanceller );
+        }
+
+        return result;
+    }
+
+    // Replace the pending requests with the new ones, cancelling the load in progress if it isn't
+    // requested anymore. At most maxLoaded objects are kept in the buffer.
+    void prefetch( const std::vector<Request>& requests, size_t maxLoaded )
+    {
+        Request next;
+        const Canceller* nextCanceller = nullptr;
+        bool started = false;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_maxLoaded = maxLoaded;
+            m_pending.clear();
+            bool loadingRequested = false;
+            for ( const auto& request : requests )
+            {
+                if ( m_loading && m_loadingKey == request.key )
+                {
+                    loadingRequested = true;
+                    continue;
+                }
+                if ( isLoaded( request.key ) )
+                {
+                    continue;
+                }
+                m_pending.push_back( request );
+            }
+
+            if ( m_loading && !loadingRequested )
+            {
+                m_loadingCanceller->cancel();
+            }
+
+            started = startLoad( next, nextCanceller );
+        }
+
+        if ( started )
+        {
+            run( next, nextCanceller );
+        }
+    }
+
+private :
+
+    bool isLoaded( const MurmurHash& key ) const
+    {
+        for ( const auto& loaded : m_loaded )
+        {
+            if ( loaded.first == key )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Must be called with the mutex locked
+    ConstObjectPtr takeLoaded( const MurmurHash& key )
+    {
+        for ( auto it = m_loaded.begin(); it != m_loaded.end(); ++it )
+        {
+            if ( it->first == key )
+            {
+                ConstObjectPtr result = it->second;
+                m_loaded.erase( it );
+                return result;
+            }
+        }
+        return nullptr;
+    }
+
+    // Pops the next pending request, returning true if it must be run. Must be called with the mutex
+    // locked, and the request run once it is unlocked.
+    bool startLoad( Request& request, const Canceller*& canceller )
+    {
+        if ( m_stop || m_loading || m_joining || m_pending.empty() )
+        {
+            return false;
+        }
+
+        request = m_pending.front();
+        m_pending.pop_front();
+        m_loading = true;
+        m_loadingKey = request.key;
+        m_loadingCanceller.reset( new Canceller );
+        canceller = m_loadingCanceller.get();
+        return true;
+    }
+
+    void run( const Request& request, const Canceller* canceller )
+    {
+        prefetchArena().execute( [this, request, canceller]() {
+            m_loads.run( [this, request, canceller]() { load( request, canceller ); } );
+        } );
+    }
+
+    // Waits for the load in progress, helping with its work in the prefetch arena
+    void waitForLoad()
+    {
+        prefetchArena().execute( [this]() { m_loads.wait(); } );
+    }
+
+    void load( const Request& request, const Canceller* canceller )
+    {
+        ConstObjectPtr object;
+        try
+        {
+            object = request.loader( canceller );
+        }
+        catch ( const Cancelled& )
+        {
+            // Superseded by a newer request
+        }
+        catch ( const std::exception& e )
+        {
+            IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", std::string( "Unable to prefetch frame : " ) + e.what() );
+        }
+
+        Request next;
+        const Canceller* nextCanceller = nullptr;
+        bool started = false;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_loading = false;
+            const bool cancelled = m_loadingCanceller->cancelled();
+            m_loadingCanceller.reset();
+            if ( object && !cancelled )
+            {
+                m_loaded.push_back( std::make_pair( request.key, object ) );
+                while ( m_loaded.size() > m_maxLoaded )
+                {
+                    m_loaded.pop_front();
+                }
+            }
+            started = startLoad( next, nextCanceller );
+        }
+
+        if ( started )
+        {
+            run( next, nextCanceller );
+        }
+    }
+
+    std::mutex m_mutex;
+    tbb::task_group m_loads;
+
+    bool m_stop;
+
+    std::deque<Request> m_pending;
+    std::deque<std::pair<MurmurHash, ConstObjectPtr>> m_loaded;
+
+    bool m_loading;
+    MurmurHash m_loadingKey;
+    std::unique_ptr<Canceller> m_loadingCanceller;
+    // The number of callers joining the load in progress
+    int m_joining;
+    size_t m_maxLoaded;
+
+};
+
+// The playback caches of the files read by a reader, one per file and null for the files that aren't
+// atoms caches. Computed by the __playbackCache plug, so the range is loaded once and shared by the
+// engines of every frame through the Gaffer cache. The playback caches never change once loaded, so
+// the copies share them. Only the files and the range of the caches are saved, they are loaded again
+// from the files when the data is loaded.
+class AtomsCrowdReader::PlaybackCacheData : public Data
+{
+
+public :
+
+    IE_CORE_DECLAREEXTENSIONOBJECT( AtomsGaffer::AtomsCrowdReader::PlaybackCacheData, AtomsGaffer::TypeId::AtomsCrowdReaderPlaybackCacheDataTypeId, IECore::Data );
+
+    PlaybackCacheData(): m_memory( 0 )
+    {
+    }
+
+    const std::vector<ConstAtomsPlaybackCachePtr>& playbackCaches() const
+    {
+        return m_playbackCaches;
+    }
+
+    // Adds the playback cache loaded from the range of the cache, or null if the file isn't an atoms cache
+    // or the range couldn't be loaded
+    void addPlaybackCache( const std::string& cachePath, const std::string& cacheName, const Imath::V2i& range, const ConstAtomsPlaybackCachePtr& playbackCache )
+    {
+        m_sources.push_back( Source{ cachePath, cacheName, range } );
+        m_playbackCaches.push_back( playbackCache );
+        m_memory += playbackCache ? playbackCache->memorySize() : 0;
+    }
+
+    size_t memorySize() const
+    {
+        return m_memory;
+    }
+
+private :
+
+    struct Source
+    {
+        std::string cachePath;
+        std::string cacheName;
+        Imath::V2i range;
+    };
+
+    static const unsigned int g_ioVersion;
+
+    std::vector<Source> m_sources;
+    std::vector<ConstAtomsPlaybackCachePtr> m_playbackCaches;
+
+    size_t m_memory;
+
+};
+
+IE_CORE_DEFINEOBJECTTYPEDESCRIPTION( AtomsCrowdReader::PlaybackCacheData );
+
+const unsigned int AtomsCrowdReader::PlaybackCacheData::g_ioVersion = 1;
+
+namespace
+{
+
+const IndexedIO::EntryID g_cachePathsEntry( "cachePaths" );
+const IndexedIO::EntryID g_cacheNamesEntry( "cacheNames" );
+const IndexedIO::EntryID g_rangesEntry( "ranges" );
+
+} // namespace
+
+bool AtomsCrowdReader::PlaybackCacheData::isEqualTo( const Object *other ) const
+{
+    if ( !Data::isEqualTo( other ) )
+    {
+        return false;
+    }
+
+    // The caches loaded separately are different, the files may have been written in between
+    const PlaybackCacheData *tOther = static_cast<const PlaybackCacheData *>( other );
+    return m_playbackCaches == tOther->m_playbackCaches;
+}
+
+void AtomsCrowdReader::PlaybackCacheData::hash( MurmurHash &h ) const
+{
+    Data::hash( h );
+    for ( const auto& playbackCache : m_playbackCaches )
+    {
+        h.append( reinterpret_cast<uint64_t>( playbackCache.get() ) );
+    }
+}
+
+void AtomsCrowdReader::PlaybackCacheData::copyFrom( const Object *other, CopyContext *context )
+{
+    Data::copyFrom( other, context );
+    const PlaybackCacheData *tOther = static_cast<const PlaybackCacheData *>( other );
+    m_sources = tOther->m_sources;
+    m_playbackCaches = tOther->m_playbackCaches;
+    m_memory = tOther->m_memory;
+}
+
+void AtomsCrowdReader::PlaybackCacheData::save( SaveContext *context ) const
+{
+    Data::save( context );
+    IndexedIOPtr container = context->container( staticTypeName(), g_ioVersion );
+
+    std::vector<std::string> cachePaths, cacheNames;
+    std::vector<int> ranges;
+    for ( const Source& source : m_sources )
+    {
+        cachePaths.push_back( source.cachePath );
+        cacheNames.push_back( source.cacheName );
+        ranges.push_back( source.range.x );
+        ranges.push_back( source.range.y );
+    }
+
+    if ( !m_sources.empty() )
+    {
+        container->write( g_cachePathsEntry, cachePaths.data(), cachePaths.size() );
+        container->write( g_cacheNamesEntry, cacheNames.data(), cacheNames.size() );
+        container->write( g_rangesEntry, ranges.data(), ranges.size() );
+    }
+}
+
+void AtomsCrowdReader::PlaybackCacheData::load( LoadContextPtr context )
+{
+    Data::load( context );
+    unsigned int v = g_ioVersion;
+    ConstIndexedIOPtr container = context->container( staticTypeName(), v );
+
+    m_sources.clear();
+    m_playbackCaches.clear();
+    m_memory = 0;
+    if ( !container->hasEntry( g_cachePathsEntry ) )
+    {
+        return;
+    }
+
+    const size_t numSources = container->entry( g_cachePathsEntry ).arrayLength();
+    std::vector<std::string> cachePaths( numSources ), cacheNames( numSources );
+    std::vector<int> ranges( numSources * 2 );
+    std::string *cachePathsData = cachePaths.data();
+    std::string *cacheNamesData = cacheNames.data();
+    int *rangesData = ranges.data();
+    container->read( g_cachePathsEntry, cachePathsData, numSources );
+    container->read( g_cacheNamesEntry, cacheNamesData, numSources );
+    container->read( g_rangesEntry, rangesData, numSources * 2 );
+
+    for ( size_t i = 0; i < numSources; ++i )
+    {
+        const Imath::V2i range( ranges[i * 2], ranges[i * 2 + 1] );
+        ConstAtomsPlaybackCachePtr playbackCache;
+        if ( !cacheNames[i].empty() )
+        {
+            try
+            {
+                playbackCache = new AtomsPlaybackCache( cachePaths[i], cacheNames[i], range.x, range.y );
+            }
+            catch ( const std::exception& e )
+            {
+                IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", std::string( "Unable to load the playback cache : " ) + e.what() );
+            }
+        }
+        addPlaybackCache( cachePaths[i], cacheNames[i], range, playbackCache );
+    }
+}
+
+void AtomsCrowdReader::PlaybackCacheData::memoryUsage( Object::MemoryAccumulator &accumulator ) const
+{
+    Data::memoryUsage( accumulator );
+    accumulator.accumulate( m_memory );
+}
+
+size_t AtomsCrowdReader::g_firstPlugIndex = 0;
+
+const IECore::InternedString AtomsCrowdReader::agentIdContextName( "atoms:agentId" );
+
+AtomsCrowdReader::AtomsCrowdReader( const std::string &name )
+	:	ObjectSource( name, "crowd" ), m_frameCache( new FrameCache ), m_framePrefetcher( new FramePrefetcher )
+{
+	storeIndexOfNextChild( g_firstPlugIndex );
+
+	addChild( new StringPlug( "atomsSimFile" ) );
+    addChild( new StringPlug( "agentIds" ) );
+    addChild( new FloatPlug( "timeOffset" ) );
+	addChild( new IntPlug( "refreshCount" ) );
+    addChild( new IntPlug( "prefetchFrames", Plug::In, 0, 0 ) );
+    addChild( new BoolPlug( "compactPalette", Plug::In, false ) );
+    addChild( new IntPlug( "cullMode", Plug::In, CullOff, CullOff, CullCamera ) );
+    addChild( new Box3fPlug( "cullBox", Plug::In, Imath::Box3f( Imath::V3f( -1 ), Imath::V3f( 1 ) ) ) );
+    addChild( new ScenePlug( "cullScene" ) );
+    addChild( new StringPlug( "cullCamera" ) );
+    addChild( new FloatPlug( "cullPadding", Plug::In, 0.0f, 0.0f ) );
+    addChild( new StringVectorDataPlug( "atomsSimFiles", Plug::In, new StringVectorData ) );
+    addChild( new IntVectorDataPlug( "agentIdOffsets", Plug::In, new IntVectorData ) );
+    addChild( new StringPlug( "diskCachePath" ) );
+    addChild( new IntPlug( "frameCacheMemory", Plug::In, defaultFrameCacheMemory(), 0 ) );
+    addChild( new BoolPlug( "playbackCache", Plug::In, false ) );
+    addChild( new V2iPlug( "playbackRange", Plug::In, Imath::V2i( 1, 100 ) ) );
+    addChild( new FloatPlug( "previewFraction", Plug::In, 1.0f, 0.0f, 1.0f ) );
+    addChild( new StringPlug( "metadataNames", Plug::In, "*" ) );
+    addChild( new StringPlug( "excludeMetadataNames", Plug::In, "" ) );
+    addChild( new ObjectPlug( "__engine", Plug::Out, NullObject::defaultNullObject() ) );
+    addChild( new ObjectPlug( "__agentData", Plug::Out, NullObject::defaultNullObject() ) );
+    addChild( new ObjectPlug( "__playbackCache", Plug::Out, NullObject::defaultNullObject() ) );
+}
+
+AtomsCrowdReader::~AtomsCrowdReader()
+{
+}
+
+StringPlug* AtomsCrowdReader::atomsSimFilePlug()
+{
+	return getChild<StringPlug>( g_firstPlugIndex );
+}
+
+const StringPlug* AtomsCrowdReader::atomsSimFilePlug() const
+{
+	return getChild<StringPlug>( g_firstPlugIndex );
+}
+
+Gaffer::StringPlug *AtomsCrowdReader::agentIdsPlug()
+{
+return getChild<StringPlug>( g_firstPlugIndex + 1 );
+}
+
+const Gaffer::StringPlug *AtomsCrowdReader::agentIdsPlug() const
+{
+    return getChild<StringPlug>( g_firstPlugIndex  + 1 );
+}
+
+Gaffer::FloatPlug *AtomsCrowdReader::timeOffsetPlug()
+{
+    return getChild<FloatPlug>( g_firstPlugIndex  + 2 );
+}
+
+const Gaffer::FloatPlug *AtomsCrowdReader::timeOffsetPlug() const
+{
+    return getChild<FloatPlug>( g_firstPlugIndex  + 2 );
+}
+
+IntPlug* AtomsCrowdReader::refreshCountPlug()
+{
+	return getChild<IntPlug>( g_firstPlugIndex + 3 );
+}
+
+const IntPlug* AtomsCrowdReader::refreshCountPlug() const
+{
+	return getChild<IntPlug>( g_firstPlugIndex + 3 );
+}
+
+Gaffer::IntPlug *AtomsCrowdReader::prefetchFramesPlug()
+{
+    return getChild<IntPlug>( g_firstPlugIndex + 4 );
+}
+
+const Gaffer::IntPlug *AtomsCrowdReader::prefetchFramesPlug() const
+{
+    return getChild<IntPlug>( g_firstPlugIndex + 4 );
+}
+
+Gaffer::BoolPlug *AtomsCrowdReader::compactPalettePlug()
+{
+    return getChild<BoolPlug>( g_firstPlugIndex + 5 );
+}
+
+const Gaffer::BoolPlug *AtomsCrowdReader::compactPalettePlug() const
+{
+    return getChild<BoolPlug>( g_firstPlugIndex + 5 );
+}
+
+Gaffer::IntPlug *AtomsCrowdReader::cullModePlug()
+{
+    return getChild<IntPlug>( g_firstPlugIndex + 6 );
+}
+
+const Gaffer::IntPlug *AtomsCrowdReader::cullModePlug() const
+{
+    return getChild<IntPlug>( g_firstPlugIndex + 6 );
+}
+
+Gaffer::Box3fPlug *AtomsCrowdReader::cullBoxPlug()
+{
+    return getChild<Box3fPlug>( g_firstPlugIndex + 7 );
+}
+
+const Gaffer::Box3fPlug *AtomsCrowdReader::cullBoxPlug() const
+{
+    return getChild<Box3fPlug>( g_firstPlugIndex + 7 );
+}
+
+GafferScene::ScenePlug *AtomsCrowdReader::cullScenePlug()
+{
+    return getChild<ScenePlug>( g_firstPlugIndex + 8 );
+}
+
+const GafferScene::ScenePlug *AtomsCrowdReader::cullScenePlug() const
+{
+    return getChild<ScenePlug>( g_firstPlugIndex + 8 );
+}
+
+Gaffer::StringPlug *AtomsCrowdReader::cullCameraPlug()
+{
+    return getChild<StringPlug>( g_firstPlugIndex + 9 );
+}
+
+const Gaffer::StringPlug *AtomsCrowdReader::cullCameraPlug() const
+{
+    return getChild<StringPlug>( g_firstPlugIndex + 9 );
+}
+
+Gaffer::FloatPlug *AtomsCrowdReader::cullPaddingPlug()
+{
+    return getChild<FloatPlug>( g_firstPlugIndex + 10 );
+}
+
+const Gaffer::FloatPlug *AtomsCrowdReader::cullPaddingPlug() const
+{
+    return getChild<FloatPlug>( g_firstPlugIndex + 10 );
+}
 
-    void copyFrom( const Object *other, CopyContext *context ) override
-    {
-        Data::copyFrom( other, context );
-        msg( Msg::Warning, "EngineData::copyFrom", "Not implemented" );
-    }
+Gaffer::StringVectorDataPlug *AtomsCrowdReader::atomsSimFilesPlug()
+{
+    return getChild<StringVectorDataPlug>( g_firstPlugIndex + 11 );
+}
 
-    void save( SaveContext *context ) const override
-    {
-        Data::save( context );
-        msg( Msg::Warning, "EngineData::save", "Not implemented" );
-    }
+const Gaffer::StringVectorDataPlug *AtomsCrowdReader::atomsSimFilesPlug() const
+{
+    return getChild<StringVectorDataPlug>( g_firstPlugIndex + 11 );
+}
 
-    void load( LoadContextPtr context ) override
-    {
-        Data::load( context );
-        msg( Msg::Warning, "EngineData::load", "Not implemented" );
-    }
+Gaffer::IntVectorDataPlug *AtomsCrowdReader::agentIdOffsetsPlug()
+{
+    return getChild<IntVectorDataPlug>( g_firstPlugIndex + 12 );
+}
 
+const Gaffer::IntVectorDataPlug *AtomsCrowdReader::agentIdOffsetsPlug() const
+{
+    return getChild<IntVectorDataPlug>( g_firstPlugIndex + 12 );
+}
 
-    virtual void memoryUsage( Object::MemoryAccumulator &accumulator ) const
-    {
-        accumulator.accumulate( m_memorySize );
-    }
+Gaffer::StringPlug *AtomsCrowdReader::diskCachePathPlug()
+{
+    return getChild<StringPlug>( g_firstPlugIndex + 13 );
+}
 
+const Gaffer::StringPlug *AtomsCrowdReader::diskCachePathPlug() const
+{
+    return getChild<StringPlug>( g_firstPlugIndex + 13 );
+}
 
-private :
+Gaffer::IntPlug *AtomsCrowdReader::frameCacheMemoryPlug()
+{
+    return getChild<IntPlug>( g_firstPlugIndex + 14 );
+}
 
-    Atoms::AtomsCache m_cache;
+const Gaffer::IntPlug *AtomsCrowdReader::frameCacheMemoryPlug() const
+{
+    return getChild<IntPlug>( g_firstPlugIndex + 14 );
+}
 
-    std::string m_filePath;
+Gaffer::BoolPlug *AtomsCrowdReader::playbackCachePlug()
+{
+    return getChild<BoolPlug>( g_firstPlugIndex + 15 );
+}
 
-    std::vector<int> m_agentIds;
+const Gaffer::BoolPlug *AtomsCrowdReader::playbackCachePlug() const
+{
+    return getChild<BoolPlug>( g_firstPlugIndex + 15 );
+}
 
-    float m_frame;
+Gaffer::V2iPlug *AtomsCrowdReader::playbackRangePlug()
+{
+    return getChild<V2iPlug>( g_firstPlugIndex + 16 );
+}
 
-    size_t m_memorySize;
-};
+const Gaffer::V2iPlug *AtomsCrowdReader::playbackRangePlug() const
+{
+    return getChild<V2iPlug>( g_firstPlugIndex + 16 );
+}
 
-size_t AtomsCrowdReader::g_firstPlugIndex = 0;
+Gaffer::FloatPlug *AtomsCrowdReader::previewFractionPlug()
+{
+    return getChild<FloatPlug>( g_firstPlugIndex + 17 );
+}
 
-AtomsCrowdReader::AtomsCrowdReader( const std::string &name )
-	:	ObjectSource( name, "crowd" )
+const Gaffer::FloatPlug *AtomsCrowdReader::previewFractionPlug() const
 {
-	storeIndexOfNextChild( g_firstPlugIndex );
+    return getChild<FloatPlug>( g_firstPlugIndex + 17 );
+}
 
-	addChild( new StringPlug( "atomsSimFile" ) );
-    addChild( new StringPlug( "agentIds" ) );
-    addChild( new FloatPlug( "timeOffset" ) );
-	addChild( new IntPlug( "refreshCount" ) );
-    addChild( new ObjectPlug( "__engine", Plug::Out, NullObject::defaultNullObject() ) );
+Gaffer::StringPlug *AtomsCrowdReader::metadataNamesPlug()
+{
+    return getChild<StringPlug>( g_firstPlugIndex + 18 );
 }
 
-StringPlug* AtomsCrowdReader::atomsSimFilePlug()
+const Gaffer::StringPlug *AtomsCrowdReader::metadataNamesPlug() const
 {
-	return getChild<StringPlug>( g_firstPlugIndex );
+    return getChild<StringPlug>( g_firstPlugIndex + 18 );
 }
 
-const StringPlug* AtomsCrowdReader::atomsSimFilePlug() const
+Gaffer::StringPlug *AtomsCrowdReader::excludeMetadataNamesPlug()
 {
-	return getChild<StringPlug>( g_firstPlugIndex );
+    return getChild<StringPlug>( g_firstPlugIndex + 19 );
 }
 
-Gaffer::StringPlug *AtomsCrowdReader::agentIdsPlug()
+const Gaffer::StringPlug *AtomsCrowdReader::excludeMetadataNamesPlug() const
 {
-return getChild<StringPlug>( g_firstPlugIndex + 1 );
+    return getChild<StringPlug>( g_firstPlugIndex + 19 );
 }
 
-const Gaffer::StringPlug *AtomsCrowdReader::agentIdsPlug() const
+Gaffer::ObjectPlug *AtomsCrowdReader::enginePlug()
 {
-    return getChild<StringPlug>( g_firstPlugIndex  + 1 );
+    return getChild<ObjectPlug>( g_firstPlugIndex + 20 );
 }
 
-Gaffer::FloatPlug *AtomsCrowdReader::timeOffsetPlug()
+const Gaffer::ObjectPlug *AtomsCrowdReader::enginePlug() const
 {
-    return getChild<FloatPlug>( g_firstPlugIndex  + 2 );
+    return getChild<ObjectPlug>( g_firstPlugIndex + 20 );
 }
 
-const Gaffer::FloatPlug *AtomsCrowdReader::timeOffsetPlug() const
+Gaffer::ObjectPlug *AtomsCrowdReader::agentDataPlug()
 {
-    return getChild<FloatPlug>( g_firstPlugIndex  + 2 );
+    return getChild<ObjectPlug>( g_firstPlugIndex + 21 );
 }
 
-IntPlug* AtomsCrowdReader::refreshCountPlug()
+const Gaffer::ObjectPlug *AtomsCrowdReader::agentDataPlug() const
 {
-	return getChild<IntPlug>( g_firstPlugIndex + 3 );
+    return getChild<ObjectPlug>( g_firstPlugIndex + 21 );
 }
 
-const IntPlug* AtomsCrowdReader::refreshCountPlug() const
+Gaffer::ObjectPlug *AtomsCrowdReader::playbackCacheDataPlug()
 {
-	return getChild<IntPlug>( g_firstPlugIndex + 3 );
+    return getChild<ObjectPlug>( g_firstPlugIndex + 22 );
 }
 
-Gaffer::ObjectPlug *AtomsCrowdReader::enginePlug()
+const Gaffer::ObjectPlug *AtomsCrowdReader::playbackCacheDataPlug() const
 {
-    return getChild<ObjectPlug>( g_firstPlugIndex + 4 );
+    return getChild<ObjectPlug>( g_firstPlugIndex + 22 );
 }
 
-const Gaffer::ObjectPlug *AtomsCrowdReader::enginePlug() const
+IECore::CompoundDataPtr AtomsCrowdReader::statistics() const
+{
+    return m_statistics.data();
+}
+
+void AtomsCrowdReader::clearStatistics()
 {
-    return getChild<ObjectPlug>( g_firstPlugIndex + 4 );
+    m_statistics.clear();
 }
 
 void AtomsCrowdReader::affects( const Plug *input, AffectedPlugsContainer &outputs ) const
@@ -436,38 +2536,123 @@ void AtomsCrowdReader::affects( const Plug *input, AffectedPlugsContainer &outpu
 	ObjectSource::affects( input, outputs );
 
 	if( input == atomsSimFilePlug() || input == refreshCountPlug() ||
-	    input == agentIdsPlug() || input == timeOffsetPlug() )
+	    input == agentIdsPlug() || input == timeOffsetPlug() ||
+	    input == atomsSimFilesPlug() || input == agentIdOffsetsPlug() ||
+	    input == playbackCachePlug() || playbackRangePlug()->isAncestorOf( input ) ||
+	    input == previewFractionPlug() || input == playbackCacheDataPlug() )
     {
 	    outputs.push_back( enginePlug() );
     }
 
+	if( input == atomsSimFilePlug() || input == atomsSimFilesPlug() || input == refreshCountPlug() ||
+	    input == playbackCachePlug() || playbackRangePlug()->isAncestorOf( input ) )
+	{
+	    outputs.push_back( playbackCacheDataPlug() );
+	}
+
+	if( input == cullModePlug() || cullBoxPlug()->isAncestorOf( input ) ||
+	    input == cullCameraPlug() || input == cullPaddingPlug() ||
+	    input == cullScenePlug()->transformPlug() || input == cullScenePlug()->objectPlug() ||
+	    transformPlug()->isAncestorOf( input ) )
+	{
+	    outputs.push_back( enginePlug() );
+	}
+
 	if ( input == enginePlug() )
 	{
         outputs.push_back( sourcePlug() );
         outputs.push_back( outPlug()->attributesPlug() );
+        outputs.push_back( agentDataPlug() );
+	}
+
+	if ( input == compactPalettePlug() || input == metadataNamesPlug() || input == excludeMetadataNamesPlug() )
+	{
+        outputs.push_back( outPlug()->attributesPlug() );
+        outputs.push_back( agentDataPlug() );
 	}
 }
 
 Gaffer::ValuePlug::CachePolicy AtomsCrowdReader::computeCachePolicy( const Gaffer::ValuePlug *output ) const
 {
-	if( output == enginePlug() )
+	if( output == enginePlug() || output == sourcePlug() || output == outPlug()->attributesPlug() ||
+	    output == playbackCacheDataPlug() )
 	{
-		// Request blocking compute for the engine, to avoid concurrent threads
-		// loading the same engine redundantly.
-		return ValuePlug::CachePolicy::Standard;
+		// The caches and the agents are loaded and evaluated with parallel loops, so rather than
+		// blocking, the threads waiting for the same engine or crowd help computing it
+		return ValuePlug::CachePolicy::TaskCollaboration;
 	}
 
 	return ObjectSource::computeCachePolicy( output );
 }
 
+void AtomsCrowdReader::hashCacheFrame( const Gaffer::Context *context, MurmurHash &h ) const
+{
+    std::vector<std::string> filePaths;
+    std::vector<int> agentIdOffsets;
+    cacheFiles( this, filePaths, agentIdOffsets );
+    const int refreshCount = refreshCountPlug()->getValue();
+    const float frame = context->getFrame() + timeOffsetPlug()->getValue();
+
+    h.append( refreshCount );
+    // The playback cache doesn't store all the metadata, so it changes the results
+    if ( playbackCachePlug()->getValue() )
+    {
+        playbackRangePlug()->hash( h );
+    }
+    for ( size_t i = 0; i < filePaths.size(); ++i )
+    {
+        h.append( agentIdOffsets[i] );
+
+        std::string cachePath, cacheName;
+        AtomsCachePool::splitFilePath( filePaths[i], cachePath, cacheName );
+        if ( cacheName.empty() )
+        {
+            h.append( filePaths[i] );
+            h.append( frame );
+            continue;
+        }
+
+        // The frames clamped to the cache range read the same data, so they hash the same
+        // and reuse the results computed downstream
+        h.append( AtomsCachePool::instance().frameHash( cachePath, cacheName, refreshCount, frame ) );
+    }
+}
+
+void AtomsCrowdReader::hashCullRegion( MurmurHash &h ) const
+{
+    const int cullMode = cullModePlug()->getValue();
+    h.append( cullMode );
+    if ( cullMode == CullOff )
+    {
+        return;
+    }
+
+    cullPaddingPlug()->hash( h );
+    transformPlug()->hash( h );
+    if ( cullMode == CullBox )
+    {
+        cullBoxPlug()->hash( h );
+        return;
+    }
+
+    const std::string cameraPath = cullCameraPlug()->getValue();
+    h.append( cameraPath );
+    ScenePlug::ScenePath path;
+    ScenePlug::stringToPath( cameraPath, path );
+    if ( !cameraPath.empty() && cullScenePlug()->getInput() && cullScenePlug()->exists( path ) )
+    {
+        h.append( cullScenePlug()->fullTransformHash( path ) );
+        h.append( cullScenePlug()->objectHash( path ) );
+    }
+}
+
 void AtomsCrowdReader::hashSource( const Gaffer::Context *context, MurmurHash &h ) const
 {
-	h.append( atomsSimFilePlug()->getValue() );
-	refreshCountPlug()->hash( h );
-	timeOffsetPlug()->hash( h );
+    hashCacheFrame( context, h );
     agentIdsPlug()->hash( h );
+    previewFractionPlug()->hash( h );
+    hashCullRegion( h );
 	outPlug()->attributesPlug()->hash( h );
-	h.append( context->getFrame() );
 }
 
 ConstObjectPtr AtomsCrowdReader::computeSource( const Gaffer::Context *context ) const
@@ -482,332 +2667,260 @@ ConstObjectPtr AtomsCrowdReader::computeSource( const Gaffer::Context *context )
         return points;
     }
 
-    double frame = engineData->frame();
-    auto& atomsCache = engineData->cache();
-    auto& agentIds = engineData->agentIds();
-    size_t numAgents = agentIds.size();
-
-
-    V3fVectorDataPtr positionData = new V3fVectorData;
-    positionData->setInterpretation( IECore::GeometricData::Interpretation::Point );
-    auto &positions = positionData->writable();
-    positions.resize( numAgents );
-
-    IntVectorDataPtr agentCacheIdsData = new IntVectorData;
-    agentCacheIdsData->writable() = agentIds;
-
-	StringVectorDataPtr agentCacheIdsStrData = new StringVectorData;
-	auto &agentCacheIdsStr = agentCacheIdsStrData->writable();
-	agentCacheIdsStr.resize( numAgents );
-
-    StringVectorDataPtr agentTypesData = new StringVectorData;
-    auto &agentTypes = agentTypesData->writable();
-    agentTypes.resize( numAgents );
-
-    StringVectorDataPtr agentVariationData = new StringVectorData;
-    auto &agentVariations = agentVariationData->writable();
-    agentVariations.resize( numAgents );
-
-    StringVectorDataPtr agentLodData = new StringVectorData;
-    auto &agentLods = agentLodData->writable();
-    agentLods.resize( numAgents );
-
-    V3fVectorDataPtr velocityData = new V3fVectorData;
-    auto &velocity = velocityData->writable();
-    velocity.resize( numAgents );
-
-    V3fVectorDataPtr directionData = new V3fVectorData;
-    auto &direction = directionData->writable();
-    direction.resize( numAgents );
-
-    V3fVectorDataPtr scaleData = new V3fVectorData;
-    auto &scale = scaleData->writable();
-    scale.resize( numAgents );
-
-    Box3fVectorDataPtr boundingBoxData = new Box3fVectorData;
-    auto &boundingBox = boundingBoxData->writable();
-    boundingBox.resize( numAgents );
-
-    M44fVectorDataPtr rootMatrixData = new M44fVectorData;
-    auto &rootMatrix = rootMatrixData->writable();
-    rootMatrix.resize( numAgents );
-
-    QuatfVectorDataPtr orientationData = new QuatfVectorData;
-    auto &orientation = orientationData->writable();
-    orientation.resize( numAgents );
-
-
-    auto& atomsAgentTypes = atomsCache.agentTypes();
-    for( size_t i = 0; i < numAgents; ++i )
-    {
-        CompoundDataPtr agentCompoundData = new CompoundData;
-        auto &agentCompound = agentCompoundData->writable();
-        int agentId = agentIds[i];
-        // \todo: In order to use the agentId for cryptomattes we need a string attribute,
-        // but we don't currently have a way of changing attribute data type in Gaffer.
-        // This is just a hack until that functionality exists. Remove when possible.
-        agentCacheIdsStr[i] = std::to_string( agentId );
-
-        // load in memory the agent type since the cache need this to interpolate the pose
-        const std::string &agentTypeName = atomsCache.agentType( frame, agentId );
-        agentTypes[i] = agentTypeName;
-
-        AtomsCore::Pose pose;
-        atomsCache.loadAgentPose( frame, agentId, pose );
-        AtomsCore::MapMetadata metadata;
-        atomsCache.loadAgentMetadata( frame, agentId, metadata );
-
-        auto variationMetadata = metadata.getTypedEntry<AtomsCore::StringMetadata>( ATOMS_AGENT_VARIATION );
-        agentVariations[i] = variationMetadata ? variationMetadata->get() : "";
-
-        auto lodMetadata = metadata.getTypedEntry<AtomsCore::StringMetadata>( ATOMS_AGENT_LOD );
-        agentLods[i] = lodMetadata ? lodMetadata->get(): "";
-
-        auto directionMetadata = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_DIRECTION );
-        if ( directionMetadata )
-        {
-            auto& v = directionMetadata->get();
-            auto& vOut = direction[i];
-            vOut.x = v.x;
-            vOut.y = v.y;
-            vOut.z = v.z;
-        }
-
-
-        auto velocityMetadata = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_VELOCITY );
-        if ( velocityMetadata )
-        {
-            auto& v = velocityMetadata->get();
-            auto& vOut = velocity[i];
-            vOut.x = v.x;
-            vOut.y = v.y;
-            vOut.z = v.z;
-        }
-
-        auto scaleMetadata = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_SCALE );
-        if ( scaleMetadata )
-        {
-            auto& v = scaleMetadata->get();
-            auto& vOut = scale[i];
-            vOut.x = v.x;
-            vOut.y = v.y;
-            vOut.z = v.z;
-        }
-
-
-        if ( pose.numJoints() > 0 )
-        {
-            auto agentTypePtr = atomsAgentTypes.agentType( agentTypeName );
-            if ( agentTypePtr )
-            {
-                AtomsCore::Poser poser( &agentTypePtr->skeleton() );
-                auto matrices = poser.getAllWorldMatrix( pose );
-                if ( !matrices.empty() )
-                {
-                    auto& pelvisMtx = matrices[0];
-                    auto pelvisPosition = pelvisMtx.translation();
-                    convertFromAtoms( positions[i], pelvisPosition );
-                    convertFromAtoms( rootMatrix[i], pelvisMtx );
-                    convertFromAtoms( orientation[i], AtomsMath::extractQuat( pelvisMtx ) );
-                }
-            }
-            else
-            {
-                convertFromAtoms( positions[i], pose.jointPose( 0 ).translation );
-            }
-        }
-    }
-
-    PointsPrimitivePtr points = new PointsPrimitive( positionData );
-    points->variables["atoms:agentType"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentTypesData );
-    points->variables["atoms:variation"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentVariationData );
-    points->variables["atoms:lod"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentLodData );
-    points->variables["atoms:agentId"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentCacheIdsData );
-    points->variables["atoms:agentIdStr"] = PrimitiveVariable( PrimitiveVariable::Vertex, agentCacheIdsStrData );
-    points->variables["atoms:velocity"] = PrimitiveVariable( PrimitiveVariable::Vertex, velocityData );
-    points->variables["atoms:direction"] = PrimitiveVariable( PrimitiveVariable::Vertex, directionData );
-    points->variables["atoms:scale"] = PrimitiveVariable( PrimitiveVariable::Vertex, scaleData );
-    points->variables["atoms:orientation"] = PrimitiveVariable( PrimitiveVariable::Vertex, orientationData );
-    return points;
-
+    const auto& sample = engineData->sample( context->getFrame() + timeOffsetPlug()->getValue(), context->canceller() );
+    return engineData->points( sample, context->canceller() );
 }
 
 void AtomsCrowdReader::hashAttributes( const ScenePath &path, const Gaffer::Context *context, const GafferScene::ScenePlug *parent, IECore::MurmurHash &h ) const
 {
     GafferScene::ObjectSource::hashAttributes( path, context, parent, h );
-    h.append( atomsSimFilePlug()->getValue() );
-    refreshCountPlug()->hash( h );
+    hashCacheFrame( context, h );
+    // The time offset is stored in the crowd data
     timeOffsetPlug()->hash( h );
     agentIdsPlug()->hash( h );
-    h.append( context->getFrame() );
+    previewFractionPlug()->hash( h );
+    hashCullRegion( h );
+    compactPalettePlug()->hash( h );
+    metadataNamesPlug()->hash( h );
+    excludeMetadataNamesPlug()->hash( h );
 }
 
 IECore::ConstCompoundObjectPtr AtomsCrowdReader::computeAttributes( const SceneNode::ScenePath &path, const Gaffer::Context *context, const GafferScene::ScenePlug *parent ) const
 {
     // The attribute output a single attribute atoms:agents containing the pose and metadata of every agents
-    ConstEngineDataPtr engineData = boost::static_pointer_cast<const EngineData>( enginePlug()->getValue() );
-
     IECore::CompoundObjectPtr result = new IECore::CompoundObject;
     auto& members = result->members();
 
+    ConstEngineDataPtr engineData = boost::static_pointer_cast<const EngineData>( enginePlug()->getValue() );
     if ( !engineData )
     {
         return result;
     }
 
-    auto& atomsCache = engineData->cache();
-    double frame = engineData->frame();
+    std::vector<size_t> indices( engineData->agentIds().size() );
+    std::iota( indices.begin(), indices.end(), 0 );
+    const auto& sample = engineData->sample( context->getFrame() + timeOffsetPlug()->getValue(), context->canceller() );
+    AtomsCrowdDataPtr crowd = engineData->crowdData( sample, indices, compactPalettePlug()->getValue(), metadataFilter( this ), context->canceller() );
 
-    auto& agentIds = engineData->agentIds();
-    size_t numAgents = agentIds.size();
+    // Store the frame offset, this is used by the cloth reader to mantain the 2 caches in synch
+    crowd->setFrameOffset( timeOffsetPlug()->getValue() );
 
-    auto& translator = AtomsMetadataTranslator::instance();
+    members[ "atoms:agents" ] = crowd;
+    return result;
+}
 
-    Box3dDataPtr cacheBox = new Box3dData;
-    AtomsCore::Box3 atomsCacheBox;
-    atomsCache.loadBoundingBox( frame, atomsCacheBox );
-    convertFromAtoms( cacheBox->writable(), atomsCacheBox );
-    //members["atoms:boundingBox"] = cacheBox;
+void AtomsCrowdReader::hash( const Gaffer::ValuePlug *output, const Gaffer::Context *context, IECore::MurmurHash &h ) const
+{
+    ObjectSource::hash( output, context, h );
+    if( output == enginePlug() )
+    {
+        atomsSimFilePlug()->hash( h );
+        atomsSimFilesPlug()->hash( h );
+        agentIdOffsetsPlug()->hash( h );
+        refreshCountPlug()->hash( h );
+        agentIdsPlug()->hash( h );
+        previewFractionPlug()->hash( h );
+        hashCullRegion( h );
+        playbackCachePlug()->hash( h );
+        // The range is only read with the playback cache on
+        if ( playbackCachePlug()->getValue() )
+        {
+            playbackRangePlug()->hash( h );
+            playbackCacheDataPlug()->hash( h );
+        }
+        // Hash the loaded cache frames rather than the exact frame, so the motion blur samples share the engine
+        std::vector<std::string> filePaths;
+        std::vector<int> agentIdOffsets;
+        cacheFiles( this, filePaths, agentIdOffsets );
+        const float frame = context->getFrame() + timeOffsetPlug()->getValue();
+        hashEngineFrame( frame, h );
+        hashEngineFrameFiles( filePaths, refreshCountPlug()->getValue(), frame, h );
+    }
 
-    IntVectorDataPtr agentIndices = new IntVectorData;
-    agentIndices->writable() = agentIds;
-    //members["atoms:agentIds"] = agentIndices;
+    if ( output == sourcePlug() )
+    {
+        hashCacheFrame( context, h );
+        agentIdsPlug()->hash( h );
+        previewFractionPlug()->hash( h );
+        hashCullRegion( h );
+    }
 
-    CompoundDataPtr agentsCompound = new CompoundData;
-    auto &agentsCompoundData = agentsCompound->writable();
+    if ( output == agentDataPlug() )
+    {
+        h.append( context->get<int>( agentIdContextName, -1 ) );
+        compactPalettePlug()->hash( h );
+        metadataNamesPlug()->hash( h );
+        excludeMetadataNamesPlug()->hash( h );
+        timeOffsetPlug()->hash( h );
+        hashCacheFrame( context, h );
+        agentIdsPlug()->hash( h );
+        previewFractionPlug()->hash( h );
+        hashCullRegion( h );
+    }
 
-    auto& atomsAgentTypes = atomsCache.agentTypes();
-    for( size_t i = 0; i < numAgents; ++i )
+    if ( output == playbackCacheDataPlug() )
     {
-        CompoundDataPtr agentCompoundData = new CompoundData;
-        auto &agentCompound = agentCompoundData->writable();
-        int agentId = agentIds[i];
+        // The range doesn't depend on the frame, so every frame shares the same playback caches
+        atomsSimFilePlug()->hash( h );
+        atomsSimFilesPlug()->hash( h );
+        refreshCountPlug()->hash( h );
+        playbackCachePlug()->hash( h );
+        if ( playbackCachePlug()->getValue() )
+        {
+            playbackRangePlug()->hash( h );
+        }
+    }
+}
 
-        // load in memory the agent type since the cache need this to interpolate the pose
-        const std::string &agentTypeName = atomsCache.agentType( frame, agentId );
-        auto agentTypePtr = atomsAgentTypes.agentType( agentTypeName );
+void AtomsCrowdReader::compute( Gaffer::ValuePlug *output, const Gaffer::Context *context ) const
+{
+    if ( output == enginePlug() )
+    {
+        EngineParameters parameters;
+        cacheFiles( this, parameters.filePaths, parameters.agentIdOffsets );
+        parameters.refreshCount = refreshCountPlug()->getValue();
+        parameters.agentIds = agentIdsPlug()->getValue();
+        parameters.previewFraction = previewFractionPlug()->getValue();
+        // The prefetched frames are culled with the region of the current frame. If the region
+        // moves, they are loaded again by their own compute.
+        parameters.cullRegion = cullRegion( this );
+        parameters.diskCachePath = diskCachePathPlug()->getValue();
+        size_t playbackCacheMemory = 0;
+        if ( playbackCachePlug()->getValue() )
+        {
+            ConstPlaybackCacheDataPtr playbackCacheData = boost::static_pointer_cast<const PlaybackCacheData>( playbackCacheDataPlug()->getValue() );
+            parameters.playbackCaches = playbackCacheData->playbackCaches();
+            playbackCacheMemory = playbackCacheData->memorySize();
+        }
 
-        AtomsPtr<AtomsCore::PoseMetadata> posePtr( new AtomsCore::PoseMetadata );
-        atomsCache.loadAgentPose( frame, agentId, posePtr->get() );
-        AtomsPtr<AtomsCore::MapMetadata> metadataPtr( new AtomsCore::MapMetadata );
-        atomsCache.loadAgentMetadata( frame, agentId, *metadataPtr.get() );
+        const float frame = context->getFrame() + timeOffsetPlug()->getValue();
 
-        Box3dDataPtr agentBBox = new Box3dData;
-        auto& agentBBoxData = agentBBox->writable();
-        if ( agentTypePtr )
+        // The frames recently loaded by this reader are looked up first, they were already counted in the statistics.
+        // They are keyed on the content of their frames, so a cache written again is loaded again.
+        const MurmurHash key = engineKey( parameters, frame );
+        const size_t frameCacheMemory = static_cast<size_t>( frameCacheMemoryPlug()->getValue() ) * 1024 * 1024;
+        ConstObjectPtr engine = frameCacheMemory ? m_frameCache->get( key ) : nullptr;
+        const bool cached = static_cast<bool>( engine );
+        if ( frameCacheMemory )
         {
-            AtomsCore::Poser poser( &agentTypePtr->skeleton() );
-            M44dVectorDataPtr matricesData = new M44dVectorData;
-            M44dVectorDataPtr normalMatricesData = new M44dVectorData;
+            m_statistics.addEvent( cached ? "frameCacheHits" : "frameCacheMisses" );
+        }
 
-            // get the root world matrix
-            auto rootMatrix = poser.getWorldMatrix( posePtr->get(), 0 );
-            // now for all the detached joint multiply transform in root local space
-            AtomsCore::Matrix rootInverseMatrix = rootMatrix.inverse();
-            const std::vector<unsigned short>& detachedJoints = agentTypePtr->skeleton().detachedJoints();
-            for ( unsigned int ii = 0; ii < agentTypePtr->skeleton().detachedJoints().size(); ii++ )
+        // The prefetch doesn't change the engine, so it isn't part of the engine hash
+        const int prefetchFrames = prefetchFramesPlug()->getValue();
+        if ( prefetchFrames > 0 )
+        {
+            if ( !engine )
             {
-                poser.setWorldMatrix( posePtr->get(), poser.getWorldMatrix( posePtr->get(), detachedJoints[ii] ) * rootInverseMatrix, detachedJoints[ii] );
+                engine = m_framePrefetcher->take( prefetchKey( parameters, frame ) );
+                m_statistics.addEvent( engine ? "prefetchHits" : "prefetchMisses" );
             }
 
-            auto& outMatrices = matricesData->writable();
-            auto& outNormalMatrices = normalMatricesData->writable();
-            convertFromAtoms( outMatrices, poser.getAllWorldMatrix( posePtr->get() ) );
-            outNormalMatrices.resize( outMatrices.size() );
-
-            //update the position metadata
-            auto positionMeta = metadataPtr->getTypedEntry<AtomsCore::Vector3Metadata>( ATOMS_AGENT_POSITION );
-            if ( positionMeta )
+            std::vector<FramePrefetcher::Request> requests;
+            for ( int i = 1; i <= prefetchFrames; ++i )
             {
-                positionMeta->set( rootMatrix.translation() );
+                const float nextFrame = frame + i;
+                FramePrefetcher::Request request;
+                request.key = prefetchKey( parameters, nextFrame );
+                // Cancelled by the prefetcher when the request is superseded
+                request.loader = [parameters, nextFrame]( const Canceller* canceller ) { return EngineData::create( parameters, nextFrame, canceller ); };
+                requests.push_back( request );
             }
+            m_framePrefetcher->prefetch( requests, prefetchFrames );
+        }
 
-            const AtomsCore::MapMetadata& metadata = agentTypePtr->metadata();
-            AtomsPtr<const AtomsCore::MatrixArrayMetadata> bindPosesInvPtr = metadata.getTypedEntry<const AtomsCore::MatrixArrayMetadata>( "worldBindPoseInverseMatrices" );
-            if ( !bindPosesInvPtr )
-            {
-                throw InvalidArgumentException( "AtomsCrowdReader : No worldBindPoseInverseMatrices metadata found on agent type: " +  agentTypeName );
-            }
+        if ( !engine )
+        {
+            engine = EngineData::create( parameters, frame, context->canceller() );
+        }
 
-            const std::vector<AtomsCore::Matrix>& bindPosesInv = bindPosesInvPtr->get();
+        if ( !cached )
+        {
+            m_statistics.merge( static_cast<const EngineData *>( engine.get() )->statistics() );
+        }
 
-            // Store the matrices for the skinning
-            for ( unsigned int j = 0; j < outMatrices.size(); j++ )
+        // The memory shared by the engines is counted once, on the node
+        size_t agentTypesMemory = 0;
+        for ( const std::string& filePath : parameters.filePaths )
+        {
+            std::string cachePath, cacheName;
+            AtomsCachePool::splitFilePath( filePath, cachePath, cacheName );
+            if ( !cacheName.empty() )
             {
-                auto &jMtx = outMatrices[j];
-                agentBBoxData.extendBy(jMtx.translation());
-                Imath::M44d bindInverseMatrix;
-                convertFromAtoms( bindInverseMatrix, bindPosesInv[j] );
-                jMtx = bindInverseMatrix * jMtx;
-                outNormalMatrices[j] = jMtx.inverse().transpose();
+                agentTypesMemory += AtomsCachePool::instance().agentTypesMemory( cachePath, cacheName, parameters.refreshCount );
             }
-
-            agentCompound["poseWorldMatrices"] = matricesData;
-            agentCompound["poseNormalWorldMatrices"] = normalMatricesData;
-
-            M44dDataPtr rootMatrixData = new M44dData( );
-            convertFromAtoms( rootMatrixData->writable(), rootMatrix );
-            agentCompound["rootMatrix"] = rootMatrixData;
-
-            // This is an hash of the agent pose in local space
-            UInt64DataPtr hashData = new UInt64Data( posePtr->get().hash() );
-            agentCompound["hash"] = hashData;
-        }
-        else
-        {
-            throw InvalidArgumentException( "AtomsCrowdReader: Invalid agent type " + agentTypeName );
         }
+        m_statistics.setMemory( "agentTypes", agentTypesMemory );
+        m_statistics.setMemory( "playbackCache", playbackCacheMemory );
 
-        agentCompound["metadata"] = translator.translate( metadataPtr );
-
-        agentCompound["boundingBox"] = agentBBox;
+        // A zero budget empties the cache
+        m_frameCache->set( key, engine, frameCacheMemory );
+        m_statistics.setMemory( "frameCache", m_frameCache->memory() );
 
-        StringDataPtr aTypeData = new StringData();
-        aTypeData->writable() = agentTypeName;
-        agentCompound["agentType"] = aTypeData;
-
-        //members[ "atoms:agent:" + std::to_string( agentId ) ] = agentCompoundData;
-        agentsCompoundData[ std::to_string( agentId ) ] =  agentCompoundData;
+        static_cast<ObjectPlug *>( output )->setValue( engine );
+        return;
     }
 
-    // Store the frame offset, this is used by the cloth reader to mantain the 2 caches in synch
-    FloatDataPtr frameOffsetData = new FloatData;
-    frameOffsetData->writable() = timeOffsetPlug()->getValue();
-    agentsCompoundData[ "frameOffset" ] = frameOffsetData;
-
-    // Store the cache data inside a blind data container to not inpact on the UI performance
-    BlindDataHolderPtr atomsObj = new BlindDataHolder(agentsCompound);
-    members[ "atoms:agents" ] = atomsObj;
-    return result;
-}
-
-void AtomsCrowdReader::hash( const Gaffer::ValuePlug *output, const Gaffer::Context *context, IECore::MurmurHash &h ) const
-{
-    ObjectSource::hash( output, context, h );
-    if( output == enginePlug() )
+    if ( output == playbackCacheDataPlug() )
     {
-        h.append( atomsSimFilePlug()->getValue() );
-        refreshCountPlug()->hash( h );
-        timeOffsetPlug()->hash( h );
-        agentIdsPlug()->hash( h );
-        h.append(context->getFrame());
+        PlaybackCacheDataPtr playbackCacheData = new PlaybackCacheData;
+        if ( playbackCachePlug()->getValue() )
+        {
+            std::vector<std::string> filePaths;
+            std::vector<int> agentIdOffsets;
+            cacheFiles( this, filePaths, agentIdOffsets );
+            const Imath::V2i playbackRange = playbackRangePlug()->getValue();
+            for ( const std::string& filePath : filePaths )
+            {
+                std::string cachePath, cacheName;
+                AtomsCachePool::splitFilePath( filePath, cachePath, cacheName );
+                ConstAtomsPlaybackCachePtr playbackCache;
+                if ( !cacheName.empty() )
+                {
+                    // A cancelled load isn't cached, so the next compute loads the range again
+                    try
+                    {
+                        AtomsStatistics::ScopedTimer timer( m_statistics, "loadPlaybackCache" );
+                        playbackCache = new AtomsPlaybackCache( cachePath, cacheName, playbackRange.x, playbackRange.y, context->canceller() );
+                        m_statistics.addEvent( "playbackCacheLoads" );
+                    }
+                    catch ( const Cancelled& )
+                    {
+                        throw;
+                    }
+                    catch ( const std::exception& e )
+                    {
+                        IECore::msg( IECore::Msg::Warning, "AtomsCrowdReader", std::string( "Unable to load the playback cache : " ) + e.what() );
+                    }
+                }
+                playbackCacheData->addPlaybackCache( cachePath, cacheName, playbackRange, playbackCache );
+            }
+        }
+        static_cast<ObjectPlug *>( output )->setValue( playbackCacheData );
+        return;
     }
 
-    if ( output == sourcePlug() )
+    if ( output == agentDataPlug() )
     {
-        enginePlug()->hash( h );
-        h.append( context->getFrame() );
-    }
-}
+        const int agentId = context->get<int>( agentIdContextName, -1 );
+        ConstEngineDataPtr engineData;
+        {
+            Context::EditableScope engineScope( context );
+            engineScope.remove( agentIdContextName );
+            engineData = boost::static_pointer_cast<const EngineData>( enginePlug()->getValue() );
+        }
 
-void AtomsCrowdReader::compute( Gaffer::ValuePlug *output, const Gaffer::Context *context ) const
-{
-    if ( output == enginePlug() )
-    {
-        // check if the frame or file path is changed and update it
-        static_cast<ObjectPlug *>( output )->setValue(
-                new EngineData( atomsSimFilePlug()->getValue(), context->getFrame() + timeOffsetPlug()->getValue(), agentIdsPlug()->getValue() )
-                );
+        const int agentIndex = engineData->agentIndex( agentId );
+        if ( agentIndex < 0 )
+        {
+            static_cast<ObjectPlug *>( output )->setToDefault();
+            return;
+        }
+
+        const auto& sample = engineData->agentSample( context->getFrame() + timeOffsetPlug()->getValue(), agentIndex, context->canceller() );
+        AtomsCrowdDataPtr crowd = engineData->crowdData( sample, std::vector<size_t>( 1, agentIndex ), compactPalettePlug()->getValue(), metadataFilter( this ), context->canceller() );
+        crowd->setFrameOffset( timeOffsetPlug()->getValue() );
+        static_cast<ObjectPlug *>( output )->setValue( crowd );
         return;
     }
 
@@ -35,18 +35,17 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "AtomsGaffer/AtomsMetadata.h"
+#include "AtomsGaffer/AtomsAgentFilter.h"
+#include "AtomsGaffer/AtomsCrowdData.h"
 
 #include "IECoreScene/PointsPrimitive.h"
 
 #include "IECore/TypeIds.h"
-#include "IECore/BlindDataHolder.h"
 
 #include "AtomsCore/Metadata/MetadataTypeIds.h"
 #include <AtomsCore/Metadata/Metadata.h>
 #include <AtomsCore/Metadata/MetadataImpl.h>
 
-#include "AtomsUtils/Utils.h"
-
 #include <algorithm>
 
 
@@ -128,103 +127,6 @@ void AtomsMetadata::hashObject( const ScenePath &path, const Gaffer::Context *co
     inPlug()->attributesPlug()->hash( h );
 }
 
-void AtomsMetadata::parseVisibleAgents( std::vector<int>& agentsFiltered,  std::vector<int>& agentIds, const std::string& filter, bool invert ) const
-{
-    std::vector<std::string> idsEntryStr;
-    AtomsUtils::splitString(filter, ',', idsEntryStr);
-    std::vector<int> idsToRemove;
-    std::vector<int> idsToAdd;
-    std::sort(agentIds.begin(), agentIds.end());
-    for ( unsigned int eId = 0; eId < idsEntryStr.size(); eId++ )
-    {
-        std::string currentStr = idsEntryStr[eId];
-        currentStr = AtomsUtils::eraseFromString(currentStr, ' ');
-        if (currentStr.length() == 0)
-        {
-            continue;
-        }
-
-        std::vector<int>* currentIdArray = &idsToAdd;
-        if (invert)
-            currentIdArray = &idsToRemove;
-        // is a remove id
-        if ( currentStr[0] == '!' )
-        {
-            if ( invert )
-            {
-                currentIdArray = &idsToAdd;
-            }
-            else
-            {
-                currentIdArray = &idsToRemove;
-            }
-            currentStr = currentStr.substr( 1, currentStr.length() );
-        }
-
-        currentStr = AtomsUtils::eraseFromString( currentStr, '(' );
-        currentStr = AtomsUtils::eraseFromString( currentStr, ')' );
-
-        // it is a range
-        if ( currentStr.find( '-' ) != std::string::npos )
-        {
-            std::vector<std::string> rangeEntryStr;
-            AtomsUtils::splitString( currentStr, '-', rangeEntryStr );
-
-            int startRange = 0;
-            int endRange = 0;
-            if ( !rangeEntryStr.empty() )
-            {
-                startRange = atoi( rangeEntryStr[0].c_str() );
-
-                if (rangeEntryStr.size() > 1)
-                {
-                    endRange = atoi( rangeEntryStr[1].c_str() );
-                    if ( startRange < endRange )
-                    {
-                        for ( int rId = startRange; rId <= endRange; rId++ )
-                        {
-                            currentIdArray->push_back( rId );
-                        }
-                    }
-                }
-            }
-        }
-        else
-        {
-            int tmpId = atoi( currentStr.c_str() );
-            currentIdArray->push_back( tmpId );
-        }
-    }
-
-    agentsFiltered.clear();
-    std::sort( idsToAdd.begin(), idsToAdd.end() );
-    std::sort( idsToRemove.begin(), idsToRemove.end() );
-    if ( !idsToAdd.empty() )
-    {
-        std::vector<int> validIds;
-        std::set_intersection(
-                agentIds.begin(), agentIds.end(),
-                idsToAdd.begin(), idsToAdd.end(),
-                std::back_inserter( validIds )
-        );
-
-
-        std::set_difference(
-                validIds.begin(), validIds.end(),
-                idsToRemove.begin(), idsToRemove.end(),
-                std::back_inserter( agentsFiltered )
-        );
-    }
-    else
-    {
-        std::set_difference(
-                agentIds.begin(), agentIds.end(),
-                idsToRemove.begin(), idsToRemove.end(),
-                std::back_inserter( agentsFiltered )
-        );
-    }
-}
-
 template <typename T, typename OUT, typename IN>
 void AtomsMetadata::setMetadataOnPoints(
         IECoreScene::PointsPrimitivePtr& primitive,
@@ -254,30 +156,16 @@ void AtomsMetadata::setMetadataOnPoints(
         //try to fill the data from the attributes
         if( attributes )
         {
-            for ( size_t i = 0;  i < agentIdVec.size(); ++i )
+            auto atomsData = attributes->member<const AtomsCrowdData>( "atoms:agents" );
+            for ( size_t i = 0;  atomsData && i < agentIdVec.size(); ++i )
             {
-                int agentId = agentIdVec[i];
-
-
-                auto atomsData = attributes->member<const BlindDataHolder>( "atoms:agents" );
-                if( !atomsData )
-                {
-                    continue;
-                }
-
-                auto agentsData = atomsData->blindData();
-                if( !agentsData )
-                {
-                    continue;
-                }
-
-                auto agentData = agentsData->member<const CompoundData>( std::to_string( agentId ) );
-                if ( !agentData )
+                const int agentIndex = atomsData->agentIndex( agentIdVec[i] );
+                if ( agentIndex < 0 )
                 {
                     continue;
                 }
 
-                auto metadataData = agentData->member<const CompoundData>( "metadata" );
+                const CompoundData* metadataData = atomsData->metadata()[agentIndex].get();
                 if ( !metadataData )
                 {
                     continue;
@@ -354,7 +242,8 @@ IECore::ConstObjectPtr AtomsMetadata::computeObject( const ScenePath &path, cons
         throw InvalidArgumentException( "AtomsMetadata: Input must be a PointsPrimitive containing an \"atoms:agentId\" vertex variable" );
     }
 
-    std::vector<int> agentIdVec = agentIdData->readable();
+    // The ids stay in point order, so the defaults read from the attributes line up with the points they belong to
+    const std::vector<int>& agentIdVec = agentIdData->readable();
     std::map<int, int> agentIdPointsMapper;
     for( size_t i=0; i< agentIdVec.size(); ++i )
     {
@@ -363,7 +252,7 @@ IECore::ConstObjectPtr AtomsMetadata::computeObject( const ScenePath &path, cons
 
     // Filter the agents
     std::vector<int> agentsFiltered;
-    parseVisibleAgents( agentsFiltered, agentIdVec, AtomsUtils::eraseFromString(agentIdsPlug()->getValue(), ' '), invertPlug()->getValue() );
+    AtomsAgentFilter::get( agentIdsPlug()->getValue() )->filter( agentIdVec, agentsFiltered, invertPlug()->getValue() );
 
     for( auto it = compoundDataMap.cbegin(); it != compoundDataMap.cend(); ++it )
     {
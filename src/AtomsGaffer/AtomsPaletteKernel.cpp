@@ -0,0 +1,305 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsPaletteKernel.h"
+
+#include "IECore/Exception.h"
+
+#if defined( __GNUC__ ) && defined( __x86_64__ )
+#define ATOMSGAFFER_PALETTEKERNEL_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace AtomsGaffer;
+
+namespace
+{
+
+// Scalar implementation
+// =====================
+
+inline void multiplyScalar( const Imath::M44d& a, const Imath::M44d& b, Imath::M44d& out )
+{
+    // out can be the same matrix as b, so compute the result before storing it
+    double result[4][4];
+    for ( int i = 0; i < 4; ++i )
+    {
+        for ( int j = 0; j < 4; ++j )
+        {
+            result[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] + a[i][3] * b[3][j];
+        }
+    }
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        for ( int j = 0; j < 4; ++j )
+        {
+            out[i][j] = result[i][j];
+        }
+    }
+}
+
+// Inverse transpose of an affine matrix. The rows of the inverse transpose of the rotation and scale block
+// are the cross products of its rows divided by its determinant.
+inline void normalMatrixScalar( const Imath::M44d& m, Imath::M44d& out )
+{
+    double c[3][3];
+    c[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    c[0][1] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    c[0][2] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    c[1][0] = m[2][1] * m[0][2] - m[2][2] * m[0][1];
+    c[1][1] = m[2][2] * m[0][0] - m[2][0] * m[0][2];
+    c[1][2] = m[2][0] * m[0][1] - m[2][1] * m[0][0];
+    c[2][0] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+    c[2][1] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+    c[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+    const double det = m[0][0] * c[0][0] + m[0][1] * c[0][1] + m[0][2] * c[0][2];
+    if ( det == 0.0 )
+    {
+        out.makeIdentity();
+        return;
+    }
+
+    const double invDet = 1.0 / det;
+    for ( int i = 0; i < 3; ++i )
+    {
+        out[i][0] = c[i][0] * invDet;
+        out[i][1] = c[i][1] * invDet;
+        out[i][2] = c[i][2] * invDet;
+        out[i][3] = -( out[i][0] * m[3][0] + out[i][1] * m[3][1] + out[i][2] * m[3][2] );
+    }
+    out[3][0] = 0.0;
+    out[3][1] = 0.0;
+    out[3][2] = 0.0;
+    out[3][3] = 1.0;
+}
+
+void skinningMatricesScalar( const Imath::M44d* bindInverse, const Imath::M44d* world, size_t count, Imath::M44d* skinning, Imath::M44d* normals )
+{
+    for ( size_t i = 0; i < count; ++i )
+    {
+        multiplyScalar( bindInverse[i], world[i], skinning[i] );
+        if ( normals )
+        {
+            normalMatrixScalar( skinning[i], normals[i] );
+        }
+    }
+}
+
+#ifdef ATOMSGAFFER_PALETTEKERNEL_AVX2
+
+// AVX2 implementation
+// ===================
+
+#define ATOMSGAFFER_AVX2 __attribute__(( target( "avx2,fma" ) ))
+
+ATOMSGAFFER_AVX2 inline void multiplyAVX2( const Imath::M44d& a, const Imath::M44d& b, Imath::M44d& out )
+{
+    // Every row of the result is a linear combination of the rows of b
+    const __m256d b0 = _mm256_loadu_pd( b[0] );
+    const __m256d b1 = _mm256_loadu_pd( b[1] );
+    const __m256d b2 = _mm256_loadu_pd( b[2] );
+    const __m256d b3 = _mm256_loadu_pd( b[3] );
+    for ( int i = 0; i < 4; ++i )
+    {
+        __m256d row = _mm256_mul_pd( _mm256_broadcast_sd( &a[i][0] ), b0 );
+        row = _mm256_fmadd_pd( _mm256_broadcast_sd( &a[i][1] ), b1, row );
+        row = _mm256_fmadd_pd( _mm256_broadcast_sd( &a[i][2] ), b2, row );
+        row = _mm256_fmadd_pd( _mm256_broadcast_sd( &a[i][3] ), b3, row );
+        _mm256_storeu_pd( out[i], row );
+    }
+}
+
+// Loads the element at row r and column c of 4 consecutive matrices, one per lane
+ATOMSGAFFER_AVX2 inline __m256d gatherAVX2( const Imath::M44d* m, int r, int c )
+{
+    return _mm256_set_pd( m[3][r][c], m[2][r][c], m[1][r][c], m[0][r][c] );
+}
+
+ATOMSGAFFER_AVX2 inline void scatterAVX2( __m256d v, Imath::M44d* m, int r, int c )
+{
+    alignas( 32 ) double lanes[4];
+    _mm256_store_pd( lanes, v );
+    m[0][r][c] = lanes[0];
+    m[1][r][c] = lanes[1];
+    m[2][r][c] = lanes[2];
+    m[3][r][c] = lanes[3];
+}
+
+// a * b - c * d
+ATOMSGAFFER_AVX2 inline __m256d crossTermAVX2( __m256d a, __m256d b, __m256d c, __m256d d )
+{
+    return _mm256_fmsub_pd( a, b, _mm256_mul_pd( c, d ) );
+}
+
+// Same as normalMatrixScalar, computing 4 matrices at once with one matrix per lane
+ATOMSGAFFER_AVX2 void normalMatricesAVX2( const Imath::M44d* m, Imath::M44d* out )
+{
+    const __m256d m00 = gatherAVX2( m, 0, 0 ), m01 = gatherAVX2( m, 0, 1 ), m02 = gatherAVX2( m, 0, 2 );
+    const __m256d m10 = gatherAVX2( m, 1, 0 ), m11 = gatherAVX2( m, 1, 1 ), m12 = gatherAVX2( m, 1, 2 );
+    const __m256d m20 = gatherAVX2( m, 2, 0 ), m21 = gatherAVX2( m, 2, 1 ), m22 = gatherAVX2( m, 2, 2 );
+    const __m256d m30 = gatherAVX2( m, 3, 0 ), m31 = gatherAVX2( m, 3, 1 ), m32 = gatherAVX2( m, 3, 2 );
+
+    __m256d c[3][3];
+    c[0][0] = crossTermAVX2( m11, m22, m12, m21 );
+    c[0][1] = crossTermAVX2( m12, m20, m10, m22 );
+    c[0][2] = crossTermAVX2( m10, m21, m11, m20 );
+    c[1][0] = crossTermAVX2( m21, m02, m22, m01 );
+    c[1][1] = crossTermAVX2( m22, m00, m20, m02 );
+    c[1][2] = crossTermAVX2( m20, m01, m21, m00 );
+    c[2][0] = crossTermAVX2( m01, m12, m02, m11 );
+    c[2][1] = crossTermAVX2( m02, m10, m00, m12 );
+    c[2][2] = crossTermAVX2( m00, m11, m01, m10 );
+
+    const __m256d det = _mm256_fmadd_pd( m00, c[0][0], _mm256_fmadd_pd( m01, c[0][1], _mm256_mul_pd( m02, c[0][2] ) ) );
+    const __m256d invDet = _mm256_div_pd( _mm256_set1_pd( 1.0 ), det );
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        const __m256d n0 = _mm256_mul_pd( c[i][0], invDet );
+        const __m256d n1 = _mm256_mul_pd( c[i][1], invDet );
+        const __m256d n2 = _mm256_mul_pd( c[i][2], invDet );
+        const __m256d n3 = _mm256_fmadd_pd( n0, m30, _mm256_fmadd_pd( n1, m31, _mm256_mul_pd( n2, m32 ) ) );
+        scatterAVX2( n0, out, i, 0 );
+        scatterAVX2( n1, out, i, 1 );
+        scatterAVX2( n2, out, i, 2 );
+        scatterAVX2( _mm256_sub_pd( _mm256_setzero_pd(), n3 ), out, i, 3 );
+    }
+
+    alignas( 32 ) double dets[4];
+    _mm256_store_pd( dets, det );
+    for ( int k = 0; k < 4; ++k )
+    {
+        if ( dets[k] == 0.0 )
+        {
+            out[k].makeIdentity();
+            continue;
+        }
+        out[k][3][0] = 0.0;
+        out[k][3][1] = 0.0;
+        out[k][3][2] = 0.0;
+        out[k][3][3] = 1.0;
+    }
+}
+
+ATOMSGAFFER_AVX2 void skinningMatricesAVX2( const Imath::M44d* bindInverse, const Imath::M44d* world, size_t count, Imath::M44d* skinning, Imath::M44d* normals )
+{
+    for ( size_t i = 0; i < count; ++i )
+    {
+        multiplyAVX2( bindInverse[i], world[i], skinning[i] );
+    }
+
+    if ( !normals )
+    {
+        return;
+    }
+
+    size_t i = 0;
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        normalMatricesAVX2( skinning + i, normals + i );
+    }
+
+    for ( ; i < count; ++i )
+    {
+        normalMatrixScalar( skinning[i], normals[i] );
+    }
+}
+
+#endif // ATOMSGAFFER_PALETTEKERNEL_AVX2
+
+} // namespace
+
+AtomsPaletteKernel::Implementation AtomsPaletteKernel::bestImplementation()
+{
+    static const Implementation implementation = isSupported( Implementation::AVX2 ) ? Implementation::AVX2 : Implementation::Scalar;
+    return implementation;
+}
+
+bool AtomsPaletteKernel::isSupported( Implementation implementation )
+{
+    switch ( implementation )
+    {
+        case Implementation::Scalar:
+            return true;
+        case Implementation::AVX2:
+#ifdef ATOMSGAFFER_PALETTEKERNEL_AVX2
+            return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+void AtomsPaletteKernel::skinningMatrices(
+        const Imath::M44d* bindInverse,
+        const Imath::M44d* world,
+        size_t count,
+        Imath::M44d* skinning,
+        Imath::M44d* normals
+)
+{
+    skinningMatrices( bindInverse, world, count, skinning, normals, bestImplementation() );
+}
+
+void AtomsPaletteKernel::skinningMatrices(
+        const Imath::M44d* bindInverse,
+        const Imath::M44d* world,
+        size_t count,
+        Imath::M44d* skinning,
+        Imath::M44d* normals,
+        Implementation implementation
+)
+{
+    if ( !isSupported( implementation ) )
+    {
+        throw IECore::InvalidArgumentException( "AtomsPaletteKernel : Implementation not supported by the cpu" );
+    }
+
+    switch ( implementation )
+    {
+#ifdef ATOMSGAFFER_PALETTEKERNEL_AVX2
+        case Implementation::AVX2:
+            skinningMatricesAVX2( bindInverse, world, count, skinning, normals );
+            break;
+#endif
+        default:
+            skinningMatricesScalar( bindInverse, world, count, skinning, normals );
+            break;
+    }
+}
@@ -0,0 +1,394 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsPlaybackCache.h"
+
+#include "IECore/Exception.h"
+
+#include "Atoms/AtomsCache.h"
+#include "Atoms/GlobalNames.h"
+
+#include "AtomsCore/Metadata/StringMetadata.h"
+#include "AtomsCore/Metadata/Vector3Metadata.h"
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace IECore;
+using namespace AtomsGaffer;
+
+namespace
+{
+
+// The metadata kept for every agent. The other metadata isn't stored.
+enum MetadataFlags : uint8_t
+{
+    HasVariation = 1 << 0,
+    HasLod = 1 << 1,
+    HasPosition = 1 << 2,
+    HasDirection = 1 << 3,
+    HasVelocity = 1 << 4,
+    HasScale = 1 << 5
+};
+
+const float g_quaternionScale = 32767.0f;
+
+// Quantise a unit quaternion to 16 bit components. q and -q are the same rotation,
+// so the real part is kept positive.
+void quantise( const AtomsCore::Quaternion& q, int16_t* out )
+{
+    const double length = std::sqrt( q.r * q.r + q.v.x * q.v.x + q.v.y * q.v.y + q.v.z * q.v.z );
+    const double scale = length > 0.0 ? ( q.r < 0.0 ? -g_quaternionScale : g_quaternionScale ) / length : 0.0;
+    out[0] = static_cast<int16_t>( std::lround( q.r * scale ) );
+    out[1] = static_cast<int16_t>( std::lround( q.v.x * scale ) );
+    out[2] = static_cast<int16_t>( std::lround( q.v.y * scale ) );
+    out[3] = static_cast<int16_t>( std::lround( q.v.z * scale ) );
+}
+
+AtomsCore::Quaternion dequantise( const int16_t* q )
+{
+    AtomsCore::Quaternion result( q[0], q[1], q[2], q[3] );
+    const double length = std::sqrt( result.r * result.r + result.v.x * result.v.x + result.v.y * result.v.y + result.v.z * result.v.z );
+    if ( length > 0.0 )
+    {
+        result.r /= length;
+        result.v /= length;
+    }
+    else
+    {
+        result.r = 1.0;
+    }
+    return result;
+}
+
+template<typename T>
+void storeVector( const T& v, float* out )
+{
+    out[0] = static_cast<float>( v.x );
+    out[1] = static_cast<float>( v.y );
+    out[2] = static_cast<float>( v.z );
+}
+
+AtomsCore::Vector3 loadVector( const float* v )
+{
+    return AtomsCore::Vector3( v[0], v[1], v[2] );
+}
+
+template<typename T>
+size_t vectorMemory( const std::vector<T>& v )
+{
+    return v.capacity() * sizeof( T );
+}
+
+} // namespace
+
+// The agents of a frame, stored as structure of arrays indexed by the agent index.
+// The joints of the agent at index i start at jointOffsets[i] and end at jointOffsets[i+1].
+struct AtomsPlaybackCache::Frame
+{
+    std::vector<int> agentIds;
+    std::vector<uint32_t> agentTypes;
+    std::vector<float> bounds;
+
+    std::vector<uint8_t> metadataFlags;
+    std::vector<uint32_t> variations;
+    std::vector<uint32_t> lods;
+    // position, direction, velocity and scale, 12 floats for every agent
+    std::vector<float> vectors;
+
+    std::vector<uint32_t> jointOffsets;
+    // 4 components for every joint
+    std::vector<int16_t> rotations;
+    // 3 components for every joint
+    std::vector<float> translations;
+    std::vector<float> scales;
+
+    size_t memorySize() const
+    {
+        return vectorMemory( agentIds ) + vectorMemory( agentTypes ) + vectorMemory( bounds ) +
+            vectorMemory( metadataFlags ) + vectorMemory( variations ) + vectorMemory( lods ) + vectorMemory( vectors ) +
+            vectorMemory( jointOffsets ) + vectorMemory( rotations ) + vectorMemory( translations ) + vectorMemory( scales );
+    }
+};
+
+AtomsPlaybackCache::AtomsPlaybackCache( const std::string& cachePath, const std::string& cacheName, int startFrame, int endFrame, const Canceller* canceller ) :
+    m_startFrame( 0 ),
+    m_endFrame( -1 )
+{
+    Atoms::AtomsCache cache;
+    if ( !cache.openCache( cachePath, cacheName ) )
+    {
+        throw IOException( "AtomsPlaybackCache : Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
+    }
+
+    m_startFrame = std::max( startFrame, static_cast<int>( std::ceil( cache.startFrame() ) ) );
+    m_endFrame = std::min( endFrame, static_cast<int>( std::floor( cache.endFrame() ) ) );
+    if ( m_endFrame < m_startFrame )
+    {
+        return;
+    }
+
+    m_frames.resize( m_endFrame - m_startFrame + 1 );
+
+    // Every frame is read from its own files, so the frames are loaded in parallel, each chunk with its own cache
+    tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+    tbb::parallel_for( tbb::blocked_range<int>( m_startFrame, m_endFrame + 1 ), [&]( const tbb::blocked_range<int>& range )
+    {
+        Atoms::AtomsCache chunkCache;
+        if ( !chunkCache.openCache( cachePath, cacheName ) )
+        {
+            throw IOException( "AtomsPlaybackCache : Unable to load the atoms cache " + cachePath + "/" + cacheName + ".atoms" );
+        }
+
+        for ( int frame = range.begin(); frame != range.end(); ++frame )
+        {
+            Canceller::check( canceller );
+            loadFrame( chunkCache, frame );
+        }
+    }, taskGroupContext );
+
+    // The table is only needed to share the names while the frames are loaded
+    m_stringIndices.clear();
+}
+
+AtomsPlaybackCache::~AtomsPlaybackCache()
+{
+}
+
+int AtomsPlaybackCache::startFrame() const
+{
+    return m_startFrame;
+}
+
+int AtomsPlaybackCache::endFrame() const
+{
+    return m_endFrame;
+}
+
+bool AtomsPlaybackCache::hasFrame( int frame ) const
+{
+    return frame >= m_startFrame && frame <= m_endFrame;
+}
+
+const std::vector<int>& AtomsPlaybackCache::agentIds( int frame ) const
+{
+    return this->frame( frame ).agentIds;
+}
+
+const std::string& AtomsPlaybackCache::agentType( int frame, int agentId ) const
+{
+    const Frame& frameData = this->frame( frame );
+    return m_strings[frameData.agentTypes[agentIndex( frameData, agentId )]];
+}
+
+void AtomsPlaybackCache::agentBoundingBox( int frame, int agentId, AtomsCore::Box3& box ) const
+{
+    const Frame& frameData = this->frame( frame );
+    const float* bounds = frameData.bounds.data() + agentIndex( frameData, agentId ) * 6;
+    box.min = loadVector( bounds );
+    box.max = loadVector( bounds + 3 );
+}
+
+void AtomsPlaybackCache::loadAgent( int frame, int agentId, AtomsCore::PoseMetadata& pose, AtomsCore::MapMetadata& metadata ) const
+{
+    const Frame& frameData = this->frame( frame );
+    const size_t index = agentIndex( frameData, agentId );
+
+    const uint32_t firstJoint = frameData.jointOffsets[index];
+    const uint32_t numJoints = frameData.jointOffsets[index + 1] - firstJoint;
+    pose.set( AtomsCore::Pose( numJoints ) );
+    AtomsCore::Pose& agentPose = pose.get();
+    for ( uint32_t j = 0; j < numJoints; ++j )
+    {
+        const uint32_t joint = firstJoint + j;
+        AtomsCore::JointPose& jointPose = agentPose.jointPose( j );
+        jointPose.rotation = dequantise( frameData.rotations.data() + joint * 4 );
+        jointPose.translation = loadVector( frameData.translations.data() + joint * 3 );
+        jointPose.scale = loadVector( frameData.scales.data() + joint * 3 );
+    }
+
+    const uint8_t flags = frameData.metadataFlags[index];
+    auto addString = [&metadata]( const char* name, const std::string& value )
+    {
+        AtomsPtr<AtomsCore::Metadata> entry( new AtomsCore::StringMetadata( value ) );
+        metadata.addEntry( name, entry, false );
+    };
+    auto addVector = [&metadata, &frameData, index]( const char* name, size_t vectorIndex )
+    {
+        AtomsPtr<AtomsCore::Metadata> entry( new AtomsCore::Vector3Metadata( loadVector( frameData.vectors.data() + index * 12 + vectorIndex * 3 ) ) );
+        metadata.addEntry( name, entry, false );
+    };
+
+    if ( flags & HasVariation )
+        addString( ATOMS_AGENT_VARIATION, m_strings[frameData.variations[index]] );
+    if ( flags & HasLod )
+        addString( ATOMS_AGENT_LOD, m_strings[frameData.lods[index]] );
+    if ( flags & HasPosition )
+        addVector( ATOMS_AGENT_POSITION, 0 );
+    if ( flags & HasDirection )
+        addVector( ATOMS_AGENT_DIRECTION, 1 );
+    if ( flags & HasVelocity )
+        addVector( ATOMS_AGENT_VELOCITY, 2 );
+    if ( flags & HasScale )
+        addVector( ATOMS_AGENT_SCALE, 3 );
+}
+
+size_t AtomsPlaybackCache::memorySize() const
+{
+    size_t result = sizeof( AtomsPlaybackCache ) + vectorMemory( m_frames );
+    for ( const Frame& frame : m_frames )
+    {
+        result += frame.memorySize();
+    }
+    for ( const std::string& value : m_strings )
+    {
+        result += value.capacity();
+    }
+    return result;
+}
+
+const AtomsPlaybackCache::Frame& AtomsPlaybackCache::frame( int frame ) const
+{
+    if ( !hasFrame( frame ) )
+    {
+        throw InvalidArgumentException( "AtomsPlaybackCache : Frame " + std::to_string( frame ) + " isn't stored" );
+    }
+    return m_frames[frame - m_startFrame];
+}
+
+size_t AtomsPlaybackCache::agentIndex( const Frame& frame, int agentId )
+{
+    auto it = std::lower_bound( frame.agentIds.begin(), frame.agentIds.end(), agentId );
+    if ( it == frame.agentIds.end() || *it != agentId )
+    {
+        throw InvalidArgumentException( "AtomsPlaybackCache : No agent " + std::to_string( agentId ) );
+    }
+    return it - frame.agentIds.begin();
+}
+
+void AtomsPlaybackCache::loadFrame( Atoms::AtomsCache& cache, int frame )
+{
+    cache.loadFrameHeader( frame );
+    std::vector<int> agentIds = cache.agentIds( frame );
+    std::sort( agentIds.begin(), agentIds.end() );
+    cache.setAgentsToLoad( agentIds );
+    cache.loadFrame( frame );
+
+    const size_t numAgents = agentIds.size();
+    Frame& frameData = m_frames[frame - m_startFrame];
+    frameData.agentTypes.resize( numAgents );
+    frameData.bounds.resize( numAgents * 6 );
+    frameData.metadataFlags.resize( numAgents, 0 );
+    frameData.variations.resize( numAgents, 0 );
+    frameData.lods.resize( numAgents, 0 );
+    frameData.vectors.resize( numAgents * 12, 0.0f );
+    frameData.jointOffsets.resize( numAgents + 1, 0 );
+
+    for ( size_t i = 0; i < numAgents; ++i )
+    {
+        const int agentId = agentIds[i];
+        frameData.agentTypes[i] = stringIndex( cache.agentType( frame, agentId ) );
+
+        AtomsCore::Box3 box;
+        cache.loadAgentBoundingBox( frame, agentId, box );
+        storeVector( box.min, frameData.bounds.data() + i * 6 );
+        storeVector( box.max, frameData.bounds.data() + i * 6 + 3 );
+
+        AtomsCore::Pose pose;
+        cache.loadAgentPose( frame, agentId, pose );
+        const size_t numJoints = pose.numJoints();
+        const size_t firstJoint = frameData.jointOffsets[i];
+        frameData.jointOffsets[i + 1] = firstJoint + numJoints;
+        frameData.rotations.resize( ( firstJoint + numJoints ) * 4 );
+        frameData.translations.resize( ( firstJoint + numJoints ) * 3 );
+        frameData.scales.resize( ( firstJoint + numJoints ) * 3 );
+        for ( size_t j = 0; j < numJoints; ++j )
+        {
+            const AtomsCore::JointPose& jointPose = pose.jointPose( j );
+            quantise( jointPose.rotation, frameData.rotations.data() + ( firstJoint + j ) * 4 );
+            storeVector( jointPose.translation, frameData.translations.data() + ( firstJoint + j ) * 3 );
+            storeVector( jointPose.scale, frameData.scales.data() + ( firstJoint + j ) * 3 );
+        }
+
+        AtomsCore::MapMetadata metadata;
+        cache.loadAgentMetadata( frame, agentId, metadata );
+        uint8_t& flags = frameData.metadataFlags[i];
+        if ( auto variation = metadata.getTypedEntry<AtomsCore::StringMetadata>( ATOMS_AGENT_VARIATION ) )
+        {
+            flags |= HasVariation;
+            frameData.variations[i] = stringIndex( variation->get() );
+        }
+        if ( auto lod = metadata.getTypedEntry<AtomsCore::StringMetadata>( ATOMS_AGENT_LOD ) )
+        {
+            flags |= HasLod;
+            frameData.lods[i] = stringIndex( lod->get() );
+        }
+
+        const char* vectorNames[] = { ATOMS_AGENT_POSITION, ATOMS_AGENT_DIRECTION, ATOMS_AGENT_VELOCITY, ATOMS_AGENT_SCALE };
+        const uint8_t vectorFlags[] = { HasPosition, HasDirection, HasVelocity, HasScale };
+        for ( size_t v = 0; v < 4; ++v )
+        {
+            if ( auto vector = metadata.getTypedEntry<AtomsCore::Vector3Metadata>( vectorNames[v] ) )
+            {
+                flags |= vectorFlags[v];
+                storeVector( vector->get(), frameData.vectors.data() + i * 12 + v * 3 );
+            }
+        }
+    }
+
+    frameData.agentIds.swap( agentIds );
+    frameData.rotations.shrink_to_fit();
+    frameData.translations.shrink_to_fit();
+    frameData.scales.shrink_to_fit();
+}
+
+uint32_t AtomsPlaybackCache::stringIndex( const std::string& value )
+{
+    std::lock_guard<std::mutex> lock( m_stringsMutex );
+    auto it = m_stringIndices.find( value );
+    if ( it != m_stringIndices.end() )
+    {
+        return it->second;
+    }
+
+    const uint32_t index = m_strings.size();
+    m_strings.push_back( value );
+    m_stringIndices.emplace( value, index );
+    return index;
+}
@@ -0,0 +1,207 @@
+//////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2018, Toolchefs Ltd. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//      * Redistributions of source code must retain the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer.
+//
+//      * Redistributions in binary form must reproduce the above
+//        copyright notice, this list of conditions and the following
+//        disclaimer in the documentation and/or other materials provided with
+//        the distribution.
+//
+//      * Neither the name of John Haddon nor the names of
+//        any other contributors to this software may be used to endorse or
+//        promote products derived from this software without specific prior
+//        written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+//  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+//  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+//  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+//  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+//  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AtomsGaffer/AtomsStatistics.h"
+
+#include "IECore/SimpleTypedData.h"
+
+using namespace IECore;
+using namespace AtomsGaffer;
+
+namespace
+{
+
+template<typename DataType, typename Map>
+CompoundDataPtr mapData( const Map& map )
+{
+    CompoundDataPtr result = new CompoundData;
+    auto& members = result->writable();
+    for ( const auto& it : map )
+    {
+        members[it.first] = new DataType( it.second );
+    }
+    return result;
+}
+
+} // namespace
+
+AtomsStatistics::AtomsStatistics( const AtomsStatistics& other )
+{
+    std::lock_guard<std::mutex> lock( other.m_mutex );
+    m_memory = other.m_memory;
+    m_counts = other.m_counts;
+    m_times = other.m_times;
+    m_events = other.m_events;
+}
+
+AtomsStatistics& AtomsStatistics::operator=( const AtomsStatistics& other )
+{
+    if ( this == &other )
+    {
+        return *this;
+    }
+
+    AtomsStatistics copy( other );
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_memory.swap( copy.m_memory );
+    m_counts.swap( copy.m_counts );
+    m_times.swap( copy.m_times );
+    m_events.swap( copy.m_events );
+    return *this;
+}
+
+void AtomsStatistics::setMemory( const std::string& category, size_t bytes )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_memory[category] = bytes;
+}
+
+void AtomsStatistics::setCount( const std::string& name, int64_t count )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_counts[name] = count;
+}
+
+void AtomsStatistics::addTime( const std::string& stage, double seconds )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_times[stage] += seconds;
+}
+
+void AtomsStatistics::addEvent( const std::string& name, int64_t count )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_events[name] += count;
+}
+
+size_t AtomsStatistics::totalMemory() const
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    size_t result = 0;
+    for ( const auto& it : m_memory )
+    {
+        result += it.second;
+    }
+    return result;
+}
+
+void AtomsStatistics::merge( const AtomsStatistics& other )
+{
+    if ( this == &other )
+    {
+        return;
+    }
+
+    AtomsStatistics copy( other );
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for ( const auto& it : copy.m_memory )
+    {
+        m_memory[it.first] = it.second;
+    }
+    for ( const auto& it : copy.m_counts )
+    {
+        m_counts[it.first] = it.second;
+    }
+    for ( const auto& it : copy.m_times )
+    {
+        m_times[it.first] += it.second;
+    }
+    for ( const auto& it : copy.m_events )
+    {
+        m_events[it.first] += it.second;
+    }
+}
+
+void AtomsStatistics::accumulate( const AtomsStatistics& other )
+{
+    if ( this == &other )
+    {
+        return;
+    }
+
+    AtomsStatistics copy( other );
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for ( const auto& it : copy.m_memory )
+    {
+        m_memory[it.first] += it.second;
+    }
+    for ( const auto& it : copy.m_counts )
+    {
+        m_counts[it.first] += it.second;
+    }
+    for ( const auto& it : copy.m_times )
+    {
+        m_times[it.first] += it.second;
+    }
+    for ( const auto& it : copy.m_events )
+    {
+        m_events[it.first] += it.second;
+    }
+}
+
+void AtomsStatistics::clear()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_memory.clear();
+    m_counts.clear();
+    m_times.clear();
+    m_events.clear();
+}
+
+CompoundDataPtr AtomsStatistics::data() const
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    CompoundDataPtr result = new CompoundData;
+    auto& members = result->writable();
+    members["memory"] = mapData<UInt64Data>( m_memory );
+    members["counts"] = mapData<Int64Data>( m_counts );
+    members["time"] = mapData<DoubleData>( m_times );
+    members["events"] = mapData<Int64Data>( m_events );
+    return result;
+}
+
+AtomsStatistics::ScopedTimer::ScopedTimer( AtomsStatistics& statistics, const std::string& stage ) :
+    m_statistics( statistics ),
+    m_stage( stage ),
+    m_start( std::chrono::steady_clock::now() )
+{
+}
+
+AtomsStatistics::ScopedTimer::~ScopedTimer()
+{
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+    m_statistics.addTime( m_stage, elapsed.count() );
+}
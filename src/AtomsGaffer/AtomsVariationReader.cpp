@@ -39,6 +39,7 @@
 #include "AtomsGaffer/AtomsMathTranaslator.h"
 
 #include "IECoreScene/MeshPrimitive.h"
+#include "IECore/Canceller.h"
 #include "IECore/NullObject.h"
 #include "IECoreScene/PointsPrimitive.h"
 
@@ -62,7 +63,11 @@
 #include "AtomsCore/Metadata/StringArrayMetadata.h"
 #include "AtomsCore/Metadata/BoolArrayMetadata.h"
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
 #include <list>
+#include <map>
 
 IE_CORE_DEFINERUNTIMETYPED( AtomsGaffer::AtomsVariationReader );
 
@@ -286,7 +291,9 @@ public :
         }
     };
 
-    EngineData( const std::string& filePath ):
+    // The canceller is checked between the agent types and between the meshes. The engine isn't shared
+    // before it is fully built, so a cancelled engine is simply discarded.
+    EngineData( const std::string& filePath, const Canceller* canceller ):
         m_filePath( filePath ),
         m_totalMemory( 0 )
     {
@@ -295,6 +302,9 @@ public :
         if ( filePath.empty() )
             return;
 
+        AtomsStatistics::ScopedTimer totalTimer( m_statistics, "total" );
+        m_statistics.addEvent( "engineLoads" );
+
         std::string fullFilePath = AtomsUtils::solvePath( filePath );
 
         if ( !AtomsUtils::fileExists( fullFilePath.c_str() ) )
@@ -302,7 +312,10 @@ public :
             throw InvalidArgumentException( "AtomsVariationsReader: " + fullFilePath + " doesn't exist" );
         }
 
-        m_variations = Atoms::loadVariationFromFile( fullFilePath );
+        {
+            AtomsStatistics::ScopedTimer timer( m_statistics, "loadVariations" );
+            m_variations = Atoms::loadVariationFromFile( fullFilePath );
+        }
 
         auto agentTypeNames = m_variations.getAgentTypeNames();
         if ( agentTypeNames.empty() )
@@ -314,6 +327,7 @@ public :
         // In Gaffer the full path is built so this build a tree containing the full hierarchy of all the meshes
         for ( size_t aTypeId = 0; aTypeId != agentTypeNames.size(); ++aTypeId )
         {
+            Canceller::check( canceller );
 
             const auto& agentTypeName = agentTypeNames[aTypeId];
             auto& agentTypeRoot = m_root.children[agentTypeName];
@@ -322,7 +336,10 @@ public :
             if ( !agentTypePtr )
                 continue;
 
-            loadAgentTypeMesh( agentTypePtr, agentTypeName );
+            {
+                AtomsStatistics::ScopedTimer timer( m_statistics, "loadMeshes" );
+                loadAgentTypeMesh( agentTypePtr, agentTypeName, canceller );
+            }
 
             auto agentTypeIt = m_meshesFileCache.find( agentTypeName );
             if ( agentTypeIt == m_meshesFileCache.end() )
@@ -506,22 +523,40 @@ public :
 
 
         m_totalMemory += AtomsCore::memSize( m_filePath );
+        m_statistics.setMemory( "variations", m_totalMemory );
 
+        size_t meshesMemory = 0;
+        int64_t numMeshes = 0;
         for (auto aTypeIt = m_meshesFileCache.cbegin(); aTypeIt != m_meshesFileCache.cend(); ++aTypeIt)
         {
             for (auto meshIt = aTypeIt->second.cbegin(); meshIt != aTypeIt->second.cend(); ++meshIt)
             {
                 if ( meshIt->second )
-                    m_totalMemory += meshIt->second->memSize();
+                {
+                    meshesMemory += meshIt->second->memSize();
+                    ++numMeshes;
+                }
             }
         }
+        m_statistics.setMemory( "meshes", meshesMemory );
 
+        size_t hierarchyMemory = 0;
         if ( m_hierarchy )
-            m_totalMemory += m_hierarchy->memSize();
+            hierarchyMemory += m_hierarchy->memSize();
 
-        m_totalMemory += AtomsCore::memSize( m_defaultSets );
+        hierarchyMemory += AtomsCore::memSize( m_defaultSets );
 
-        m_totalMemory += m_root.memSize();
+        hierarchyMemory += m_root.memSize();
+        m_statistics.setMemory( "hierarchy", hierarchyMemory );
+
+        m_statistics.setCount( "agentTypes", agentTypeNames.size() );
+        m_statistics.setCount( "meshes", numMeshes );
+        m_totalMemory = m_statistics.totalMemory();
+    }
+
+    const AtomsStatistics& statistics() const
+    {
+        return m_statistics;
     }
 
     virtual ~EngineData()
@@ -741,9 +776,14 @@ public :
         return geoMap;
     }
 
-    void loadAgentTypeMesh( Atoms::AgentTypeVariationCPtr agentTypePtr, const std::string& agentTypeName )
+    void loadAgentTypeMesh( Atoms::AgentTypeVariationCPtr agentTypePtr, const std::string& agentTypeName, const Canceller* canceller )
     {
         auto geoNames = agentTypePtr->getGeometryNames();
+
+        // The geos often share a mesh file, and Atoms::loadMesh isn't safe to call concurrently for the
+        // same file, so the files are loaded in parallel and the geos of a file one after the other.
+        // The hierarchy is then built in the order of the geos.
+        std::map<std::string, std::vector<size_t>> fileGeos;
         for ( size_t geoId = 0; geoId != geoNames.size(); ++geoId )
         {
             auto geoPtr = agentTypePtr->getGeometryPtr( geoNames[geoId] );
@@ -753,13 +793,43 @@ public :
             if ( geoPtr->getGeometryFile().find(".groom") != std::string::npos )
                 continue;
 
-            auto inGeoMap = Atoms::loadMesh( geoPtr->getGeometryFile(), geoPtr->getGeometryFilter() );
-            if ( !inGeoMap )
+            fileGeos[geoPtr->getGeometryFile()].push_back( geoId );
+        }
+
+        std::vector<const std::vector<size_t>*> files;
+        files.reserve( fileGeos.size() );
+        for ( const auto& file : fileGeos )
+        {
+            files.push_back( &file.second );
+        }
+
+        std::vector<AtomsPtr<AtomsCore::MapMetadata>> inGeoMaps( geoNames.size() );
+        tbb::task_group_context taskGroupContext( tbb::task_group_context::isolated );
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, files.size(), 1 ), [&]( const tbb::blocked_range<size_t>& range )
+        {
+            for ( size_t fileId = range.begin(); fileId != range.end(); ++fileId )
             {
-                throw InvalidArgumentException( "AtomsVariationsReader: Invalid geo: " +
-                geoPtr->getGeometryFile() +":" + geoPtr->getGeometryFilter() );
+                for ( size_t geoId : *files[fileId] )
+                {
+                    Canceller::check( canceller );
+                    auto geoPtr = agentTypePtr->getGeometryPtr( geoNames[geoId] );
+                    inGeoMaps[geoId] = Atoms::loadMesh( geoPtr->getGeometryFile(), geoPtr->getGeometryFilter() );
+                    if ( !inGeoMaps[geoId] )
+                    {
+                        throw InvalidArgumentException( "AtomsVariationsReader: Invalid geo: " +
+                        geoPtr->getGeometryFile() +":" + geoPtr->getGeometryFilter() );
+                    }
+                }
             }
+        }, taskGroupContext );
+
+        for ( size_t geoId = 0; geoId != geoNames.size(); ++geoId )
+        {
+            const auto& inGeoMap = inGeoMaps[geoId];
+            if ( !inGeoMap )
+                continue;
 
+            auto geoPtr = agentTypePtr->getGeometryPtr( geoNames[geoId] );
             auto* agentTypeRoot = &m_root.children[agentTypeName];
             AtomsPtr<AtomsCore::MapMetadata> atomsGeoMap( new AtomsCore::MapMetadata );
             flatMeshHierarchy(inGeoMap.get(), atomsGeoMap, agentTypeRoot);
@@ -919,6 +989,8 @@ private :
     AtomsDagNode m_root;
 
     size_t m_totalMemory;
+
+    AtomsStatistics m_statistics;
 };
 
 size_t AtomsVariationReader::g_firstPlugIndex = 0;
@@ -985,6 +1057,16 @@ const Gaffer::ObjectPlug *AtomsVariationReader::enginePlug() const
 	return getChild<ObjectPlug>( g_firstPlugIndex + 4 );
 }
 
+IECore::CompoundDataPtr AtomsVariationReader::statistics() const
+{
+	return m_statistics.data();
+}
+
+void AtomsVariationReader::clearStatistics()
+{
+	m_statistics.clear();
+}
+
 void AtomsVariationReader::affects( const Plug *input, AffectedPlugsContainer &outputs ) const
 {
 	if( input == atomsVariationFilePlug() || input == refreshCountPlug() ||
@@ -1011,9 +1093,9 @@ Gaffer::ValuePlug::CachePolicy AtomsVariationReader::computeCachePolicy( const G
 {
 	if( output == enginePlug() )
 	{
-		// Request blocking compute for the engine, to avoid concurrent threads
-        // loading the same engine redundantly.
-		return ValuePlug::CachePolicy::Standard;
+		// The meshes are loaded with a parallel loop, so rather than blocking, the threads
+		// waiting for the same engine help loading it
+		return ValuePlug::CachePolicy::TaskCollaboration;
 	}
 
 	return SceneNode::computeCachePolicy( output );
@@ -1735,7 +1817,9 @@ void AtomsVariationReader::compute( Gaffer::ValuePlug *output, const Gaffer::Con
 	// branch.
 	if (output == enginePlug()) {
 
-		static_cast<ObjectPlug *>( output )->setValue(new EngineData(atomsVariationFilePlug()->getValue()));
+		ConstEngineDataPtr engineData = new EngineData( atomsVariationFilePlug()->getValue(), context->canceller() );
+		m_statistics.merge( engineData->statistics() );
+		static_cast<ObjectPlug *>( output )->setValue( engineData );
 		return;
 	}
 
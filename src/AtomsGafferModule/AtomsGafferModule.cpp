@@ -37,6 +37,7 @@
 #include "boost/python.hpp"
 
 #include "IECorePython/RunTimeTypedBinding.h"
+#include "IECorePython/ScopedGILRelease.h"
 
 #include "AtomsGaffer/AtomsCrowdReader.h"
 #include "AtomsGaffer/AtomsVariationReader.h"
@@ -44,9 +45,16 @@
 #include "AtomsGaffer/AtomsAttributes.h"
 #include "AtomsGaffer/AtomsMetadata.h"
 #include "AtomsGaffer/AtomsCrowdClothReader.h"
+#include "AtomsGaffer/AtomsCrowdData.h"
+#include "AtomsGaffer/AtomsPaletteKernel.h"
+#include "AtomsGaffer/AtomsCacheIndex.h"
 
 #include "GafferBindings/DependencyNodeBinding.h"
 #include "IECore/MessageHandler.h"
+#include "IECore/SimpleTypedData.h"
+#include "IECore/VectorTypedData.h"
+
+#include <algorithm>
 
 #include "Atoms/Initialize.h"
 #include "AtomsUtils/Logger.h"
@@ -83,6 +91,153 @@ public:
 	}
 };
 
+namespace
+{
+
+void setAgents( AtomsGaffer::AtomsCrowdData &crowd, object agentIds, object numJoints, bool compact )
+{
+	std::vector<int> ids;
+	std::vector<size_t> joints;
+	for( long i = 0, e = len( agentIds ); i < e; ++i )
+	{
+		ids.push_back( extract<int>( agentIds[i] ) );
+	}
+	for( long i = 0, e = len( numJoints ); i < e; ++i )
+	{
+		joints.push_back( extract<size_t>( numJoints[i] ) );
+	}
+	crowd.setAgents( ids, joints, compact );
+}
+
+IECore::IntVectorDataPtr agentIds( const AtomsGaffer::AtomsCrowdData &crowd )
+{
+	return new IECore::IntVectorData( crowd.agentIds() );
+}
+
+int agentIndexOrThrow( const AtomsGaffer::AtomsCrowdData &crowd, int agentId )
+{
+	const int index = crowd.agentIndex( agentId );
+	if( index < 0 )
+	{
+		throw IECore::InvalidArgumentException( "AtomsCrowdData : No agent " + std::to_string( agentId ) );
+	}
+	return index;
+}
+
+// Returns the data of an agent in the same layout of the AtomsCrowdReader per agent CompoundData
+IECore::CompoundDataPtr agentData( const AtomsGaffer::AtomsCrowdData &crowd, int agentId )
+{
+	const int index = agentIndexOrThrow( crowd, agentId );
+
+	IECore::CompoundDataPtr result = new IECore::CompoundData;
+	auto &agentData = result->writable();
+	IECore::M44dVectorDataPtr worldMatricesData = new IECore::M44dVectorData;
+	crowd.skinningMatrices( index, worldMatricesData->writable() );
+	IECore::M44dVectorDataPtr normalMatricesData = new IECore::M44dVectorData;
+	if( crowd.isCompact() )
+	{
+		// The compact crowds don't store the normal matrices
+		for( const auto &m : worldMatricesData->readable() )
+		{
+			normalMatricesData->writable().push_back( m.inverse().transpose() );
+		}
+	}
+	else
+	{
+		const Imath::M44d *normalMatrices = crowd.normalMatrices( index );
+		normalMatricesData->writable().assign( normalMatrices, normalMatrices + crowd.numJoints( index ) );
+	}
+	agentData["poseWorldMatrices"] = worldMatricesData;
+	agentData["poseNormalWorldMatrices"] = normalMatricesData;
+	agentData["rootMatrix"] = new IECore::M44dData( crowd.rootMatrices()[index] );
+	agentData["boundingBox"] = new IECore::Box3dData( crowd.bounds()[index] );
+	agentData["hash"] = new IECore::UInt64Data( crowd.poseHashes()[index] );
+	agentData["agentType"] = new IECore::StringData( crowd.agentTypes()[index] );
+	if( crowd.metadata()[index] )
+	{
+		agentData["metadata"] = crowd.metadata()[index]->copy();
+	}
+	return result;
+}
+
+// Stores the data of an agent from the layout returned by agentData
+void setAgentData( AtomsGaffer::AtomsCrowdData &crowd, int agentId, const IECore::CompoundData *data )
+{
+	const int index = agentIndexOrThrow( crowd, agentId );
+	if( auto matrices = data->member<IECore::M44dVectorData>( "poseWorldMatrices" ) )
+	{
+		const size_t numMatrices = std::min( matrices->readable().size(), crowd.numJoints( index ) );
+		if( crowd.isCompact() )
+		{
+			for( size_t j = 0; j < numMatrices; ++j )
+			{
+				AtomsGaffer::AtomsCrowdData::compactMatrix( matrices->readable()[j], crowd.compactMatrices( index ) + j * 12 );
+			}
+		}
+		else
+		{
+			std::copy_n( matrices->readable().begin(), numMatrices, crowd.worldMatrices( index ) );
+		}
+	}
+	// The compact crowds don't store the normal matrices
+	auto normalMatrices = data->member<IECore::M44dVectorData>( "poseNormalWorldMatrices" );
+	if( normalMatrices && !crowd.isCompact() )
+	{
+		std::copy_n( normalMatrices->readable().begin(), std::min( normalMatrices->readable().size(), crowd.numJoints( index ) ), crowd.normalMatrices( index ) );
+	}
+	if( auto rootMatrix = data->member<IECore::M44dData>( "rootMatrix" ) )
+	{
+		crowd.rootMatrices()[index] = rootMatrix->readable();
+	}
+	if( auto bound = data->member<IECore::Box3dData>( "boundingBox" ) )
+	{
+		crowd.bounds()[index] = bound->readable();
+	}
+	if( auto hash = data->member<IECore::UInt64Data>( "hash" ) )
+	{
+		crowd.poseHashes()[index] = hash->readable();
+	}
+	if( auto agentType = data->member<IECore::StringData>( "agentType" ) )
+	{
+		crowd.agentTypes()[index] = agentType->readable();
+	}
+	if( auto metadata = data->member<IECore::CompoundData>( "metadata" ) )
+	{
+		crowd.metadata()[index] = metadata->copy();
+	}
+}
+
+tuple skinningMatrices( const IECore::M44dVectorData *bindInverse, const IECore::M44dVectorData *world, AtomsGaffer::AtomsPaletteKernel::Implementation implementation )
+{
+	if( bindInverse->readable().size() != world->readable().size() )
+	{
+		throw IECore::InvalidArgumentException( "AtomsPaletteKernel : bindInverse and world must have the same length" );
+	}
+
+	const size_t count = world->readable().size();
+	IECore::M44dVectorDataPtr skinning = new IECore::M44dVectorData( std::vector<Imath::M44d>( count ) );
+	IECore::M44dVectorDataPtr normals = new IECore::M44dVectorData( std::vector<Imath::M44d>( count ) );
+	AtomsGaffer::AtomsPaletteKernel::skinningMatrices(
+		bindInverse->readable().data(), world->readable().data(), count,
+		skinning->writable().data(), normals->writable().data(), implementation
+	);
+	return make_tuple( skinning, normals );
+}
+
+// The index is built in parallel without calling back into python, so release the GIL while building
+int buildCacheIndex( const std::string &atomsSimFile )
+{
+	IECorePython::ScopedGILRelease gilRelease;
+	return AtomsGaffer::AtomsCacheIndex::build( atomsSimFile );
+}
+
+void buildCacheFrameIndex( const std::string &cachePath, const std::string &cacheName, int frame )
+{
+	IECorePython::ScopedGILRelease gilRelease;
+	AtomsGaffer::AtomsCacheIndex::build( cachePath, cacheName, frame );
+}
+
+} // namespace
 
 BOOST_PYTHON_MODULE( _AtomsGaffer )
 {
@@ -91,11 +246,63 @@ BOOST_PYTHON_MODULE( _AtomsGaffer )
 	AtomsUtils::Logger::instance().setLogType(mayaLogger);
 	Atoms::initAtoms();
 
+	IECorePython::RunTimeTypedClass<AtomsGaffer::AtomsCrowdData>()
+		.def( init<>() )
+		.def( "setAgents", &setAgents, ( arg( "agentIds" ), arg( "numJoints" ), arg( "compact" ) = false ) )
+		.def( "isCompact", &AtomsGaffer::AtomsCrowdData::isCompact )
+		.def( "numAgents", &AtomsGaffer::AtomsCrowdData::numAgents )
+		.def( "agentIndex", &AtomsGaffer::AtomsCrowdData::agentIndex )
+		.def( "agentIds", &agentIds )
+		.def( "numJoints", &AtomsGaffer::AtomsCrowdData::numJoints )
+		.def( "agentData", &agentData )
+		.def( "setAgentData", &setAgentData )
+		.def( "getFrameOffset", &AtomsGaffer::AtomsCrowdData::getFrameOffset )
+		.def( "setFrameOffset", &AtomsGaffer::AtomsCrowdData::setFrameOffset )
+	;
+
+	{
+		scope s = class_<AtomsGaffer::AtomsPaletteKernel>( "AtomsPaletteKernel", no_init )
+			.def( "bestImplementation", &AtomsGaffer::AtomsPaletteKernel::bestImplementation )
+			.staticmethod( "bestImplementation" )
+			.def( "isSupported", &AtomsGaffer::AtomsPaletteKernel::isSupported )
+			.staticmethod( "isSupported" )
+			.def( "skinningMatrices", &skinningMatrices )
+			.staticmethod( "skinningMatrices" )
+		;
+
+		enum_<AtomsGaffer::AtomsPaletteKernel::Implementation>( "Implementation" )
+			.value( "Scalar", AtomsGaffer::AtomsPaletteKernel::Implementation::Scalar )
+			.value( "AVX2", AtomsGaffer::AtomsPaletteKernel::Implementation::AVX2 )
+		;
+	}
+
+	class_<AtomsGaffer::AtomsCacheIndex, boost::noncopyable>( "AtomsCacheIndex", no_init )
+		.def( "indexPath", &AtomsGaffer::AtomsCacheIndex::indexPath )
+		.staticmethod( "indexPath" )
+		.def( "build", &buildCacheIndex )
+		.def( "build", &buildCacheFrameIndex )
+		.staticmethod( "build" )
+	;
+
 	typedef GafferBindings::DependencyNodeWrapper<AtomsGaffer::AtomsCrowdReader> AtomsCrowdReaderWrapper;
-	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsCrowdReader, AtomsCrowdReaderWrapper>();
+	{
+		scope s = GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsCrowdReader, AtomsCrowdReaderWrapper>()
+			.def( "statistics", &AtomsGaffer::AtomsCrowdReader::statistics )
+			.def( "clearStatistics", &AtomsGaffer::AtomsCrowdReader::clearStatistics )
+		;
+
+		enum_<AtomsGaffer::AtomsCrowdReader::CullMode>( "CullMode" )
+			.value( "CullOff", AtomsGaffer::AtomsCrowdReader::CullOff )
+			.value( "CullBox", AtomsGaffer::AtomsCrowdReader::CullBox )
+			.value( "CullCamera", AtomsGaffer::AtomsCrowdReader::CullCamera )
+		;
+	}
 
 	typedef GafferBindings::DependencyNodeWrapper<AtomsGaffer::AtomsVariationReader> AtomsVariationReaderWrapper;
-	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsVariationReader, AtomsVariationReaderWrapper>();
+	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsVariationReader, AtomsVariationReaderWrapper>()
+		.def( "statistics", &AtomsGaffer::AtomsVariationReader::statistics )
+		.def( "clearStatistics", &AtomsGaffer::AtomsVariationReader::clearStatistics )
+	;
 
 	typedef GafferBindings::DependencyNodeWrapper<AtomsGaffer::AtomsCrowdGenerator> AtomsCrowdGeneratorWrapper;
 	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsCrowdGenerator, AtomsCrowdGeneratorWrapper>();
@@ -104,7 +311,10 @@ BOOST_PYTHON_MODULE( _AtomsGaffer )
 	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsAttributes, AtomsAttributesWrapper>();
 
 	typedef GafferBindings::DependencyNodeWrapper<AtomsGaffer::AtomsCrowdClothReader> AtomsCrowdClothReaderWrapper;
-	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsCrowdClothReader, AtomsCrowdClothReaderWrapper>();
+	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsCrowdClothReader, AtomsCrowdClothReaderWrapper>()
+		.def( "statistics", &AtomsGaffer::AtomsCrowdClothReader::statistics )
+		.def( "clearStatistics", &AtomsGaffer::AtomsCrowdClothReader::clearStatistics )
+	;
 
 	typedef GafferBindings::DependencyNodeWrapper<AtomsGaffer::AtomsMetadata> AtomsMetadataWrapper;
 	GafferBindings::DependencyNodeClass<AtomsGaffer::AtomsMetadata, AtomsMetadataWrapper>();